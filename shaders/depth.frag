@@ -1,14 +1,14 @@
 #version 460 core
+#extension GL_GOOGLE_include_directive : require
 
 layout (location = 0) in vec4 FragPos;
 
-layout (location = 1) uniform vec3 lightPos;
-layout (location = 2) uniform float far_plane;
+#include "light_data.glsl"
 
 void main() {
-    float lightDistance = length(FragPos.xyz - lightPos);
+    float lightDistance = length(FragPos.xyz - light.positionRadius.xyz);
 
-    lightDistance = lightDistance / far_plane;
+    lightDistance = lightDistance / light.far_plane;
 
     gl_FragDepth = lightDistance;
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #version 460 core
+#extension GL_GOOGLE_include_directive : require
 
 layout (location = 0) in vec3 aPos;
 
-layout (location = 0) uniform mat4 matrix_model;
+#include "draw_data.glsl"
+layout (location = 0) uniform int draw_offset;
 
 void main() {
-    gl_Position = matrix_model * vec4(aPos, 1.0);
+    DrawData draw = draws[draw_offset + gl_DrawID];
+    vec3 position = aPos * draw.positionScale.xyz + draw.positionOffset.xyz;
+    gl_Position = draw.matrix_model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 460 core
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 aPos;
+
+#include "light_data.glsl"
+
+#include "draw_data.glsl"
+layout (location = 0) uniform int draw_offset;
+layout (location = 1) uniform int face;
+
+layout (location = 0) out vec4 FragPos;
+
+// renders a single cube face, the face is attached directly so no layer selection is needed
+void main() {
+    DrawData draw = draws[draw_offset + gl_DrawID];
+    vec3 position = aPos * draw.positionScale.xyz + draw.positionOffset.xyz;
+    FragPos = draw.matrix_model * vec4(position, 1.0);
+    gl_Position = light.shadowMatrices[face] * FragPos;
+}
@@ -0,0 +1,19 @@
+#version 460 core
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 vPos;
+
+#include "frame_data.glsl"
+#include "draw_data.glsl"
+layout (location = 1) uniform int draw_offset;
+
+// the scene pass tests against these depths with GL_EQUAL, so the position has to be computed exactly like pbr.vert
+invariant gl_Position;
+
+void main() {
+    DrawData draw = draws[draw_offset + gl_DrawID];
+    vec3 position = vPos * draw.positionScale.xyz + draw.positionOffset.xyz;
+    vec3 worldPos = vec3(draw.matrix_model * vec4(position, 1.0f));
+
+    gl_Position = frame.matrix_viewproj * vec4(worldPos, 1.0f);
+}
@@ -0,0 +1,10 @@
+// per-draw data indexed by draw_offset + gl_DrawID; mirrors DrawData in shader_data.h
+struct DrawData {
+    mat4 matrix_model;
+    vec4 positionScale;
+    vec4 positionOffset;
+    uint materialIndex;
+};
+layout (std430, binding = 2) readonly buffer DrawBuffer {
+    DrawData draws[];
+};
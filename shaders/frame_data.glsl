@@ -0,0 +1,14 @@
+// the one declaration of the per frame uniform block, every stage includes it so the block matches across a
+// program; mirrors FrameData in shader_data.h
+layout (std140, binding = 0) uniform FrameData {
+    mat4 matrix_viewproj;
+    vec4 camPos;
+    float gamma;
+    float exposure;
+    float shadowBias;
+    mat4 view;
+    uvec4 clusterGrid;
+    vec4 clusterTile;
+    vec4 clusterDepth;
+    vec4 projectionScale;
+} frame;
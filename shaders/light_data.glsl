@@ -0,0 +1,7 @@
+// the shadowed point light; mirrors LightData in shader_data.h
+layout (std140, binding = 1) uniform LightData {
+    mat4 shadowMatrices[6];
+    vec4 positionRadius;
+    vec4 colorPower;
+    float far_plane;
+} light;
@@ -0,0 +1,9 @@
+#version 460 core
+
+layout (location = 0) out vec4 FragColor;
+
+// drawn additively in place of the material shader, every fragment that passes the depth test would have been
+// shaded; red saturates after 8 layers, green after 16 and blue after 32, so the count reads as a heat ramp
+void main() {
+    FragColor = vec4(1.0f / 8.0f, 1.0f / 16.0f, 1.0f / 32.0f, 1.0f);
+}
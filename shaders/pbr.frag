@@ -1,221 +1,13 @@
 #version 460 core
-layout (location = 0) out vec4 outColor;
+#extension GL_GOOGLE_include_directive : require
 
-layout (location = 0) in vec2 fUV;
-layout (location = 1) in vec3 fWorldPos;
-layout (location = 2) in vec3 fNormal;
+// every texture pool bound at once, MAX_TEXTURE_POOLS from texture_pool.h
+layout (binding = 4) uniform sampler2DArray texture_pools[12];
 
-// material parameters
-layout (binding = 0) uniform sampler2D texture_base;
-layout (binding = 1) uniform sampler2D texture_normal;
-layout (binding = 2) uniform sampler2D texture_roughness;
-layout (binding = 3) uniform samplerCube depth_map;
-
-layout (location = 4) uniform vec3 camPos;
-layout (location = 5) uniform float lightRadius;
-layout (location = 6) uniform float lightPower;
-layout (location = 7) uniform vec3 lightColor;
-layout (location = 8) uniform float far_plane;
-layout (location = 9) uniform vec3 lightPos;
-layout (location = 10) uniform float gamma;
-layout (location = 11) uniform float shadowBias;
-
-// array of offset direction for sampling
-vec3 gridSamplingDisk[20] = vec3[]
-(
-vec3(1, 1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1, 1,  1),
-vec3(1, 1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
-vec3(1, 1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1, 1,  0),
-vec3(1, 0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1, 0, -1),
-vec3(0, 1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0, 1, -1)
-);
-
-float ShadowCalculation(vec3 fragPos)
-{
-    // get vector between fragment position and light position
-    vec3 fragToLight = fragPos - lightPos;
-    // use the fragment to light vector to sample from the depth map
-    // float closestDepth = texture(depthMap, fragToLight).r;
-    // it is currently in linear range between [0,1], let's re-transform it back to original depth value
-    // closestDepth *= far_plane;
-    // now get current linear depth as the length between the fragment and light position
-    float currentDepth = length(fragToLight);
-    // test for shadows
-    // float bias = 0.05; // we use a much larger bias since depth is now in [near_plane, far_plane] range
-    // float shadow = currentDepth -  bias > closestDepth ? 1.0 : 0.0;
-    // PCF
-    // float shadow = 0.0;
-    // float bias = 0.05;
-    // float samples = 4.0;
-    // float offset = 0.1;
-    // for(float x = -offset; x < offset; x += offset / (samples * 0.5))
-    // {
-    // for(float y = -offset; y < offset; y += offset / (samples * 0.5))
-    // {
-    // for(float z = -offset; z < offset; z += offset / (samples * 0.5))
-    // {
-    // float closestDepth = texture(depthMap, fragToLight + vec3(x, y, z)).r; // use lightdir to lookup cubemap
-    // closestDepth *= far_plane;   // Undo mapping [0;1]
-    // if(currentDepth - bias > closestDepth)
-    // shadow += 1.0;
-    // }
-    // }
-    // }
-    // shadow /= (samples * samples * samples);
-    float shadow = 0.0;
-    float bias = shadowBias;
-    int samples = 20;
-    float viewDistance = length(camPos - fragPos);
-    float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;
-    for(int i = 0; i < samples; ++i)
-    {
-        float closestDepth = texture(depth_map, fragToLight + gridSamplingDisk[i] * diskRadius).r;
-        closestDepth *= far_plane;   // undo mapping [0;1]
-        if(currentDepth - bias > closestDepth)
-        shadow += 1.0;
-    }
-    shadow /= float(samples);
-
-    // display closestDepth as debug (to visualize depth cubemap)
-    // FragColor = vec4(vec3(closestDepth / far_plane), 1.0);
-
-    return shadow;
+// the pool index has to be dynamically uniform, the renderer never puts draws reading different pools into one
+// multi-draw call
+vec4 sample_texture(uint slot, vec2 uv) {
+    return texture(texture_pools[slot >> 16], vec3(uv, float(slot & 0xFFFFu)));
 }
 
-const float PI = 3.14159265359;
-// ----------------------------------------------------------------------------
-// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
-// Don't worry if you don't get what's going on; you generally want to do normal
-// mapping the usual way for performance anways; I do plan make a note of this
-// technique somewhere later in the normal mapping tutorial.
-vec3 getNormalFromMap()
-{
-    vec3 tangentNormal = texture(texture_normal, fUV).xyz * 2.0 - 1.0;
-
-    vec3 Q1  = dFdx(fWorldPos);
-    vec3 Q2  = dFdy(fWorldPos);
-    vec2 st1 = dFdx(fUV);
-    vec2 st2 = dFdy(fUV);
-
-    vec3 N   = normalize(fNormal);
-    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B  = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    return normalize(TBN * tangentNormal);
-}
-// ----------------------------------------------------------------------------
-float DistributionGGX(vec3 N, vec3 H, float roughness)
-{
-    float a = roughness*roughness;
-    float a2 = a*a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH2 = NdotH*NdotH;
-
-    float nom   = a2;
-    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
-    denom = PI * denom * denom;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySchlickGGX(float NdotV, float roughness)
-{
-    float r = (roughness + 1.0);
-    float k = (r*r) / 8.0;
-
-    float nom   = NdotV;
-    float denom = NdotV * (1.0 - k) + k;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
-{
-    float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
-    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
-
-    return ggx1 * ggx2;
-}
-// ----------------------------------------------------------------------------
-vec3 fresnelSchlick(float cosTheta, vec3 F0)
-{
-    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
-// ----------------------------------------------------------------------------
-void main()
-{
-    vec3 LIGHTS[1] = vec3[](lightPos);
-
-    vec3 albedo     = pow(texture(texture_base, fUV).rgb, vec3(2.2));
-    float metallic  = texture(texture_roughness, fUV).r;
-    float roughness = texture(texture_roughness, fUV).g;
-    float ao = 0.0f;
-
-    vec3 N = getNormalFromMap();
-    vec3 V = normalize(camPos - fWorldPos);
-
-    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0
-    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
-    vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, metallic);
-
-    // reflectance equation
-    vec3 Lo = vec3(0.0);
-    float shadow = ShadowCalculation(fWorldPos);
-    for(int i = 0; i < LIGHTS.length(); ++i)
-    {
-        // calculate per-light radiance
-        vec3 L = normalize(LIGHTS[i] - fWorldPos);
-        vec3 H = normalize(V + L);
-        float distance = length(LIGHTS[i] - fWorldPos);
-
-        // inverse square falloff - Karis, 2013
-        float falloffNumerator = pow(clamp(1 - pow((distance / lightRadius), 4), 0.0f, 1.0f), 2);
-        float falloffDenominator = pow(distance, 2) + 1;
-        float falloff = falloffNumerator / falloffDenominator;
-
-        vec3 radiance = lightColor * falloff * lightPower;
-
-        // Cook-Torrance BRDF
-        float NDF = DistributionGGX(N, H, roughness);
-        float G   = GeometrySmith(N, V, L, roughness);
-        vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
-
-        vec3 numerator    = NDF * G * F;
-        float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
-        vec3 specular = numerator / denominator;
-
-        // kS is equal to Fresnel
-        vec3 kS = F;
-        // for energy conservation, the diffuse and specular light can't
-        // be above 1.0 (unless the surface emits light); to preserve this
-        // relationship the diffuse component (kD) should equal 1.0 - kS.
-        vec3 kD = vec3(1.0) - kS;
-        // multiply kD by the inverse metalness such that only non-metals
-        // have diffuse lighting, or a linear blend if partly metal (pure metals
-        // have no diffuse light).
-        kD *= 1.0 - metallic;
-
-        // scale light by NdotL
-        float NdotL = max(dot(N, L), 0.0);
-
-        // add to outgoing radiance Lo
-        Lo += (kD * albedo / PI + specular) * radiance * NdotL * (1.0 - shadow);  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
-    }
-
-    // ambient lighting (note that the next IBL tutorial will replace
-    // this ambient lighting with environment lighting).
-    vec3 ambient = vec3(0.03) * albedo * ao;
-
-    vec3 color = ambient + Lo;
-
-    // HDR tonemapping
-    color = color / (color + vec3(1.0));
-    // gamma correct
-    color = pow(color, vec3(1.0/gamma));
-
-    outColor = vec4(color, 1.0);
-}
\ No newline at end of file
+#include "pbr_lighting.glsl"
\ No newline at end of file
@@ -1,22 +1,40 @@
 #version 460 core
+#extension GL_GOOGLE_include_directive : require
 
+// snorm16 position inside the mesh bounds, octahedral normal, half float uv,
+// octahedral tangent with the bitangent sign in z
 layout (location = 0) in vec3 vPos;
-layout (location = 1) in vec3 vNormal;
+layout (location = 1) in vec2 vNormal;
 layout (location = 2) in vec2 vUV;
-layout (location = 3) in vec3 vTangent;
-layout (location = 4) in vec3 vBitangent;
+layout (location = 3) in vec4 vTangent;
 
 layout (location = 0) out vec2 fUV;
 layout (location = 1) out vec3 fWorldPos;
 layout (location = 2) out vec3 fNormal;
+layout (location = 3) flat out uint fMaterial;
 
-layout (location = 0) uniform mat4 matrix_viewproj;
-layout (location = 1) uniform mat4 matrix_model;
+#include "frame_data.glsl"
+#include "draw_data.glsl"
+layout (location = 1) uniform int draw_offset;
+
+// must match depth_prepass.vert bit for bit, the scene pass may test with GL_EQUAL against its depths
+invariant gl_Position;
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 v = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -t : t;
+    v.y += v.y >= 0.0f ? -t : t;
+    return normalize(v);
+}
 
 void main() {
+    DrawData draw = draws[draw_offset + gl_DrawID];
+    vec3 position = vPos * draw.positionScale.xyz + draw.positionOffset.xyz;
     fUV = vUV;
-    fWorldPos = vec3(matrix_model * vec4(vPos, 1.0f));
-    fNormal = mat3(matrix_model) * vNormal;
+    fWorldPos = vec3(draw.matrix_model * vec4(position, 1.0f));
+    fNormal = mat3(draw.matrix_model) * decode_octahedral(vNormal);
+    fMaterial = draw.materialIndex;
 
-    gl_Position = matrix_viewproj * vec4(fWorldPos, 1.0f);
+    gl_Position = frame.matrix_viewproj * vec4(fWorldPos, 1.0f);
 }
\ No newline at end of file
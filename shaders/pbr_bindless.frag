@@ -0,0 +1,16 @@
+#version 460 core
+#extension GL_GOOGLE_include_directive : require
+#extension GL_ARB_bindless_texture : require
+
+// resident handles of the texture pools, one per pool
+layout (std430, binding = 4) readonly buffer TexturePoolHandles {
+    uvec2 texture_pool_handles[];
+};
+
+// handles index the same way as the bound pools, so the renderer keeps one set of pools per multi-draw call
+// here too instead of relying on GL_EXT_nonuniform_qualifier
+vec4 sample_texture(uint slot, vec2 uv) {
+    return texture(sampler2DArray(texture_pool_handles[slot >> 16]), vec3(uv, float(slot & 0xFFFFu)));
+}
+
+#include "pbr_lighting.glsl"
@@ -0,0 +1,321 @@
+// shared by pbr.frag and pbr_bindless.frag, which only differ in how sample_texture reaches the texture pools
+layout (location = 0) out vec4 outColor;
+
+layout (location = 0) in vec2 fUV;
+layout (location = 1) in vec3 fWorldPos;
+layout (location = 2) in vec3 fNormal;
+layout (location = 3) flat in uint fMaterial;
+
+layout (binding = 3) uniform samplerCube depth_map;
+layout (binding = 2) uniform sampler2D shadow_atlas;
+
+// texture slots are pool << 16 | layer
+struct MaterialData {
+    uint albedo;
+    uint normal;
+    uint metalRoughness;
+    uint padding;
+    vec4 baseColorFactor;
+    vec4 metalRoughnessFactor;
+};
+layout (std430, binding = 3) readonly buffer MaterialBuffer {
+    MaterialData materials[];
+};
+
+#include "frame_data.glsl"
+
+#include "light_data.glsl"
+
+// local lights, binned into froxels by LightClusters or light_cull.comp; the important ones get atlas shadows
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colorPower;
+    int shadowIndex;
+};
+layout (std430, binding = 5) readonly buffer PointLightBuffer {
+    PointLight pointLights[];
+};
+// offset and count into lightIndices
+layout (std430, binding = 6) readonly buffer LightClusterBuffer {
+    uvec2 clusters[];
+};
+layout (std430, binding = 7) readonly buffer LightIndexBuffer {
+    uint lightIndices[];
+};
+
+// one cube face of a shadowed point light; rect is the atlas uv offset in xy and uv size in z
+struct ShadowTile {
+    mat4 viewProj;
+    vec4 rect;
+    vec4 positionRadius;
+};
+layout (std430, binding = 8) readonly buffer ShadowTileBuffer {
+    ShadowTile shadowTiles[];
+};
+
+// x fastest, then y, then the exponential depth slice
+uint cluster_index(vec3 fragPos)
+{
+    float depth = -(frame.view * vec4(fragPos, 1.0)).z;
+    uvec3 grid = frame.clusterGrid.xyz;
+    uint slice = uint(clamp(log(depth) * frame.clusterDepth.x + frame.clusterDepth.y, 0.0, float(grid.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / frame.clusterTile.xy), grid.xy - 1);
+    return tile.x + grid.x * (tile.y + grid.y * slice);
+}
+
+// array of offset direction for sampling
+vec3 gridSamplingDisk[20] = vec3[]
+(
+vec3(1, 1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1, 1,  1),
+vec3(1, 1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
+vec3(1, 1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1, 1,  0),
+vec3(1, 0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1, 0, -1),
+vec3(0, 1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0, 1, -1)
+);
+
+float ShadowCalculation(vec3 fragPos)
+{
+    vec3 lightPos = light.positionRadius.xyz;
+    float far_plane = light.far_plane;
+    // get vector between fragment position and light position
+    vec3 fragToLight = fragPos - lightPos;
+    // use the fragment to light vector to sample from the depth map
+    // float closestDepth = texture(depthMap, fragToLight).r;
+    // it is currently in linear range between [0,1], let's re-transform it back to original depth value
+    // closestDepth *= far_plane;
+    // now get current linear depth as the length between the fragment and light position
+    float currentDepth = length(fragToLight);
+    // test for shadows
+    // float bias = 0.05; // we use a much larger bias since depth is now in [near_plane, far_plane] range
+    // float shadow = currentDepth -  bias > closestDepth ? 1.0 : 0.0;
+    // PCF
+    // float shadow = 0.0;
+    // float bias = 0.05;
+    // float samples = 4.0;
+    // float offset = 0.1;
+    // for(float x = -offset; x < offset; x += offset / (samples * 0.5))
+    // {
+    // for(float y = -offset; y < offset; y += offset / (samples * 0.5))
+    // {
+    // for(float z = -offset; z < offset; z += offset / (samples * 0.5))
+    // {
+    // float closestDepth = texture(depthMap, fragToLight + vec3(x, y, z)).r; // use lightdir to lookup cubemap
+    // closestDepth *= far_plane;   // Undo mapping [0;1]
+    // if(currentDepth - bias > closestDepth)
+    // shadow += 1.0;
+    // }
+    // }
+    // }
+    // shadow /= (samples * samples * samples);
+    float shadow = 0.0;
+    float bias = frame.shadowBias;
+    int samples = 20;
+    float viewDistance = length(frame.camPos.xyz - fragPos);
+    float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;
+    for(int i = 0; i < samples; ++i)
+    {
+        float closestDepth = texture(depth_map, fragToLight + gridSamplingDisk[i] * diskRadius).r;
+        closestDepth *= far_plane;   // undo mapping [0;1]
+        if(currentDepth - bias > closestDepth)
+        shadow += 1.0;
+    }
+    shadow /= float(samples);
+
+    // display closestDepth as debug (to visualize depth cubemap)
+    // FragColor = vec4(vec3(closestDepth / far_plane), 1.0);
+
+    return shadow;
+}
+
+// looked up with the light as its tiles were drawn, so a tile waiting for its refresh stays self-consistent
+float PointShadowCalculation(int shadowIndex, vec3 fragPos)
+{
+    vec3 lightPos = shadowTiles[shadowIndex * 6].positionRadius.xyz;
+    vec3 fragToLight = fragPos - lightPos;
+    vec3 axis = abs(fragToLight);
+    // +X, -X, +Y, -Y, +Z, -Z like the cubemap faces
+    int face = axis.x >= axis.y && axis.x >= axis.z ? (fragToLight.x > 0.0 ? 0 : 1) :
+               axis.y >= axis.z ? (fragToLight.y > 0.0 ? 2 : 3) : (fragToLight.z > 0.0 ? 4 : 5);
+    ShadowTile tile = shadowTiles[shadowIndex * 6 + face];
+
+    vec4 clip = tile.viewProj * vec4(fragPos, 1.0);
+    vec2 uv = tile.rect.xy + (clip.xy / clip.w * 0.5 + 0.5) * tile.rect.z;
+    // keep the filter taps inside the tile
+    vec2 texel = 1.0 / vec2(textureSize(shadow_atlas, 0));
+    vec2 tileMin = tile.rect.xy + texel;
+    vec2 tileMax = tile.rect.xy + tile.rect.z - texel;
+
+    float currentDepth = length(fragToLight);
+    float shadow = 0.0;
+    for(int x = 0; x < 2; ++x)
+    {
+        for(int y = 0; y < 2; ++y)
+        {
+            vec2 sampleUV = clamp(uv + (vec2(x, y) - 0.5) * texel, tileMin, tileMax);
+            float closestDepth = texture(shadow_atlas, sampleUV).r * tile.positionRadius.w;
+            if(currentDepth - frame.shadowBias > closestDepth)
+            shadow += 1.0;
+        }
+    }
+    return shadow / 4.0;
+}
+
+const float PI = 3.14159265359;
+// ----------------------------------------------------------------------------
+// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
+// Don't worry if you don't get what's going on; you generally want to do normal
+// mapping the usual way for performance anways; I do plan make a note of this
+// technique somewhere later in the normal mapping tutorial.
+vec3 getNormalFromMap(uint normalSlot)
+{
+    // rebuild z from xy so two-channel (BC5) normal maps work as well
+    vec2 tangentNormalXY = sample_texture(normalSlot, fUV).xy * 2.0 - 1.0;
+    vec3 tangentNormal = vec3(tangentNormalXY, sqrt(max(1.0 - dot(tangentNormalXY, tangentNormalXY), 0.0)));
+
+    vec3 Q1  = dFdx(fWorldPos);
+    vec3 Q2  = dFdy(fWorldPos);
+    vec2 st1 = dFdx(fUV);
+    vec2 st2 = dFdy(fUV);
+
+    vec3 N   = normalize(fNormal);
+    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
+    vec3 B  = -normalize(cross(N, T));
+    mat3 TBN = mat3(T, B, N);
+
+    return normalize(TBN * tangentNormal);
+}
+// ----------------------------------------------------------------------------
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness*roughness;
+    float a2 = a*a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH*NdotH;
+
+    float nom   = a2;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+
+    float nom   = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+// ----------------------------------------------------------------------------
+// radiance from one point light with the windowed falloff, which reaches zero at lightRadius
+vec3 point_light(vec3 lightPos, float lightRadius, vec3 lightColor, float lightPower, vec3 N, vec3 V, vec3 F0,
+                 vec3 albedo, float metallic, float roughness)
+{
+    // calculate per-light radiance
+    vec3 L = normalize(lightPos - fWorldPos);
+    vec3 H = normalize(V + L);
+    float distance = length(lightPos - fWorldPos);
+
+    // inverse square falloff - Karis, 2013
+    float falloffNumerator = pow(clamp(1 - pow((distance / lightRadius), 4), 0.0f, 1.0f), 2);
+    float falloffDenominator = pow(distance, 2) + 1;
+    float falloff = falloffNumerator / falloffDenominator;
+
+    vec3 radiance = lightColor * falloff * lightPower;
+
+    // Cook-Torrance BRDF
+    float NDF = DistributionGGX(N, H, roughness);
+    float G   = GeometrySmith(N, V, L, roughness);
+    vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3 numerator    = NDF * G * F;
+    float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
+    vec3 specular = numerator / denominator;
+
+    // kS is equal to Fresnel
+    vec3 kS = F;
+    // for energy conservation, the diffuse and specular light can't
+    // be above 1.0 (unless the surface emits light); to preserve this
+    // relationship the diffuse component (kD) should equal 1.0 - kS.
+    vec3 kD = vec3(1.0) - kS;
+    // multiply kD by the inverse metalness such that only non-metals
+    // have diffuse lighting, or a linear blend if partly metal (pure metals
+    // have no diffuse light).
+    kD *= 1.0 - metallic;
+
+    // scale light by NdotL
+    float NdotL = max(dot(N, L), 0.0);
+
+    // outgoing radiance; note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    MaterialData material = materials[fMaterial];
+    vec3 albedo     = pow(sample_texture(material.albedo, fUV).rgb, vec3(2.2)) * material.baseColorFactor.rgb;
+    vec2 metalRoughness = sample_texture(material.metalRoughness, fUV).rg * material.metalRoughnessFactor.xy;
+    float metallic  = metalRoughness.r;
+    float roughness = metalRoughness.g;
+    float ao = 0.0f;
+
+    vec3 N = getNormalFromMap(material.normal);
+    vec3 V = normalize(frame.camPos.xyz - fWorldPos);
+
+    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0
+    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
+    vec3 F0 = vec3(0.04);
+    F0 = mix(F0, albedo, metallic);
+
+    // reflectance equation
+    vec3 Lo = vec3(0.0);
+    float shadow = ShadowCalculation(fWorldPos);
+    Lo += point_light(light.positionRadius.xyz, light.positionRadius.w, light.colorPower.rgb, light.colorPower.a,
+                      N, V, F0, albedo, metallic, roughness) * (1.0 - shadow);
+
+    // local lights only come from this fragment's cluster
+    uvec2 cluster = clusters[cluster_index(fWorldPos)];
+    for(uint i = 0; i < cluster.y; ++i)
+    {
+        PointLight pointLight = pointLights[lightIndices[cluster.x + i]];
+        vec3 radiance = point_light(pointLight.positionRadius.xyz, pointLight.positionRadius.w,
+                                    pointLight.colorPower.rgb, pointLight.colorPower.a, N, V, F0, albedo, metallic,
+                                    roughness);
+        // the scheduler gives atlas tiles to the most important lights only
+        if(pointLight.shadowIndex >= 0)
+        radiance *= 1.0 - PointShadowCalculation(pointLight.shadowIndex, fWorldPos);
+        Lo += radiance;
+    }
+
+    // ambient lighting (note that the next IBL tutorial will replace
+    // this ambient lighting with environment lighting).
+    vec3 ambient = vec3(0.03) * albedo * ao;
+
+    vec3 color = ambient + Lo;
+
+    // HDR tonemapping
+    color *= frame.exposure;
+    color = color / (color + vec3(1.0));
+    // gamma correct
+    color = pow(color, vec3(1.0/frame.gamma));
+
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 460 core
+
+layout (location = 0) in vec4 FragPos;
+
+layout (location = 2) uniform vec3 light_position;
+layout (location = 3) uniform float light_radius;
+
+// linear distance over the light radius, like the cubemap
+void main() {
+    gl_FragDepth = length(FragPos.xyz - light_position) / light_radius;
+}
@@ -0,0 +1,18 @@
+#version 460 core
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 aPos;
+
+#include "draw_data.glsl"
+layout (location = 0) uniform int draw_offset;
+layout (location = 1) uniform mat4 face_matrix;
+
+layout (location = 0) out vec4 FragPos;
+
+// renders one cube face of a point light into its atlas tile, the viewport selects the tile
+void main() {
+    DrawData draw = draws[draw_offset + gl_DrawID];
+    vec3 position = aPos * draw.positionScale.xyz + draw.positionOffset.xyz;
+    FragPos = draw.matrix_model * vec4(position, 1.0);
+    gl_Position = face_matrix * FragPos;
+}
@@ -0,0 +1,390 @@
+#include "benchmark.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <glad/glad.h>
+#include <gl/renderer.h>
+#include <camera.h>
+#include <profiler.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+constexpr float BENCHMARK_FOV_DEG = 90.0f;
+
+struct FrameRecord {
+    double cpuTime;
+    double frameTime;
+    GLRenderer::FrameStats stats;
+};
+
+bool load_camera_path(const std::string &filePath, std::vector<CameraKeyframe> &keyframes) {
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        std::cout << "Failed to open camera path " << filePath << std::endl;
+        return false;
+    }
+
+    keyframes.clear();
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::istringstream stream(line);
+        CameraKeyframe keyframe{};
+        if (!(stream >> keyframe.frame >> keyframe.position[0] >> keyframe.position[1] >> keyframe.position[2] >>
+                     keyframe.yaw >> keyframe.pitch)) {
+            std::cout << "Camera path " << filePath << ":" << lineNumber << " is not 'frame x y z yaw pitch'"
+                      << std::endl;
+            return false;
+        }
+        if (!keyframes.empty() && keyframe.frame <= keyframes.back().frame) {
+            std::cout << "Camera path " << filePath << ":" << lineNumber << " is out of order" << std::endl;
+            return false;
+        }
+        keyframes.push_back(keyframe);
+    }
+    if (keyframes.empty()) {
+        std::cout << "Camera path " << filePath << " has no keyframes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// linear between the surrounding keyframes, held at the ends
+static void sample_camera_path(const std::vector<CameraKeyframe> &keyframes, uint32_t frame, FlyCamera &camera) {
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+                                 [](uint32_t value, const CameraKeyframe &keyframe) { return value < keyframe.frame; });
+    const CameraKeyframe &a = next == keyframes.begin() ? *next : *(next - 1);
+    const CameraKeyframe &b = next == keyframes.end() ? keyframes.back() : *next;
+    float t = b.frame > a.frame ? std::clamp((float) (frame - a.frame) / (float) (b.frame - a.frame), 0.0f, 1.0f) : 0.0f;
+    glm::vec3 position = glm::vec3(a.position[0], a.position[1], a.position[2]) * (1.0f - t) +
+                         glm::vec3(b.position[0], b.position[1], b.position[2]) * t;
+    camera.set_pose(position, a.yaw + (b.yaw - a.yaw) * t, a.pitch + (b.pitch - a.pitch) * t);
+}
+
+static bool capture_frame(unsigned int framebuffer, uint32_t width, uint32_t height, const std::string &filePath) {
+    std::vector<unsigned char> pixels((size_t) width * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (GLsizei) width, (GLsizei) height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // GL rows start at the bottom
+    stbi_flip_vertically_on_write(1);
+    if (!stbi_write_png(filePath.c_str(), (int) width, (int) height, 4, pixels.data(), (int) width * 4)) {
+        std::cout << "Failed to write capture " << filePath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    auto index = (size_t) std::min((double) (values.size() - 1), fraction * (double) (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static std::string json_string(const std::string &value) {
+    std::string escaped = "\"";
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int) (unsigned char) c);
+            escaped += buffer;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+static bool write_report(const BenchmarkOptions &options, const std::vector<FrameRecord> &frames,
+                         const std::vector<std::string> &captures) {
+    std::ofstream file(options.reportPath, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "Failed to write benchmark report " << options.reportPath << std::endl;
+        return false;
+    }
+
+    std::vector<double> cpuTimes;
+    std::vector<double> frameTimes;
+    std::vector<double> gpuTimes;
+    for (auto &frame: frames) {
+        cpuTimes.push_back(frame.cpuTime);
+        frameTimes.push_back(frame.frameTime);
+        gpuTimes.push_back(frame.stats.gpu.get_time("Frame"));
+    }
+    auto mean = [](const std::vector<double> &values) {
+        double sum = 0.0;
+        for (double value: values) sum += value;
+        return values.empty() ? 0.0 : sum / (double) values.size();
+    };
+
+    auto gl_string = [](GLenum name) {
+        auto value = (const char *) glGetString(name);
+        return std::string(value ? value : "");
+    };
+
+    file << "{\n";
+    file << "  \"cameraPath\": " << json_string(options.cameraPathFile) << ",\n";
+    file << "  \"width\": " << options.width << ",\n";
+    file << "  \"height\": " << options.height << ",\n";
+    file << "  \"warmupFrames\": " << options.warmupFrames << ",\n";
+    file << "  \"pointLights\": " << options.pointLights << ",\n";
+    file << "  \"gpuLightCulling\": " << (options.gpuLightCulling ? "true" : "false") << ",\n";
+    file << "  \"depthPrepass\": " << (options.depthPrepass ? "true" : "false") << ",\n";
+    file << "  \"occlusionCulling\": " << (options.occlusionCulling ? "true" : "false") << ",\n";
+    file << "  \"glRenderer\": " << json_string(gl_string(GL_RENDERER)) << ",\n";
+    file << "  \"glVersion\": " << json_string(gl_string(GL_VERSION)) << ",\n";
+    file << "  \"summary\": {\n";
+    file << "    \"frames\": " << frames.size() << ",\n";
+    file << "    \"cpuMsMean\": " << mean(cpuTimes) << ",\n";
+    file << "    \"cpuMsP50\": " << percentile(cpuTimes, 0.5) << ",\n";
+    file << "    \"cpuMsP95\": " << percentile(cpuTimes, 0.95) << ",\n";
+    file << "    \"frameMsMean\": " << mean(frameTimes) << ",\n";
+    file << "    \"frameMsP50\": " << percentile(frameTimes, 0.5) << ",\n";
+    file << "    \"frameMsP95\": " << percentile(frameTimes, 0.95) << ",\n";
+    file << "    \"gpuMsMean\": " << mean(gpuTimes) << ",\n";
+    file << "    \"gpuMsP50\": " << percentile(gpuTimes, 0.5) << ",\n";
+    file << "    \"gpuMsP95\": " << percentile(gpuTimes, 0.95) << "\n";
+    file << "  },\n";
+    file << "  \"frames\": [\n";
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameRecord &frame = frames[i];
+        file << "    {\"frame\": " << i << ", \"cpuMs\": " << frame.cpuTime << ", \"frameMs\": " << frame.frameTime
+             << ", \"cullMs\": " << frame.stats.cullTime << ", \"shadowGpuMs\": " << frame.stats.shadowPassTime
+             << ", \"sceneTriangles\": " << frame.stats.sceneTriangles << ", \"shadowTriangles\": "
+             << frame.stats.shadowTriangles << ", \"drawCommands\": " << frame.stats.drawCommands
+             << ", \"visibleMeshes\": " << frame.stats.visibleMeshes << ", \"drawCalls\": "
+             << frame.stats.glState.drawCalls << ", \"programBinds\": " << frame.stats.glState.programBinds
+             << ", \"textureBinds\": " << frame.stats.glState.textureBinds << ", \"vaoBinds\": "
+             << frame.stats.glState.vaoBinds << ", \"lightBinMs\": " << frame.stats.lightBinTime
+             << ", \"clusterLightReferences\": " << frame.stats.lightClusters.lightReferences
+             << ", \"shadowedLights\": " << frame.stats.shadowAtlas.shadowedLights << ", \"atlasRefreshedLights\": "
+             << frame.stats.shadowAtlas.refreshedLights << ", \"atlasStaleLights\": "
+             << frame.stats.shadowAtlas.staleLights << ", \"atlasOccupancy\": " << frame.stats.shadowAtlas.occupancy
+             << ", \"atlasTriangles\": " << frame.stats.atlasTriangles << ", \"prepassTriangles\": "
+             << frame.stats.prepassTriangles << ", \"shadedSamples\": " << frame.stats.shadedSamples
+             << ", \"occlusionTested\": " << frame.stats.occlusion.tested << ", \"occlusionOccluded\": "
+             << frame.stats.occlusion.occluded << ", \"occlusionMs\": " << frame.stats.occlusionTime
+             << ", \"gpuPasses\": [";
+        for (size_t zone = 0; zone < frame.stats.gpu.zones.size(); zone++) {
+            const GLRenderer::GpuZone &gpuZone = frame.stats.gpu.zones[zone];
+            file << (zone > 0 ? ", " : "") << "{\"name\": " << json_string(gpuZone.name) << ", \"depth\": "
+                 << gpuZone.depth << ", \"ms\": " << gpuZone.duration << "}";
+        }
+        file << "]}" << (i + 1 < frames.size() ? "," : "") << "\n";
+    }
+    file << "  ],\n";
+    file << "  \"captures\": [";
+    for (size_t i = 0; i < captures.size(); i++) {
+        file << (i > 0 ? ", " : "") << json_string(captures[i]);
+    }
+    file << "]\n";
+    file << "}\n";
+    return true;
+}
+
+#ifdef HAVE_EGL
+// surfaceless so no display or window system is needed, Mesa's llvmpipe provides this without a GPU
+static bool create_egl_context(EGLDisplay &display, EGLContext &context) {
+    display = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cout << "Failed to initialize EGL" << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "EGL does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        std::cout << "No EGL config with desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 6,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        std::cout << "Failed to create an OpenGL 4.6 core context through EGL" << std::endl;
+        return false;
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "Failed to make the EGL context current, EGL_KHR_surfaceless_context is required" << std::endl;
+        return false;
+    }
+    return true;
+}
+#endif
+
+int run_benchmark(const BenchmarkOptions &options) {
+#ifndef HAVE_EGL
+    (void) options;
+    std::cout << "Headless benchmark needs EGL, this build was made without it" << std::endl;
+    return -1;
+#else
+    std::vector<CameraKeyframe> keyframes;
+    if (!load_camera_path(options.cameraPathFile, keyframes)) {
+        return -1;
+    }
+    uint32_t frameCount = options.frameCount > 0 ? options.frameCount : keyframes.back().frame + 1;
+
+    EGLDisplay display;
+    EGLContext context;
+    if (!create_egl_context(display, context)) {
+        return -1;
+    }
+    if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    // same fixed function state as the windowed path
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // fixed resolution target instead of a window
+    unsigned int framebuffer = 0;
+    unsigned int colorBuffer = 0;
+    unsigned int depthBuffer = 0;
+    glCreateFramebuffers(1, &framebuffer);
+    glCreateRenderbuffers(1, &colorBuffer);
+    glNamedRenderbufferStorage(colorBuffer, GL_RGBA8, (GLsizei) options.width, (GLsizei) options.height);
+    glCreateRenderbuffers(1, &depthBuffer);
+    glNamedRenderbufferStorage(depthBuffer, GL_DEPTH_COMPONENT32F, (GLsizei) options.width, (GLsizei) options.height);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Benchmark framebuffer is incomplete" << std::endl;
+        return -1;
+    }
+
+    FlyCamera camera(BENCHMARK_FOV_DEG, (float) options.width / (float) options.height, 0.1f, 2000.0f);
+    GLRenderer::Renderer renderer;
+    renderer.importThreadCount = options.importThreadCount;
+    renderer.textureBudgetMB = options.textureBudgetMB;
+    renderer.useBindless = options.useBindless;
+    renderer.pointLightCount = options.pointLights;
+    renderer.gpuLightCulling = options.gpuLightCulling;
+    renderer.depthPrepass = options.depthPrepass;
+    renderer.occlusionCulling = options.occlusionCulling;
+    renderer.procAddressLoader = (GLADloadproc) eglGetProcAddress;
+    renderer.drawUI = false;
+    renderer.outputFramebuffer = framebuffer;
+    renderer.init(&camera, options.width, options.height);
+    if (!renderer.isInitialized) {
+        std::cout << "Failed to initialize renderer" << std::endl;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < options.warmupFrames; i++) {
+        sample_camera_path(keyframes, 0, camera);
+        renderer.draw(0.0);
+    }
+    glFinish();
+    // warmup timings stay out of the trace
+    renderer.collect_gpu_timings();
+
+    // cpu time covers building and submitting the frame, frame time also waits for the GPU to finish it
+    std::vector<FrameRecord> frames;
+    std::vector<std::string> captures;
+    frames.reserve(frameCount);
+    if (!options.gpuTracePath.empty()) {
+        renderer.get_gpu_profiler()->start_capture(frameCount);
+    }
+    uint64_t cpuTraceBegin = CpuProfiler::now();
+    double previousFrameTime = 0.0;
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        sample_camera_path(keyframes, frame, camera);
+
+        auto frameTimerStart = std::chrono::high_resolution_clock::now();
+        renderer.draw(previousFrameTime);
+        auto submitTimerEnd = std::chrono::high_resolution_clock::now();
+        glFinish();
+        auto frameTimerEnd = std::chrono::high_resolution_clock::now();
+        renderer.collect_gpu_timings();
+
+        FrameRecord record{};
+        record.cpuTime = std::chrono::duration<double, std::milli>(submitTimerEnd - frameTimerStart).count();
+        record.frameTime = std::chrono::duration<double, std::milli>(frameTimerEnd - frameTimerStart).count();
+        record.stats = renderer.get_frame_stats();
+        frames.push_back(record);
+        previousFrameTime = record.frameTime;
+
+        if (std::find(options.captureFrames.begin(), options.captureFrames.end(), frame) !=
+            options.captureFrames.end()) {
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "_%05u.png", frame);
+            std::string capturePath = options.capturePrefix + suffix;
+            if (capture_frame(framebuffer, options.width, options.height, capturePath)) {
+                captures.push_back(capturePath);
+            }
+        }
+    }
+
+    bool written = write_report(options, frames, captures);
+    if (!options.gpuTracePath.empty() && renderer.get_gpu_profiler()->write_trace(options.gpuTracePath)) {
+        std::cout << "GPU trace written to " << options.gpuTracePath << std::endl;
+    }
+    if (!options.cpuTracePath.empty() && CpuProfiler::write_trace(options.cpuTracePath, cpuTraceBegin) &&
+        CpuProfiler::write_folded(options.cpuTracePath + ".folded", cpuTraceBegin)) {
+        std::cout << "CPU trace written to " << options.cpuTracePath << std::endl;
+    }
+    if (written) {
+        std::cout << "Benchmark of " << frames.size() << " frames written to " << options.reportPath << std::endl;
+    }
+
+    renderer.cleanup();
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return written ? 0 : -1;
+#endif
+}
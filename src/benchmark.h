@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// headless replay of a camera path into a fixed size offscreen framebuffer, so runs are comparable across commits
+struct BenchmarkOptions {
+    std::string cameraPathFile;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    // 0 runs to the last keyframe
+    uint32_t frameCount = 0;
+    // rendered at the first keyframe before measuring, not part of the report
+    uint32_t warmupFrames = 0;
+    std::string reportPath = "benchmark.json";
+    std::vector<uint32_t> captureFrames;
+    std::string capturePrefix = "capture";
+    // Chrome trace of every measured frame's GPU passes, empty for none
+    std::string gpuTracePath;
+    // same for the CPU zones of every thread, plus a folded stack file next to it
+    std::string cpuTracePath;
+    unsigned int importThreadCount = 0;
+    int textureBudgetMB = 1024;
+    bool useBindless = true;
+    // stress mode point lights, run several counts to chart frame time against light count
+    int pointLights = 0;
+    bool gpuLightCulling = false;
+    bool depthPrepass = false;
+    bool occlusionCulling = false;
+};
+
+// one pose per line as "frame x y z yaw pitch", sorted by frame, # starts a comment
+struct CameraKeyframe {
+    uint32_t frame;
+    float position[3];
+    float yaw;
+    float pitch;
+};
+
+bool load_camera_path(const std::string &filePath, std::vector<CameraKeyframe> &keyframes);
+
+// creates a surfaceless EGL context, runs the path and writes the report; returns the process exit code
+int run_benchmark(const BenchmarkOptions &options);
@@ -48,6 +48,16 @@ void FlyCamera::process_mouse(float dx, float dy) {
     update_camera_vectors();
 }
 
+void FlyCamera::set_pose(const glm::vec3 &newPosition, float yaw, float pitch) {
+    position = newPosition;
+    _yaw = yaw;
+    _pitch = pitch;
+    if (_pitch > 89.0f) _pitch = 89.0f;
+    if (_pitch < -89.0f) _pitch = -89.0f;
+
+    update_camera_vectors();
+}
+
 void FlyCamera::update_camera_vectors() {
     glm::vec3 front;
     front.x = cos(glm::radians(_yaw)) * cos(glm::radians(_pitch));
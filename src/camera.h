@@ -22,6 +22,13 @@ public:
 
     void process_mouse(float dx, float dy);
 
+    // places the camera directly, used to replay recorded paths
+    void set_pose(const glm::vec3 &newPosition, float yaw, float pitch);
+
+    float get_near() const { return _near; }
+
+    float get_far() const { return _far; }
+
     glm::mat4 projection;
     glm::vec3 position;
 private:
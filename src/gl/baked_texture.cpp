@@ -0,0 +1,94 @@
+#include "baked_texture.h"
+
+#include <glad/glad.h>
+#include <fstream>
+#include <cstring>
+
+namespace GLRenderer {
+    std::string baked_texture_path(const std::string &sourcePath) {
+        return sourcePath + ".btex";
+    }
+
+    uint32_t baked_block_size(uint32_t format) {
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                return 8;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_RG_RGTC2:
+                return 16;
+            default:
+                return 0;
+        }
+    }
+
+    const char *baked_format_name(uint32_t format) {
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                return "BC1";
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                return "BC3";
+            case GL_COMPRESSED_RG_RGTC2:
+                return "BC5";
+            default:
+                return "unknown";
+        }
+    }
+
+    bool parse_baked_texture(const std::vector<unsigned char> &contents, BakedTexture &texture) {
+        if (contents.size() < sizeof(BakedTextureHeader)) {
+            return false;
+        }
+        BakedTextureHeader header{};
+        std::memcpy(&header, contents.data(), sizeof(header));
+        if (header.magic != BAKED_TEXTURE_MAGIC || header.version != BAKED_TEXTURE_VERSION ||
+            baked_block_size(header.format) == 0 || header.levelCount == 0 || header.levelCount > 32) {
+            return false;
+        }
+
+        uint64_t dataOffset = sizeof(BakedTextureHeader) + (uint64_t) header.levelCount * sizeof(BakedTextureLevel);
+        if (dataOffset > contents.size()) {
+            return false;
+        }
+
+        texture.format = header.format;
+        texture.width = header.width;
+        texture.height = header.height;
+        texture.levels.resize(header.levelCount);
+        std::memcpy(texture.levels.data(), contents.data() + sizeof(BakedTextureHeader),
+                    header.levelCount * sizeof(BakedTextureLevel));
+
+        // every level has to fit in the file and match its block count
+        uint64_t dataSize = contents.size() - dataOffset;
+        for (auto &level: texture.levels) {
+            uint64_t expectedSize = (uint64_t) ((level.width + 3) / 4) * ((level.height + 3) / 4) *
+                                    baked_block_size(header.format);
+            if (level.size != expectedSize || level.offset + level.size > dataSize) {
+                return false;
+            }
+        }
+
+        texture.data.assign(contents.begin() + (std::ptrdiff_t) dataOffset, contents.end());
+        return true;
+    }
+
+    bool write_baked_texture(const std::string &filePath, const BakedTexture &texture) {
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        BakedTextureHeader header{};
+        header.magic = BAKED_TEXTURE_MAGIC;
+        header.version = BAKED_TEXTURE_VERSION;
+        header.format = texture.format;
+        header.width = texture.width;
+        header.height = texture.height;
+        header.levelCount = (uint32_t) texture.levels.size();
+
+        file.write((const char *) &header, sizeof(header));
+        file.write((const char *) texture.levels.data(),
+                   (std::streamsize) (texture.levels.size() * sizeof(BakedTextureLevel)));
+        file.write((const char *) texture.data.data(), (std::streamsize) texture.data.size());
+        return (bool) file;
+    }
+}
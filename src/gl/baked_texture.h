@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// S3TC is an extension, so the generated loader has no enums for it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace GLRenderer {
+    constexpr uint32_t BAKED_TEXTURE_MAGIC = 0x58455442; // "BTEX"
+    constexpr uint32_t BAKED_TEXTURE_VERSION = 1;
+
+    // on-disk layout: header, level table, then the block data of each level from largest to smallest
+    struct BakedTextureHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+    };
+
+    struct BakedTextureLevel {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // level offsets are relative to the start of data
+    struct BakedTexture {
+        uint32_t format = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<BakedTextureLevel> levels;
+        std::vector<unsigned char> data;
+    };
+
+    std::string baked_texture_path(const std::string &sourcePath);
+
+    // bytes per 4x4 block, 0 for unsupported formats
+    uint32_t baked_block_size(uint32_t format);
+
+    const char *baked_format_name(uint32_t format);
+
+    bool parse_baked_texture(const std::vector<unsigned char> &contents, BakedTexture &texture);
+
+    bool write_baked_texture(const std::string &filePath, const BakedTexture &texture);
+}
@@ -0,0 +1,26 @@
+#include "bindless.h"
+#include <cstring>
+
+namespace GLRenderer {
+    bool BindlessFunctions::load(GLADloadproc loader) {
+        if (!loader) {
+            return false;
+        }
+        bool supported = false;
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (int i = 0; i < extensionCount && !supported; i++) {
+            auto extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+            supported = extension && strcmp(extension, "GL_ARB_bindless_texture") == 0;
+        }
+        if (!supported) {
+            return false;
+        }
+
+        getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC) loader("glGetTextureHandleARB");
+        makeTextureHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC) loader("glMakeTextureHandleResidentARB");
+        makeTextureHandleNonResident =
+                (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC) loader("glMakeTextureHandleNonResidentARB");
+        return getTextureHandle && makeTextureHandleResident && makeTextureHandleNonResident;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// ARB_bindless_texture is an extension, so the generated loader has neither its functions nor a way to load them;
+// they are fetched through the same proc address function the context was loaded with
+namespace GLRenderer {
+    typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+    typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+    typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+    struct BindlessFunctions {
+        PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = nullptr;
+        PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeTextureHandleResident = nullptr;
+        PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeTextureHandleNonResident = nullptr;
+
+        // false if the extension is missing or any function could not be found
+        bool load(GLADloadproc loader);
+    };
+}
@@ -0,0 +1,266 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace GLRenderer {
+    constexpr int SAH_BIN_COUNT = 12;
+    constexpr uint32_t MAX_LEAF_SIZE = 4;
+
+    void BVH::build(const std::vector<AABB> &primitiveBounds) {
+        _nodes.clear();
+        _primitiveBounds = primitiveBounds;
+        _primitiveIndices.resize(primitiveBounds.size());
+        if (primitiveBounds.empty()) {
+            return;
+        }
+
+        std::vector<glm::vec3> centroids(primitiveBounds.size());
+        for (uint32_t i = 0; i < (uint32_t) primitiveBounds.size(); i++) {
+            _primitiveIndices[i] = i;
+            centroids[i] = primitiveBounds[i].center();
+        }
+
+        // children are always stored after their parent, refit relies on this
+        _nodes.reserve(primitiveBounds.size() * 2);
+        _nodes.push_back({AABB{}, 0, (uint32_t) primitiveBounds.size()});
+        subdivide(0, primitiveBounds, centroids);
+    }
+
+    void BVH::subdivide(uint32_t nodeIndex, const std::vector<AABB> &primitiveBounds,
+                        const std::vector<glm::vec3> &centroids) {
+        uint32_t first = _nodes[nodeIndex].first;
+        uint32_t count = _nodes[nodeIndex].count;
+
+        AABB bounds = primitiveBounds[_primitiveIndices[first]];
+        AABB centroidBounds{centroids[_primitiveIndices[first]], centroids[_primitiveIndices[first]]};
+        for (uint32_t i = first + 1; i < first + count; i++) {
+            bounds.grow(primitiveBounds[_primitiveIndices[i]]);
+            centroidBounds.grow({centroids[_primitiveIndices[i]], centroids[_primitiveIndices[i]]});
+        }
+        _nodes[nodeIndex].bounds = bounds;
+        if (count <= 2) {
+            return;
+        }
+
+        // binned SAH, find the cheapest split plane over all three axes
+        struct Bin {
+            AABB bounds;
+            uint32_t count = 0;
+        };
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        int bestSplit = 0;
+        glm::vec3 centroidSize = centroidBounds.max - centroidBounds.min;
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroidSize[axis] <= 0.0f) {
+                continue;
+            }
+            float binScale = (float) SAH_BIN_COUNT / centroidSize[axis];
+            Bin bins[SAH_BIN_COUNT];
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t primitive = _primitiveIndices[i];
+                int bin = std::min(SAH_BIN_COUNT - 1,
+                                   (int) ((centroids[primitive][axis] - centroidBounds.min[axis]) * binScale));
+                if (bins[bin].count == 0) {
+                    bins[bin].bounds = primitiveBounds[primitive];
+                } else {
+                    bins[bin].bounds.grow(primitiveBounds[primitive]);
+                }
+                bins[bin].count++;
+            }
+
+            // sweep from both sides so every split is evaluated in linear time
+            float leftArea[SAH_BIN_COUNT - 1];
+            uint32_t leftCount[SAH_BIN_COUNT - 1];
+            AABB sweepBounds;
+            uint32_t sweepCount = 0;
+            for (int i = 0; i < SAH_BIN_COUNT - 1; i++) {
+                if (bins[i].count > 0) {
+                    if (sweepCount == 0) {
+                        sweepBounds = bins[i].bounds;
+                    } else {
+                        sweepBounds.grow(bins[i].bounds);
+                    }
+                    sweepCount += bins[i].count;
+                }
+                leftArea[i] = sweepCount ? sweepBounds.surface_area() : 0.0f;
+                leftCount[i] = sweepCount;
+            }
+            sweepCount = 0;
+            for (int i = SAH_BIN_COUNT - 1; i > 0; i--) {
+                if (bins[i].count > 0) {
+                    if (sweepCount == 0) {
+                        sweepBounds = bins[i].bounds;
+                    } else {
+                        sweepBounds.grow(bins[i].bounds);
+                    }
+                    sweepCount += bins[i].count;
+                }
+                float rightArea = sweepCount ? sweepBounds.surface_area() : 0.0f;
+                float cost = leftArea[i - 1] * (float) leftCount[i - 1] + rightArea * (float) sweepCount;
+                if (leftCount[i - 1] > 0 && sweepCount > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // stay a leaf if splitting doesn't pay off, unless the leaf would get too big
+        float leafCost = bounds.surface_area() * (float) count;
+        if (bestAxis < 0 || (bestCost >= leafCost && count <= MAX_LEAF_SIZE)) {
+            return;
+        }
+
+        float binScale = (float) SAH_BIN_COUNT / centroidSize[bestAxis];
+        auto middle = std::partition(_primitiveIndices.begin() + first, _primitiveIndices.begin() + first + count,
+                                     [&](uint32_t primitive) {
+                                         int bin = std::min(SAH_BIN_COUNT - 1,
+                                                            (int) ((centroids[primitive][bestAxis] -
+                                                                    centroidBounds.min[bestAxis]) * binScale));
+                                         return bin < bestSplit;
+                                     });
+        auto leftCount = (uint32_t) (middle - (_primitiveIndices.begin() + first));
+
+        auto leftChild = (uint32_t) _nodes.size();
+        _nodes.push_back({AABB{}, first, leftCount});
+        _nodes.push_back({AABB{}, first + leftCount, count - leftCount});
+        _nodes[nodeIndex].first = leftChild;
+        _nodes[nodeIndex].count = 0;
+
+        subdivide(leftChild, primitiveBounds, centroids);
+        subdivide(leftChild + 1, primitiveBounds, centroids);
+    }
+
+    void BVH::refit(const std::vector<AABB> &primitiveBounds) {
+        _primitiveBounds = primitiveBounds;
+
+        // children come after their parent, so walking backwards visits them first
+        for (size_t i = _nodes.size(); i-- > 0;) {
+            Node &node = _nodes[i];
+            if (node.count > 0) {
+                node.bounds = primitiveBounds[_primitiveIndices[node.first]];
+                for (uint32_t j = node.first + 1; j < node.first + node.count; j++) {
+                    node.bounds.grow(primitiveBounds[_primitiveIndices[j]]);
+                }
+            } else {
+                node.bounds = _nodes[node.first].bounds;
+                node.bounds.grow(_nodes[node.first + 1].bounds);
+            }
+        }
+    }
+
+    uint32_t BVH::query_frustum(const Frustum &frustum, std::vector<uint32_t> &primitives) const {
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        std::vector<uint32_t> stack{0};
+        uint32_t visited = 0;
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.back();
+            stack.pop_back();
+            const Node &node = _nodes[nodeIndex];
+            visited++;
+
+            CullResult result = frustum.classify(node.bounds);
+            if (result == CullResult::Outside) {
+                continue;
+            }
+            // fully inside, take everything below without further tests
+            if (result == CullResult::Inside) {
+                append_subtree(nodeIndex, primitives);
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    if (frustum.classify(_primitiveBounds[_primitiveIndices[i]]) != CullResult::Outside) {
+                        primitives.push_back(_primitiveIndices[i]);
+                    }
+                }
+                continue;
+            }
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+        return visited;
+    }
+
+    uint32_t BVH::query_sphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &primitives) const {
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        std::vector<uint32_t> stack{0};
+        uint32_t visited = 0;
+        while (!stack.empty()) {
+            const Node &node = _nodes[stack.back()];
+            stack.pop_back();
+            visited++;
+
+            if (!node.bounds.intersects_sphere(center, radius)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    if (_primitiveBounds[_primitiveIndices[i]].intersects_sphere(center, radius)) {
+                        primitives.push_back(_primitiveIndices[i]);
+                    }
+                }
+                continue;
+            }
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+        return visited;
+    }
+
+    bool BVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, uint32_t &primitive,
+                      float &distance) const {
+        if (_nodes.empty()) {
+            return false;
+        }
+
+        glm::vec3 invDirection = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        std::vector<uint32_t> stack{0};
+        bool hit = false;
+        distance = maxDistance;
+        while (!stack.empty()) {
+            const Node &node = _nodes[stack.back()];
+            stack.pop_back();
+
+            // skip nodes that start beyond the closest hit so far
+            float tNode = 0.0f;
+            if (!node.bounds.intersects_ray(origin, invDirection, distance, tNode)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    float tPrimitive = 0.0f;
+                    if (_primitiveBounds[_primitiveIndices[i]].intersects_ray(origin, invDirection, distance,
+                                                                               tPrimitive)) {
+                        hit = true;
+                        distance = tPrimitive;
+                        primitive = _primitiveIndices[i];
+                    }
+                }
+                continue;
+            }
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+        return hit;
+    }
+
+    void BVH::append_subtree(uint32_t nodeIndex, std::vector<uint32_t> &primitives) const {
+        const Node &node = _nodes[nodeIndex];
+        if (node.count > 0) {
+            primitives.insert(primitives.end(), _primitiveIndices.begin() + node.first,
+                              _primitiveIndices.begin() + node.first + node.count);
+            return;
+        }
+        append_subtree(node.first, primitives);
+        append_subtree(node.first + 1, primitives);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <gl/culling.h>
+
+namespace GLRenderer {
+    // binary BVH over world-space primitive boxes, primitives are referred to by their index in the build input
+    class BVH {
+    public:
+        // surface area heuristic build, used whenever the set of primitives changes
+        void build(const std::vector<AABB> &primitiveBounds);
+
+        // keeps the tree topology and recomputes node boxes for moved primitives
+        void refit(const std::vector<AABB> &primitiveBounds);
+
+        // each query appends the primitives it finds and returns how many nodes it visited
+        uint32_t query_frustum(const Frustum &frustum, std::vector<uint32_t> &primitives) const;
+
+        uint32_t query_sphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &primitives) const;
+
+        // closest primitive box hit by the ray, false if nothing was hit
+        bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, uint32_t &primitive,
+                     float &distance) const;
+
+        size_t node_count() const { return _nodes.size(); }
+
+    private:
+        // leaves have count > 0 and hold primitives [first, first + count) of _primitiveIndices,
+        // inner nodes have count == 0 and their children at first and first + 1
+        struct Node {
+            AABB bounds;
+            uint32_t first;
+            uint32_t count;
+        };
+
+        std::vector<Node> _nodes;
+        std::vector<uint32_t> _primitiveIndices;
+        std::vector<AABB> _primitiveBounds;
+
+        void subdivide(uint32_t nodeIndex, const std::vector<AABB> &primitiveBounds,
+                       const std::vector<glm::vec3> &centroids);
+
+        void append_subtree(uint32_t nodeIndex, std::vector<uint32_t> &primitives) const;
+    };
+}
@@ -5,6 +5,8 @@ namespace GLRenderer {
     void APIENTRY glDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length,
                                 const char *message, const void *userParam) {
         if (id == 131169 || id == 131185 || id == 131218 || id == 131204) return;
+        // profiler zones, not worth a message each
+        if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) return;
         std::cout << "---------------" << std::endl;
         std::cout << "Debug message (" << id << "): " << message << std::endl;
 
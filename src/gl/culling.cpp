@@ -0,0 +1,215 @@
+#include "culling.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULLING_SSE
+#endif
+
+namespace GLRenderer {
+    constexpr size_t SIMD_WIDTH = 4;
+
+    Frustum Frustum::from_matrix(const glm::mat4 &viewProj) {
+        // Gribb/Hartmann, glm is column-major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        auto row = [&viewProj](int i) {
+            return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+        };
+        Frustum frustum{};
+        frustum.planes[0] = row(3) + row(0);
+        frustum.planes[1] = row(3) - row(0);
+        frustum.planes[2] = row(3) + row(1);
+        frustum.planes[3] = row(3) - row(1);
+        frustum.planes[4] = row(3) + row(2);
+        frustum.planes[5] = row(3) - row(2);
+        for (auto &plane: frustum.planes) {
+            plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+        }
+        return frustum;
+    }
+
+    CullResult Frustum::classify(const AABB &box) const {
+        glm::vec3 center = box.center();
+        glm::vec3 extent = box.extent();
+        CullResult result = CullResult::Inside;
+        for (const auto &plane: planes) {
+            float distance = center.x * plane.x + center.y * plane.y + center.z * plane.z + plane.w;
+            float projectedExtent = extent.x * std::abs(plane.x) + extent.y * std::abs(plane.y) +
+                                    extent.z * std::abs(plane.z);
+            if (distance + projectedExtent < 0.0f) {
+                return CullResult::Outside;
+            }
+            if (distance - projectedExtent < 0.0f) {
+                result = CullResult::Intersecting;
+            }
+        }
+        return result;
+    }
+
+    bool Frustum::intersects_sphere(const glm::vec3 &center, float radius) const {
+        for (const auto &plane: planes) {
+            if (center.x * plane.x + center.y * plane.y + center.z * plane.z + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    float AABB::surface_area() const {
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void AABB::grow(const AABB &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool AABB::intersects_sphere(const glm::vec3 &center, float radius) const {
+        glm::vec3 closest = glm::max(min, glm::min(center, max));
+        glm::vec3 offset = closest - center;
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+
+    bool AABB::intersects_ray(const glm::vec3 &origin, const glm::vec3 &invDirection, float maxDistance,
+                              float &tHit) const {
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (min[axis] - origin[axis]) * invDirection[axis];
+            float t1 = (max[axis] - origin[axis]) * invDirection[axis];
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        tHit = tMin;
+        return tMin <= tMax;
+    }
+
+    MeshBounds transform_bounds(const MeshBounds &bounds, const glm::mat4 &modelMatrix) {
+        // the box extent in world space is the absolute rotation-scale applied to the local extent
+        MeshBounds worldBounds;
+        worldBounds.center = glm::vec3(modelMatrix * glm::vec4(bounds.center, 1.0f));
+        for (int axis = 0; axis < 3; axis++) {
+            worldBounds.extent[axis] = std::abs(modelMatrix[0][axis]) * bounds.extent.x +
+                                       std::abs(modelMatrix[1][axis]) * bounds.extent.y +
+                                       std::abs(modelMatrix[2][axis]) * bounds.extent.z;
+        }
+        float maxScale = std::max({glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1])),
+                                   glm::length(glm::vec3(modelMatrix[2]))});
+        worldBounds.radius = bounds.radius * maxScale;
+        return worldBounds;
+    }
+
+    void BoundsList::clear() {
+        _count = 0;
+        _centerX.clear();
+        _centerY.clear();
+        _centerZ.clear();
+        _extentX.clear();
+        _extentY.clear();
+        _extentZ.clear();
+        _radius.clear();
+    }
+
+    void BoundsList::add(const MeshBounds &bounds) {
+        // grow by a whole SIMD group at a time, padding entries are never reported
+        if (_count % SIMD_WIDTH == 0) {
+            size_t paddedSize = _count + SIMD_WIDTH;
+            for (auto array: {&_centerX, &_centerY, &_centerZ, &_extentX, &_extentY, &_extentZ, &_radius}) {
+                array->resize(paddedSize, 0.0f);
+            }
+        }
+
+        _centerX[_count] = bounds.center.x;
+        _centerY[_count] = bounds.center.y;
+        _centerZ[_count] = bounds.center.z;
+        _extentX[_count] = bounds.extent.x;
+        _extentY[_count] = bounds.extent.y;
+        _extentZ[_count] = bounds.extent.z;
+        _radius[_count] = bounds.radius;
+        _count++;
+    }
+
+    size_t BoundsList::cull_frustum(const Frustum &frustum, std::vector<uint8_t> &visible) const {
+        visible.resize(_centerX.size());
+
+#ifdef CULLING_SSE
+        for (size_t i = 0; i < _centerX.size(); i += SIMD_WIDTH) {
+            __m128 centerX = _mm_loadu_ps(&_centerX[i]);
+            __m128 centerY = _mm_loadu_ps(&_centerY[i]);
+            __m128 centerZ = _mm_loadu_ps(&_centerZ[i]);
+            __m128 extentX = _mm_loadu_ps(&_extentX[i]);
+            __m128 extentY = _mm_loadu_ps(&_extentY[i]);
+            __m128 extentZ = _mm_loadu_ps(&_extentZ[i]);
+
+            // a box is outside if it lies fully behind any plane
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const auto &plane: frustum.planes) {
+                __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)), _mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+                        _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 projectedExtent = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))),
+                                   _mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y)))),
+                        _mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z))));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, projectedExtent), _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (size_t lane = 0; lane < SIMD_WIDTH; lane++) {
+                visible[i + lane] = (uint8_t) ((mask >> lane) & 1);
+            }
+        }
+#else
+        for (size_t i = 0; i < _centerX.size(); i++) {
+            bool inside = true;
+            for (const auto &plane: frustum.planes) {
+                float distance = _centerX[i] * plane.x + _centerY[i] * plane.y + _centerZ[i] * plane.z + plane.w;
+                float projectedExtent = _extentX[i] * std::abs(plane.x) + _extentY[i] * std::abs(plane.y) +
+                                        _extentZ[i] * std::abs(plane.z);
+                inside = inside && distance + projectedExtent >= 0.0f;
+            }
+            visible[i] = (uint8_t) inside;
+        }
+#endif
+
+        visible.resize(_count);
+        return (size_t) std::count(visible.begin(), visible.end(), 1);
+    }
+
+    size_t BoundsList::cull_sphere(const glm::vec3 &center, float radius, std::vector<uint8_t> &visible) const {
+        visible.resize(_centerX.size());
+
+#ifdef CULLING_SSE
+        __m128 sphereX = _mm_set1_ps(center.x);
+        __m128 sphereY = _mm_set1_ps(center.y);
+        __m128 sphereZ = _mm_set1_ps(center.z);
+        __m128 sphereRadius = _mm_set1_ps(radius);
+        for (size_t i = 0; i < _centerX.size(); i += SIMD_WIDTH) {
+            __m128 deltaX = _mm_sub_ps(_mm_loadu_ps(&_centerX[i]), sphereX);
+            __m128 deltaY = _mm_sub_ps(_mm_loadu_ps(&_centerY[i]), sphereY);
+            __m128 deltaZ = _mm_sub_ps(_mm_loadu_ps(&_centerZ[i]), sphereZ);
+            __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(deltaX, deltaX), _mm_mul_ps(deltaY, deltaY)),
+                                           _mm_mul_ps(deltaZ, deltaZ));
+            __m128 radiusSum = _mm_add_ps(_mm_loadu_ps(&_radius[i]), sphereRadius);
+
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_mul_ps(radiusSum, radiusSum)));
+            for (size_t lane = 0; lane < SIMD_WIDTH; lane++) {
+                visible[i + lane] = (uint8_t) ((mask >> lane) & 1);
+            }
+        }
+#else
+        for (size_t i = 0; i < _centerX.size(); i++) {
+            float deltaX = _centerX[i] - center.x;
+            float deltaY = _centerY[i] - center.y;
+            float deltaZ = _centerZ[i] - center.z;
+            float radiusSum = _radius[i] + radius;
+            visible[i] = (uint8_t) (deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ <= radiusSum * radiusSum);
+        }
+#endif
+
+        visible.resize(_count);
+        return (size_t) std::count(visible.begin(), visible.end(), 1);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace GLRenderer {
+    // local-space bounds of a mesh, computed from its vertices when it is uploaded
+    struct MeshBounds {
+        glm::vec3 center = glm::vec3(0.0f);
+        // half size of the box
+        glm::vec3 extent = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    struct AABB {
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+
+        glm::vec3 center() const { return (min + max) * 0.5f; }
+
+        glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+        float surface_area() const;
+
+        void grow(const AABB &other);
+
+        bool intersects_sphere(const glm::vec3 &center, float radius) const;
+
+        // slab test, tHit is the entry distance along the ray
+        bool intersects_ray(const glm::vec3 &origin, const glm::vec3 &invDirection, float maxDistance, float &tHit) const;
+    };
+
+    enum class CullResult {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    struct Frustum {
+        // xyz normal pointing inwards, w distance, normalized
+        glm::vec4 planes[6];
+
+        static Frustum from_matrix(const glm::mat4 &viewProj);
+
+        CullResult classify(const AABB &box) const;
+
+        bool intersects_sphere(const glm::vec3 &center, float radius) const;
+    };
+
+    // local bounds moved into world space, the sphere grows with the largest axis scale
+    MeshBounds transform_bounds(const MeshBounds &bounds, const glm::mat4 &modelMatrix);
+
+    // world-space bounds stored as structure of arrays, padded to the SIMD width so the
+    // kernels can test four boxes at a time without a scalar tail
+    class BoundsList {
+    public:
+        void clear();
+
+        // appends world-space bounds
+        void add(const MeshBounds &bounds);
+
+        size_t size() const { return _count; }
+
+        // visible[i] is 1 if box i intersects the frustum, returns the number of visible boxes
+        size_t cull_frustum(const Frustum &frustum, std::vector<uint8_t> &visible) const;
+
+        // visible[i] is 1 if sphere i intersects the given sphere, used for point light shadow casters
+        size_t cull_sphere(const glm::vec3 &center, float radius, std::vector<uint8_t> &visible) const;
+
+    private:
+        size_t _count = 0;
+        std::vector<float> _centerX, _centerY, _centerZ;
+        std::vector<float> _extentX, _extentY, _extentZ;
+        std::vector<float> _radius;
+    };
+}
@@ -0,0 +1,180 @@
+#include "geometry_pool.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+
+namespace GLRenderer {
+    GeometryPool::GeometryPool(size_t vertexCapacity, size_t indexCapacity) {
+        _vertexCapacity = vertexCapacity;
+        _indexCapacity = indexCapacity * sizeof(unsigned int);
+
+        glCreateBuffers(1, &positionVBO);
+        glNamedBufferData(positionVBO, (GLsizeiptr) (_vertexCapacity * sizeof(PositionVertex)), nullptr, GL_STATIC_DRAW);
+        glCreateBuffers(1, &attributeVBO);
+        glNamedBufferData(attributeVBO, (GLsizeiptr) (_vertexCapacity * sizeof(AttributeVertex)), nullptr,
+                          GL_STATIC_DRAW);
+        glCreateBuffers(1, &EBO);
+        glNamedBufferData(EBO, (GLsizeiptr) _indexCapacity, nullptr, GL_STATIC_DRAW);
+
+        // set up attributes once for the whole pool
+        glCreateVertexArrays(1, &VAO);
+        glCreateVertexArrays(1, &depthVAO);
+        bind_vertex_buffers();
+    }
+
+    void GeometryPool::bind_vertex_buffers() {
+        set_vertex_format<PositionVertex>(VAO, 0, positionVBO);
+        set_vertex_format<AttributeVertex>(VAO, 1, attributeVBO);
+        glVertexArrayElementBuffer(VAO, EBO);
+        set_vertex_format<PositionVertex>(depthVAO, 0, positionVBO);
+        glVertexArrayElementBuffer(depthVAO, EBO);
+    }
+
+    GeometryAllocation GeometryPool::allocate(const PositionVertex *positions, const AttributeVertex *attributes,
+                                              size_t vertexCount, const unsigned int *indices, size_t indexCount) {
+        GeometryAllocation allocation;
+        size_t vertexStart = 0;
+        size_t indexStart = 0;
+
+        // indices are relative to the base vertex, small meshes fit in 16 bits
+        allocation.indexType = vertexCount <= SHORT_INDEX_VERTEX_LIMIT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        size_t indexBytes = index_bytes(allocation.indexType, indexCount);
+
+        // reuse a freed range if one fits, otherwise append and grow the buffers if needed
+        if (!take_range(_freeVertices, vertexCount, vertexStart)) {
+            vertexStart = _vertexEnd;
+            _vertexEnd += vertexCount;
+            if (_vertexEnd > _vertexCapacity) {
+                size_t newCapacity = std::max(_vertexCapacity * 2, _vertexEnd);
+                grow_buffer(positionVBO, _vertexCapacity * sizeof(PositionVertex),
+                            newCapacity * sizeof(PositionVertex));
+                grow_buffer(attributeVBO, _vertexCapacity * sizeof(AttributeVertex),
+                            newCapacity * sizeof(AttributeVertex));
+                _vertexCapacity = newCapacity;
+                bind_vertex_buffers();
+            }
+        }
+        if (!take_range(_freeIndices, indexBytes, indexStart)) {
+            indexStart = _indexEnd;
+            _indexEnd += indexBytes;
+            if (_indexEnd > _indexCapacity) {
+                size_t newCapacity = std::max(_indexCapacity * 2, _indexEnd);
+                grow_buffer(EBO, _indexCapacity, newCapacity);
+                _indexCapacity = newCapacity;
+                bind_vertex_buffers();
+            }
+        }
+
+        glNamedBufferSubData(positionVBO, (GLintptr) (vertexStart * sizeof(PositionVertex)),
+                             (GLsizeiptr) (vertexCount * sizeof(PositionVertex)), positions);
+        glNamedBufferSubData(attributeVBO, (GLintptr) (vertexStart * sizeof(AttributeVertex)),
+                             (GLsizeiptr) (vertexCount * sizeof(AttributeVertex)), attributes);
+        if (allocation.indexType == GL_UNSIGNED_SHORT) {
+            _shortIndexScratch.assign(indices, indices + indexCount);
+            glNamedBufferSubData(EBO, (GLintptr) indexStart, (GLsizeiptr) (indexCount * sizeof(uint16_t)),
+                                 _shortIndexScratch.data());
+        } else {
+            glNamedBufferSubData(EBO, (GLintptr) indexStart, (GLsizeiptr) (indexCount * sizeof(unsigned int)),
+                                 indices);
+        }
+
+        _vertexUsed += vertexCount;
+        _indexUsed += indexCount;
+        _indexBytesUsed += indexBytes;
+        allocation.baseVertex = (uint32_t) vertexStart;
+        allocation.vertexCount = (uint32_t) vertexCount;
+        allocation.firstIndex = (uint32_t) (indexStart / index_size(allocation.indexType));
+        allocation.indexCount = (uint32_t) indexCount;
+        return allocation;
+    }
+
+    void GeometryPool::free(const GeometryAllocation &allocation) {
+        return_range(_freeVertices, _vertexEnd, allocation.baseVertex, allocation.vertexCount);
+        size_t indexBytes = index_bytes(allocation.indexType, allocation.indexCount);
+        size_t indexStart = allocation.firstIndex * index_size(allocation.indexType);
+        return_range(_freeIndices, _indexEnd, indexStart, indexBytes);
+        _vertexUsed -= allocation.vertexCount;
+        _indexUsed -= allocation.indexCount;
+        _indexBytesUsed -= indexBytes;
+    }
+
+    void GeometryPool::bind() const {
+        glBindVertexArray(VAO);
+    }
+
+    void GeometryPool::bind_depth() const {
+        glBindVertexArray(depthVAO);
+    }
+
+    void GeometryPool::cleanup() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteVertexArrays(1, &depthVAO);
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteBuffers(1, &attributeVBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = depthVAO = positionVBO = attributeVBO = EBO = 0;
+    }
+
+    size_t GeometryPool::index_bytes(GLenum indexType, size_t indexCount) {
+        // keep every allocation 4 byte aligned
+        return (indexCount * index_size(indexType) + 3) & ~(size_t) 3;
+    }
+
+    bool GeometryPool::take_range(std::vector<Range> &freeRanges, size_t count, size_t &start) {
+        // first fit
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->count >= count) {
+                start = it->start;
+                it->start += count;
+                it->count -= count;
+                if (it->count == 0) {
+                    freeRanges.erase(it);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void GeometryPool::return_range(std::vector<Range> &freeRanges, size_t &end, size_t start, size_t count) {
+        if (count == 0) {
+            return;
+        }
+
+        auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), start, [](const Range &range, size_t value) {
+            return range.start < value;
+        });
+        it = freeRanges.insert(it, {start, count});
+
+        // merge with the following and preceding ranges
+        auto next = it + 1;
+        if (next != freeRanges.end() && it->start + it->count == next->start) {
+            it->count += next->count;
+            freeRanges.erase(next);
+        }
+        if (it != freeRanges.begin()) {
+            auto previous = it - 1;
+            if (previous->start + previous->count == it->start) {
+                previous->count += it->count;
+                it = freeRanges.erase(it) - 1;
+            }
+        }
+
+        // a free range at the end just moves the end back
+        if (it->start + it->count == end) {
+            end = it->start;
+            freeRanges.erase(it);
+        }
+    }
+
+    void GeometryPool::grow_buffer(unsigned int &buffer, size_t oldSize, size_t newSize) {
+        unsigned int newBuffer = 0;
+        glCreateBuffers(1, &newBuffer);
+        glNamedBufferData(newBuffer, (GLsizeiptr) newSize, nullptr, GL_STATIC_DRAW);
+        if (oldSize > 0) {
+            glCopyNamedBufferSubData(buffer, newBuffer, 0, 0, (GLsizeiptr) oldSize);
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = newBuffer;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <gl/vertex_format.h>
+#include <gl/culling.h>
+
+namespace GLRenderer {
+    // meshes up to this many vertices get 16-bit indices
+    constexpr size_t SHORT_INDEX_VERTEX_LIMIT = 1 << 16;
+
+    // where a mesh lives inside the pool, in vertices and indices; firstIndex counts in units of indexType
+    struct GeometryAllocation {
+        uint32_t baseVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+    };
+
+    // layout glMultiDrawElementsIndirect reads from the indirect buffer
+    struct DrawCommand {
+        uint32_t count;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t baseInstance;
+    };
+
+    // a position stream and an attribute stream plus one index buffer shared by all static meshes;
+    // VAO reads both streams, depthVAO only positions for the depth passes. 16-bit and 32-bit indices
+    // share the index buffer, every allocation there is 4 byte aligned so both can address it
+    class GeometryPool {
+    public:
+        GeometryPool(size_t vertexCapacity, size_t indexCapacity);
+
+        // streams come packed, positions quantized inside the mesh bounds that the draws dequantize them with
+        GeometryAllocation allocate(const PositionVertex *positions, const AttributeVertex *attributes,
+                                    size_t vertexCount, const unsigned int *indices, size_t indexCount);
+
+        void free(const GeometryAllocation &allocation);
+
+        void bind() const;
+
+        void bind_depth() const;
+
+        void cleanup();
+
+        size_t get_vertex_count() const { return _vertexUsed; }
+
+        size_t get_index_count() const { return _indexUsed; }
+
+        size_t get_index_bytes() const { return _indexBytesUsed; }
+
+        // bytes the used vertices take on the GPU, and what they would take as unpacked Vertex
+        size_t get_vertex_bytes() const { return _vertexUsed * (sizeof(PositionVertex) + sizeof(AttributeVertex)); }
+
+        size_t get_unpacked_vertex_bytes() const { return _vertexUsed * sizeof(Vertex); }
+
+        static size_t index_size(GLenum indexType) {
+            return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        }
+
+        unsigned int VAO = 0;
+        unsigned int depthVAO = 0;
+        unsigned int positionVBO = 0;
+        unsigned int attributeVBO = 0;
+        unsigned int EBO = 0;
+
+    private:
+        struct Range {
+            size_t start;
+            size_t count;
+        };
+
+        size_t _vertexCapacity = 0;
+        // index buffer space is tracked in bytes
+        size_t _indexCapacity = 0;
+        size_t _vertexUsed = 0;
+        size_t _indexUsed = 0;
+        size_t _indexBytesUsed = 0;
+        // freed ranges, sorted by start and coalesced
+        std::vector<Range> _freeVertices;
+        std::vector<Range> _freeIndices;
+        // end of the highest allocation, everything past it is free
+        size_t _vertexEnd = 0;
+        size_t _indexEnd = 0;
+
+        static size_t index_bytes(GLenum indexType, size_t indexCount);
+
+        static bool take_range(std::vector<Range> &freeRanges, size_t count, size_t &start);
+
+        static void return_range(std::vector<Range> &freeRanges, size_t &end, size_t start, size_t count);
+
+        // staging for 16-bit indices, reused between allocations
+        std::vector<uint16_t> _shortIndexScratch;
+
+        void bind_vertex_buffers();
+
+        static void grow_buffer(unsigned int &buffer, size_t oldSize, size_t newSize);
+    };
+}
@@ -0,0 +1,82 @@
+#include "gl_state.h"
+#include <algorithm>
+#include <iterator>
+
+namespace GLRenderer {
+    void GLStateCache::use_program(unsigned int program) {
+        if (_program == program) {
+            _stats.skipped++;
+            return;
+        }
+        _program = program;
+        glUseProgram(program);
+        _stats.programBinds++;
+    }
+
+    void GLStateCache::bind_vertex_array(unsigned int vao) {
+        if (_vao == vao) {
+            _stats.skipped++;
+            return;
+        }
+        _vao = vao;
+        glBindVertexArray(vao);
+        _stats.vaoBinds++;
+    }
+
+    void GLStateCache::bind_texture(uint32_t unit, unsigned int texture) {
+        if (unit < GL_STATE_TEXTURE_UNITS && _textures[unit] == texture) {
+            _stats.skipped++;
+            return;
+        }
+        if (unit < GL_STATE_TEXTURE_UNITS) {
+            _textures[unit] = texture;
+        }
+        glBindTextureUnit(unit, texture);
+        _stats.textureBinds++;
+    }
+
+    void GLStateCache::bind_framebuffer(unsigned int framebuffer) {
+        if (_framebuffer == framebuffer) {
+            _stats.skipped++;
+            return;
+        }
+        _framebuffer = framebuffer;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        _stats.framebufferBinds++;
+    }
+
+    void GLStateCache::cull_face(GLenum face) {
+        if (_cullFace == face) {
+            return;
+        }
+        _cullFace = face;
+        glCullFace(face);
+    }
+
+    void GLStateCache::enable_culling(bool enabled) {
+        if (_culling == (int) enabled) {
+            return;
+        }
+        _culling = (int) enabled;
+        if (enabled) {
+            glEnable(GL_CULL_FACE);
+        } else {
+            glDisable(GL_CULL_FACE);
+        }
+    }
+
+    void GLStateCache::invalidate() {
+        _program = UNKNOWN;
+        _vao = UNKNOWN;
+        std::fill(std::begin(_textures), std::end(_textures), UNKNOWN);
+        _framebuffer = UNKNOWN;
+        _cullFace = 0;
+        _culling = -1;
+    }
+
+    GLStateStats GLStateCache::take_stats() {
+        GLStateStats stats = _stats;
+        _stats = GLStateStats();
+        return stats;
+    }
+}
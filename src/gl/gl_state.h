@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace GLRenderer {
+    constexpr uint32_t GL_STATE_TEXTURE_UNITS = 16;
+
+    struct GLStateStats {
+        uint32_t drawCalls = 0;
+        uint32_t programBinds = 0;
+        uint32_t textureBinds = 0;
+        uint32_t vaoBinds = 0;
+        uint32_t framebufferBinds = 0;
+        // binds dropped because the state was already current
+        uint32_t skipped = 0;
+    };
+
+    // shadow copy of the bindings the renderer changes, so only binds that change something reach the driver;
+    // anything else touching GL state (ImGui, texture uploads) has to be followed by invalidate()
+    class GLStateCache {
+    public:
+        GLStateCache() { invalidate(); }
+
+        void use_program(unsigned int program);
+
+        void bind_vertex_array(unsigned int vao);
+
+        // DSA bind, leaves the active texture unit alone
+        void bind_texture(uint32_t unit, unsigned int texture);
+
+        void bind_framebuffer(unsigned int framebuffer);
+
+        void cull_face(GLenum face);
+
+        // GL_CULL_FACE, off by default in GL
+        void enable_culling(bool enabled);
+
+        void count_draw() { _stats.drawCalls++; }
+
+        // forget everything, the next bind of each kind is always issued
+        void invalidate();
+
+        // counts since the last call
+        GLStateStats take_stats();
+
+    private:
+        // 0 is a valid binding, so unknown is tracked separately
+        static constexpr unsigned int UNKNOWN = UINT32_MAX;
+
+        unsigned int _program = UNKNOWN;
+        unsigned int _vao = UNKNOWN;
+        unsigned int _textures[GL_STATE_TEXTURE_UNITS] = {};
+        unsigned int _framebuffer = UNKNOWN;
+        GLenum _cullFace = 0;
+        // -1 until the first call
+        int _culling = -1;
+        GLStateStats _stats;
+    };
+}
@@ -0,0 +1,154 @@
+#include "gpu_profiler.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+namespace GLRenderer {
+    double GpuFrame::get_time(const char *name) const {
+        double time = 0.0;
+        for (auto &zone: zones) {
+            if (strcmp(zone.name, name) == 0) {
+                time += zone.duration;
+            }
+        }
+        return time;
+    }
+
+    GpuProfiler::GpuProfiler() {
+        for (auto &frame: _frames) {
+            glCreateQueries(GL_TIMESTAMP, (GLsizei) (GPU_PROFILER_MAX_ZONES * 2), frame.queries);
+        }
+    }
+
+    void GpuProfiler::begin_frame() {
+        collect();
+
+        // the slot is still in flight after GPU_PROFILER_FRAME_LAG frames, drop it rather than stall
+        FrameQueries &queries = current();
+        if (queries.pending) {
+            queries.pending = false;
+            _droppedFrames++;
+        }
+        queries.zoneCount = 0;
+        queries.frame = _frameIndex;
+        _stack.clear();
+        push("Frame");
+    }
+
+    void GpuProfiler::end_frame() {
+        while (!_stack.empty()) {
+            pop();
+        }
+        FrameQueries &queries = current();
+        queries.pending = queries.zoneCount > 0;
+        _frameIndex++;
+    }
+
+    void GpuProfiler::push(const char *name) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+
+        FrameQueries &queries = current();
+        if (queries.zoneCount >= GPU_PROFILER_MAX_ZONES) {
+            _stack.push_back(UINT32_MAX);
+            return;
+        }
+        uint32_t zone = queries.zoneCount++;
+        queries.names[zone] = name;
+        queries.depths[zone] = (uint32_t) _stack.size();
+        glQueryCounter(queries.queries[zone * 2], GL_TIMESTAMP);
+        _stack.push_back(zone);
+    }
+
+    void GpuProfiler::pop() {
+        if (_stack.empty()) {
+            return;
+        }
+        uint32_t zone = _stack.back();
+        _stack.pop_back();
+        if (zone != UINT32_MAX) {
+            glQueryCounter(current().queries[zone * 2 + 1], GL_TIMESTAMP);
+        }
+        glPopDebugGroup();
+    }
+
+    void GpuProfiler::collect() {
+        // oldest first, so the last frame stays the newest
+        for (uint32_t i = 0; i < GPU_PROFILER_FRAME_LAG; i++) {
+            FrameQueries &queries = _frames[(_frameIndex + i) % GPU_PROFILER_FRAME_LAG];
+            if (queries.pending && resolve(queries)) {
+                queries.pending = false;
+            }
+        }
+    }
+
+    bool GpuProfiler::resolve(FrameQueries &queries) {
+        // timestamps complete in order, so the frame's last end means every query is done;
+        // the frame zone is opened first and closed last
+        int available = 0;
+        glGetQueryObjectiv(queries.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+
+        GpuFrame frame;
+        frame.frame = queries.frame;
+        frame.zones.reserve(queries.zoneCount);
+        for (uint32_t zone = 0; zone < queries.zoneCount; zone++) {
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(queries.queries[zone * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries.queries[zone * 2 + 1], GL_QUERY_RESULT, &end);
+            if (zone == 0) {
+                frame.timestamp = begin;
+            }
+            GpuZone result{};
+            result.name = queries.names[zone];
+            result.depth = queries.depths[zone];
+            result.start = (double) (begin - frame.timestamp) / 1000000.0;
+            result.duration = end > begin ? (double) (end - begin) / 1000000.0 : 0.0;
+            frame.zones.push_back(result);
+        }
+
+        if (_captureRemaining > 0) {
+            _captured.push_back(frame);
+            _captureRemaining--;
+        }
+        _lastFrame = std::move(frame);
+        return true;
+    }
+
+    void GpuProfiler::start_capture(uint32_t frameCount) {
+        _captured.clear();
+        _captured.reserve(frameCount);
+        _captureRemaining = frameCount;
+    }
+
+    bool GpuProfiler::write_trace(const std::string &filePath) const {
+        std::ofstream file(filePath, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "Failed to write GPU trace " << filePath << std::endl;
+            return false;
+        }
+
+        // complete events in microseconds relative to the first captured frame
+        uint64_t origin = _captured.empty() ? 0 : _captured.front().timestamp;
+        file << "{\"traceEvents\": [\n";
+        file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}";
+        for (auto &frame: _captured) {
+            double frameStart = (double) (frame.timestamp - origin) / 1000.0;
+            for (auto &zone: frame.zones) {
+                file << ",\n  {\"name\": \"" << zone.name << "\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 0, "
+                     << "\"tid\": 0, \"ts\": " << frameStart + zone.start * 1000.0 << ", \"dur\": "
+                     << zone.duration * 1000.0 << ", \"args\": {\"frame\": " << frame.frame << "}}";
+            }
+        }
+        file << "\n], \"displayTimeUnit\": \"ms\"}\n";
+        return true;
+    }
+
+    void GpuProfiler::cleanup() {
+        for (auto &frame: _frames) {
+            glDeleteQueries((GLsizei) (GPU_PROFILER_MAX_ZONES * 2), frame.queries);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace GLRenderer {
+    // frames in flight before a query slot is reused, results are read this many frames late at worst
+    constexpr uint32_t GPU_PROFILER_FRAME_LAG = 4;
+    constexpr uint32_t GPU_PROFILER_MAX_ZONES = 64;
+
+    struct GpuZone {
+        // string literals only, names are kept by pointer
+        const char *name;
+        uint32_t depth;
+        // ms since the start of the frame
+        double start;
+        double duration;
+    };
+
+    struct GpuFrame {
+        uint64_t frame = 0;
+        // GPU clock in ns when the frame started
+        uint64_t timestamp = 0;
+        std::vector<GpuZone> zones;
+
+        // total of every zone with the name, 0 if the pass did not run
+        double get_time(const char *name) const;
+    };
+
+    // timestamp queries around nested passes, each also a debug group so captures in RenderDoc or Nsight
+    // show the same names; results are read back only once available so the CPU never waits on the GPU
+    class GpuProfiler {
+    public:
+        GpuProfiler();
+
+        // reads back finished frames and opens the frame zone
+        void begin_frame();
+
+        void end_frame();
+
+        void push(const char *name);
+
+        void pop();
+
+        // reads back every finished frame without waiting
+        void collect();
+
+        // the newest frame with results, frame numbers tell how far it lags
+        const GpuFrame &get_last_frame() const { return _lastFrame; }
+
+        uint32_t get_dropped_frames() const { return _droppedFrames; }
+
+        uint64_t get_frame_index() const { return _frameIndex; }
+
+        // keeps the next frameCount finished frames for write_trace
+        void start_capture(uint32_t frameCount);
+
+        bool is_capturing() const { return _captureRemaining > 0; }
+
+        // Chrome about:tracing JSON
+        bool write_trace(const std::string &filePath) const;
+
+        void cleanup();
+
+    private:
+        // one frame's queries, zone i uses the query pair at 2 * i
+        struct FrameQueries {
+            unsigned int queries[GPU_PROFILER_MAX_ZONES * 2] = {};
+            const char *names[GPU_PROFILER_MAX_ZONES] = {};
+            uint32_t depths[GPU_PROFILER_MAX_ZONES] = {};
+            uint32_t zoneCount = 0;
+            uint64_t frame = 0;
+            bool pending = false;
+        };
+
+        FrameQueries _frames[GPU_PROFILER_FRAME_LAG];
+        uint64_t _frameIndex = 0;
+        // zone indices of the open zones, UINT32_MAX for zones past the limit that only get a debug group
+        std::vector<uint32_t> _stack;
+        GpuFrame _lastFrame;
+        uint32_t _droppedFrames = 0;
+
+        std::vector<GpuFrame> _captured;
+        uint32_t _captureRemaining = 0;
+
+        FrameQueries &current() { return _frames[_frameIndex % GPU_PROFILER_FRAME_LAG]; }
+
+        bool resolve(FrameQueries &queries);
+    };
+
+    // push and pop over a scope
+    class GpuZoneScope {
+    public:
+        GpuZoneScope(GpuProfiler *profiler, const char *name) : _profiler(profiler) {
+            _profiler->push(name);
+        }
+
+        ~GpuZoneScope() {
+            _profiler->pop();
+        }
+
+        GpuZoneScope(const GpuZoneScope &) = delete;
+
+        GpuZoneScope &operator=(const GpuZoneScope &) = delete;
+
+    private:
+        GpuProfiler *_profiler;
+    };
+}
@@ -0,0 +1,200 @@
+#include "light_clusters.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <profiler.h>
+
+namespace GLRenderer {
+    LightClusters::LightClusters() {
+        _clusters.resize(CLUSTER_COUNT);
+        _lightBuffer = new UniformBuffer(sizeof(PointLight) * MAX_POINT_LIGHTS, POINT_LIGHT_BINDING,
+                                         GL_SHADER_STORAGE_BUFFER);
+        _clusterBuffer = new UniformBuffer(sizeof(LightCluster) * CLUSTER_COUNT, LIGHT_CLUSTER_BINDING,
+                                           GL_SHADER_STORAGE_BUFFER);
+        // sized for the compute path, which writes every cluster's list at a fixed offset
+        _indexBuffer = new UniformBuffer(sizeof(uint32_t) * CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER,
+                                         LIGHT_INDEX_BINDING, GL_SHADER_STORAGE_BUFFER);
+        _clusterBuffer->update(_clusters.data(), sizeof(LightCluster) * _clusters.size());
+
+        _cullShader = new Shader("../shaders/light_cull.comp.spv");
+        if (!_cullShader->isLinked) {
+            std::cout << "Light culling shader unavailable, lights are binned on the CPU only" << std::endl;
+        }
+        _lightCountUniform = _cullShader->get_uniform<int>(LIGHT_COUNT_LOCATION, "light_count");
+    }
+
+    void LightClusters::set_view(const glm::mat4 &projection, float near, float far, uint32_t width,
+                                 uint32_t height) {
+        if (projection == _projection && near == _near && far == _far && width == _width && height == _height) {
+            return;
+        }
+        _projection = projection;
+        _near = near;
+        _far = far;
+        _width = std::max(width, 1u);
+        _height = std::max(height, 1u);
+
+        // tiles are whole pixels so the fragment shader can find its tile from gl_FragCoord alone
+        _tileSize = glm::vec2((float) ((_width + CLUSTER_GRID_X - 1) / CLUSTER_GRID_X),
+                              (float) ((_height + CLUSTER_GRID_Y - 1) / CLUSTER_GRID_Y));
+        // slice = log(depth) * scale + bias, so every slice covers the same depth ratio
+        float depthRatio = std::log(_far / _near);
+        _sliceScale = (float) CLUSTER_GRID_Z / depthRatio;
+        _sliceBias = -(float) CLUSTER_GRID_Z * std::log(_near) / depthRatio;
+
+        // a froxel is widest at its far end on the side away from the view axis, so take both ends
+        _bounds.resize(CLUSTER_COUNT);
+        glm::vec2 screen = glm::vec2((float) _width, (float) _height);
+        glm::vec2 invScale = glm::vec2(1.0f / _projection[0][0], 1.0f / _projection[1][1]);
+        for (uint32_t z = 0; z < CLUSTER_GRID_Z; z++) {
+            float sliceNear = _near * std::pow(_far / _near, (float) z / (float) CLUSTER_GRID_Z);
+            float sliceFar = _near * std::pow(_far / _near, (float) (z + 1) / (float) CLUSTER_GRID_Z);
+            for (uint32_t y = 0; y < CLUSTER_GRID_Y; y++) {
+                for (uint32_t x = 0; x < CLUSTER_GRID_X; x++) {
+                    glm::vec2 tile = glm::vec2((float) x, (float) y);
+                    glm::vec2 ndcMin = tile * _tileSize / screen * 2.0f - 1.0f;
+                    glm::vec2 ndcMax = glm::min((tile + 1.0f) * _tileSize, screen) / screen * 2.0f - 1.0f;
+
+                    AABB &bounds = _bounds[x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z)];
+                    glm::vec2 boundsMin = glm::min(ndcMin * sliceNear, ndcMin * sliceFar) * invScale;
+                    glm::vec2 boundsMax = glm::max(ndcMax * sliceNear, ndcMax * sliceFar) * invScale;
+                    bounds.min = glm::vec3(boundsMin, -sliceFar);
+                    bounds.max = glm::vec3(boundsMax, -sliceNear);
+                }
+            }
+        }
+    }
+
+    void LightClusters::fill_frame_data(FrameData &frameData) const {
+        frameData.clusterGrid = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 0);
+        frameData.clusterTile = glm::vec4(_tileSize, (float) _width, (float) _height);
+        frameData.clusterDepth = glm::vec4(_sliceScale, _sliceBias, _near, _far);
+        frameData.projectionScale = glm::vec4(_projection[0][0], _projection[1][1], 0.0f, 0.0f);
+    }
+
+    void LightClusters::upload_lights(const std::vector<PointLight> &lights) {
+        size_t count = std::min(lights.size(), (size_t) MAX_POINT_LIGHTS);
+        if (count > 0) {
+            _lightBuffer->update(lights.data(), sizeof(PointLight) * count);
+        }
+    }
+
+    void LightClusters::bin_lights(const std::vector<PointLight> &lights, const glm::mat4 &view) {
+        PROFILE_ZONE("LightClusters::bin_lights");
+        _overlaps.clear();
+        uint32_t lightCount = (uint32_t) std::min(lights.size(), (size_t) MAX_POINT_LIGHTS);
+        float scaleX = _projection[0][0];
+        float scaleY = _projection[1][1];
+        for (uint32_t light = 0; light < lightCount; light++) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[light].positionRadius), 1.0f));
+            float radius = lights[light].positionRadius.w;
+            float depth = -center.z;
+            if (depth + radius <= _near || depth - radius >= _far) {
+                continue;
+            }
+            float depthMin = std::max(depth - radius, _near);
+            float depthMax = std::min(depth + radius, _far);
+
+            // x / depth is monotonic in both, so the corners of the sphere's box bound its screen rectangle
+            float ndcMinX = std::min(std::min(scaleX * (center.x - radius) / depthMin,
+                                              scaleX * (center.x - radius) / depthMax), 1.0f);
+            float ndcMaxX = std::max(std::max(scaleX * (center.x + radius) / depthMin,
+                                              scaleX * (center.x + radius) / depthMax), -1.0f);
+            float ndcMinY = std::min(std::min(scaleY * (center.y - radius) / depthMin,
+                                              scaleY * (center.y - radius) / depthMax), 1.0f);
+            float ndcMaxY = std::max(std::max(scaleY * (center.y + radius) / depthMin,
+                                              scaleY * (center.y + radius) / depthMax), -1.0f);
+            uint32_t firstX = tile_x(ndcMinX), lastX = tile_x(ndcMaxX);
+            uint32_t firstY = tile_y(ndcMinY), lastY = tile_y(ndcMaxY);
+            uint32_t firstZ = depth_slice(depthMin), lastZ = depth_slice(depthMax);
+
+            // the rectangle is conservative, so the froxels in it still get the exact sphere test
+            for (uint32_t z = firstZ; z <= lastZ; z++) {
+                for (uint32_t y = firstY; y <= lastY; y++) {
+                    for (uint32_t x = firstX; x <= lastX; x++) {
+                        uint32_t cluster = x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);
+                        if (_bounds[cluster].intersects_sphere(center, radius)) {
+                            _overlaps.emplace_back(cluster, light);
+                        }
+                    }
+                }
+            }
+        }
+
+        // counting sort by cluster, lights stay in index order within a cluster like in the compute path
+        _stats = LightClusterStats{};
+        _stats.lights = lightCount;
+        for (auto &cluster: _clusters) {
+            cluster = LightCluster{0, 0};
+        }
+        for (auto &overlap: _overlaps) {
+            _clusters[overlap.first].count++;
+        }
+        uint32_t offset = 0;
+        for (auto &cluster: _clusters) {
+            if (cluster.count > MAX_LIGHTS_PER_CLUSTER) {
+                _stats.overflow += cluster.count - MAX_LIGHTS_PER_CLUSTER;
+                cluster.count = MAX_LIGHTS_PER_CLUSTER;
+            }
+            _stats.occupiedClusters += cluster.count > 0 ? 1 : 0;
+            _stats.maxClusterLights = std::max(_stats.maxClusterLights, cluster.count);
+            cluster.offset = offset;
+            offset += cluster.count;
+            // refilled below
+            cluster.count = 0;
+        }
+        _stats.lightReferences = offset;
+        _lightIndices.resize(offset);
+        for (auto &overlap: _overlaps) {
+            LightCluster &cluster = _clusters[overlap.first];
+            if (cluster.count < MAX_LIGHTS_PER_CLUSTER) {
+                _lightIndices[cluster.offset + cluster.count++] = overlap.second;
+            }
+        }
+
+        _clusterBuffer->update(_clusters.data(), sizeof(LightCluster) * _clusters.size());
+        if (!_lightIndices.empty()) {
+            _indexBuffer->update(_lightIndices.data(), sizeof(uint32_t) * _lightIndices.size());
+        }
+    }
+
+    void LightClusters::dispatch(GLStateCache &glState, uint32_t lightCount) {
+        _stats = LightClusterStats{};
+        _stats.lights = lightCount;
+        glState.use_program(_cullShader->programID);
+        _cullShader->set(_lightCountUniform, (int) lightCount);
+        glDispatchCompute((CLUSTER_COUNT + LIGHT_CULL_GROUP_SIZE - 1) / LIGHT_CULL_GROUP_SIZE, 1, 1);
+        // the scene pass reads the lists as storage buffers
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    uint32_t LightClusters::depth_slice(float depth) const {
+        float slice = std::log(depth) * _sliceScale + _sliceBias;
+        return (uint32_t) std::clamp(slice, 0.0f, (float) (CLUSTER_GRID_Z - 1));
+    }
+
+    uint32_t LightClusters::tile_x(float ndc) const {
+        float tile = (ndc * 0.5f + 0.5f) * (float) _width / _tileSize.x;
+        return (uint32_t) std::clamp(tile, 0.0f, (float) (CLUSTER_GRID_X - 1));
+    }
+
+    uint32_t LightClusters::tile_y(float ndc) const {
+        float tile = (ndc * 0.5f + 0.5f) * (float) _height / _tileSize.y;
+        return (uint32_t) std::clamp(tile, 0.0f, (float) (CLUSTER_GRID_Y - 1));
+    }
+
+    void LightClusters::cleanup() {
+        _lightBuffer->cleanup();
+        _clusterBuffer->cleanup();
+        _indexBuffer->cleanup();
+        glDeleteProgram(_cullShader->programID);
+        delete _lightBuffer;
+        delete _clusterBuffer;
+        delete _indexBuffer;
+        delete _cullShader;
+        _lightBuffer = nullptr;
+        _clusterBuffer = nullptr;
+        _indexBuffer = nullptr;
+        _cullShader = nullptr;
+    }
+}
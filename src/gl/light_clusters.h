@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <gl/shader.h>
+#include <gl/shader_data.h>
+#include <gl/uniform_buffer.h>
+#include <gl/culling.h>
+#include <gl/gl_state.h>
+
+namespace GLRenderer {
+    // the view frustum is split into screen tiles and exponential depth slices (froxels); each froxel gets the
+    // point lights whose radius reaches it, so fragments only loop over the lights of their own cluster
+    constexpr uint32_t CLUSTER_GRID_X = 16;
+    constexpr uint32_t CLUSTER_GRID_Y = 9;
+    constexpr uint32_t CLUSTER_GRID_Z = 24;
+    constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+    // both binning paths drop lights past this, the compute path gives every cluster a fixed slice of the list
+    constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 256;
+    constexpr uint32_t MAX_POINT_LIGHTS = 4096;
+    // must match local_size_x in light_cull.comp
+    constexpr uint32_t LIGHT_CULL_GROUP_SIZE = 64;
+
+    struct LightClusterStats {
+        uint32_t lights = 0;
+        uint32_t occupiedClusters = 0;
+        uint32_t maxClusterLights = 0;
+        // total entries in the light index list
+        uint32_t lightReferences = 0;
+        // references dropped because a cluster was full
+        uint32_t overflow = 0;
+    };
+
+    class LightClusters {
+    public:
+        LightClusters();
+
+        // rebuilds the froxel bounds when the projection or the screen size changed
+        void set_view(const glm::mat4 &projection, float near, float far, uint32_t width, uint32_t height);
+
+        // grid and depth slicing parameters the fragment and culling shaders need
+        void fill_frame_data(FrameData &frameData) const;
+
+        void upload_lights(const std::vector<PointLight> &lights);
+
+        // bins on the CPU and uploads the cluster and index lists
+        void bin_lights(const std::vector<PointLight> &lights, const glm::mat4 &view);
+
+        // bins with light_cull.comp, reads the lights uploaded last and the frame buffer; no stats are read back
+        void dispatch(GLStateCache &glState, uint32_t lightCount);
+
+        bool has_compute() const { return _cullShader && _cullShader->isLinked; }
+
+        const LightClusterStats &get_stats() const { return _stats; }
+
+        void cleanup();
+
+    private:
+        // view-space bounds of every froxel, x fastest then y then depth slice
+        std::vector<AABB> _bounds;
+        std::vector<LightCluster> _clusters;
+        std::vector<uint32_t> _lightIndices;
+        // cluster and light of every overlap found, sorted by cluster into the index list
+        std::vector<std::pair<uint32_t, uint32_t>> _overlaps;
+        LightClusterStats _stats;
+
+        glm::mat4 _projection = glm::mat4(0.0f);
+        float _near = 0.0f;
+        float _far = 0.0f;
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        Uniform<int> _lightCountUniform;
+        glm::vec2 _tileSize = glm::vec2(0.0f);
+        float _sliceScale = 0.0f;
+        float _sliceBias = 0.0f;
+
+        Shader *_cullShader = nullptr;
+        UniformBuffer *_lightBuffer = nullptr;
+        UniformBuffer *_clusterBuffer = nullptr;
+        UniformBuffer *_indexBuffer = nullptr;
+
+        uint32_t depth_slice(float depth) const;
+
+        // screen tile covering a normalized device coordinate, clamped to the grid
+        uint32_t tile_x(float ndc) const;
+
+        uint32_t tile_y(float ndc) const;
+    };
+}
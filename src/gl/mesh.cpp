@@ -1,66 +1,63 @@
 #include "mesh.h"
 
-namespace GLRenderer {
-    void Mesh::setup_mesh() {
-        // generate IDs
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+#include <cmath>
+#include <algorithm>
 
-        // copy vertices
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+namespace GLRenderer {
+    MeshBounds compute_mesh_bounds(const Vertex *vertices, size_t vertexCount) {
+        MeshBounds bounds;
+        if (vertexCount == 0) {
+            return bounds;
+        }
+        glm::vec3 boundsMin = vertices[0].position;
+        glm::vec3 boundsMax = vertices[0].position;
+        for (size_t i = 1; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertices[i].position);
+            boundsMax = glm::max(boundsMax, vertices[i].position);
+        }
+        bounds.center = (boundsMin + boundsMax) * 0.5f;
+        bounds.extent = (boundsMax - boundsMin) * 0.5f;
+        float radiusSq = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++) {
+            glm::vec3 offset = vertices[i].position - bounds.center;
+            radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radiusSq);
+        return bounds;
+    }
 
-        // copy indices
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    void encode_mesh(MeshData &data) {
+        data.bounds = compute_mesh_bounds(data.vertices.data(), data.vertices.size());
+        data.positions.resize(data.vertices.size());
+        data.attributes.resize(data.vertices.size());
+        encode_vertices(data.vertices.data(), data.vertices.size(), data.bounds.center, data.bounds.extent,
+                        data.positions.data(), data.attributes.data());
+    }
 
-        // set up attributes
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) 0);
-        // normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, normal));
-        // uvs
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, uv));
-        // tangents
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, tangent));
-        // bitangents
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, bitangent));
+    void Mesh::setup_mesh(GeometryPool *pool, const PositionVertex *positions, const AttributeVertex *attributes,
+                          size_t vertexCount, const unsigned int *indices, size_t numIndices,
+                          const MeshBounds &meshBounds) {
+        // a single full level unless the caller sets up more
+        lods[0] = {0, (uint32_t) numIndices, 0.0f};
+        lodCount = 1;
 
-        glBindVertexArray(0);
+        // the positions were quantized against these bounds, draws dequantize with them
+        bounds = meshBounds;
+        geometry = pool->allocate(positions, attributes, vertexCount, indices, numIndices);
     }
 
-    void Mesh::draw_mesh(glm::mat4 modelMatrix, Shader *shader, unsigned int depthTexture) {
-        // bind PBR textures
-        glActiveTexture(GL_TEXTURE0);
-        shader->set_int("texture_base", 0);
-        glBindTexture(GL_TEXTURE_2D, pbrTexture->albedo->id);
-        glActiveTexture(GL_TEXTURE1);
-        shader->set_int("texture_normal", 1);
-        glBindTexture(GL_TEXTURE_2D, pbrTexture->normal->id);
-        glActiveTexture(GL_TEXTURE2);
-        shader->set_int("texture_roughness", 2);
-        glBindTexture(GL_TEXTURE_2D, pbrTexture->metalroughness->id);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthTexture);
-
-        // draw
-        shader->set_mat4("matrix_model", modelMatrix);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    DrawCommand Mesh::get_draw_command(uint32_t lod) const {
+        DrawCommand command{};
+        command.count = lods[lod].indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = geometry.firstIndex + lods[lod].indexOffset;
+        command.baseVertex = (int32_t) geometry.baseVertex;
+        command.baseInstance = 0;
+        return command;
     }
 
-    void Mesh::draw_mesh_untextured(glm::mat4 modelMatrix, Shader *shader) {
-        // draw
-        shader->set_mat4("matrix_model", modelMatrix);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    void Mesh::cleanup(GeometryPool *pool) {
+        pool->free(geometry);
+        geometry = {};
     }
 }
\ No newline at end of file
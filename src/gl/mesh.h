@@ -1,22 +1,78 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <gl/vertex.h>
 #include <gl/texture.h>
-#include <gl/shader.h>
+#include <gl/geometry_pool.h>
+#include <gl/culling.h>
+#include <gl/mesh_optimizer.h>
+#include <gl/meshlet.h>
 
 namespace GLRenderer {
-    struct Mesh {
-        unsigned int VAO, VBO, EBO;
+    // texture paths relative to the model directory, empty if the material has none
+    struct MaterialRef {
+        std::string baseColor;
+        std::string normal;
+        std::string roughness;
+        std::string name;
+    };
+
+    // CPU-side mesh produced by the importer, before upload
+    struct MeshData {
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
+        MaterialRef material;
+        // index into the model's imported nodes
+        uint32_t node = 0;
+        MeshOptimizationStats optimization;
+        // ranges of indices, the full level first
+        std::vector<MeshLod> lods;
+        // split of the full level
+        std::vector<Meshlet> meshlets;
+        // what gets uploaded and cached, filled by encode_mesh once the vertices are final
+        MeshBounds bounds;
+        std::vector<PositionVertex> positions;
+        std::vector<AttributeVertex> attributes;
+    };
+
+    // box around the vertices, sphere around the box center
+    MeshBounds compute_mesh_bounds(const Vertex *vertices, size_t vertexCount);
+
+    // quantizes the vertices of imported data against their bounds
+    void encode_mesh(MeshData &data);
+
+    // imported node, parents come before their children and the root has parent -1
+    struct NodeData {
+        int32_t parent;
+        glm::mat4 localTransform;
+    };
+
+    // a range of the shared geometry pool plus its material, drawn through the renderer's indirect buffer
+    struct Mesh {
+        GeometryAllocation geometry;
+        MeshBounds bounds;
+        // scene graph node whose world transform places this mesh
+        uint32_t node = 0;
+        // post-transform cache misses per triangle of the uploaded index order
+        float acmr = 0.0f;
+        MeshLod lods[MAX_LOD_COUNT];
+        uint32_t lodCount = 1;
+        // only used at full detail, empty if the mesh was not split
+        std::vector<Meshlet> meshlets;
+        // mesh-space copy of the full detail triangles for the CPU occlusion culler, empty unless the mesh was
+        // picked as an occluder at import
+        std::vector<glm::vec3> occluderPositions;
+        std::vector<uint32_t> occluderIndices;
         Texture *texture;
         PBRTexture *pbrTexture;
 
-        void setup_mesh();
+        void setup_mesh(GeometryPool *pool, const PositionVertex *positions, const AttributeVertex *attributes,
+                        size_t vertexCount, const unsigned int *indices, size_t numIndices,
+                        const MeshBounds &meshBounds);
 
-        void draw_mesh(glm::mat4 modelMatrix, Shader *shader, unsigned int depthTexture);
+        DrawCommand get_draw_command(uint32_t lod) const;
 
-        void draw_mesh_untextured(glm::mat4 modelMatrix, Shader *shader);
+        void cleanup(GeometryPool *pool);
     };
 }
\ No newline at end of file
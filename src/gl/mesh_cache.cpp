@@ -0,0 +1,374 @@
+#include "mesh_cache.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace GLRenderer {
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool MappedFile::open(const std::string &filePath) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            return false;
+        }
+        void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        _file = file;
+        _mapping = mapping;
+        data = (const uint8_t *) view;
+        size = (size_t) fileSize.QuadPart;
+#else
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *view = mmap(nullptr, (size_t) fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        _fd = fd;
+        data = (const uint8_t *) view;
+        size = (size_t) fileStat.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (!data) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(_mapping);
+        CloseHandle(_file);
+        _mapping = nullptr;
+        _file = nullptr;
+#else
+        munmap((void *) data, size);
+        ::close(_fd);
+        _fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool MeshCache::open(const std::string &sourcePath, uint32_t importFlags) {
+        close();
+
+        std::string canonicalPath;
+        int64_t modifiedTime = 0;
+        uint64_t sourceSize = 0;
+        if (!get_source_info(sourcePath, canonicalPath, modifiedTime, sourceSize)) {
+            return false;
+        }
+
+        std::string cachePath = cache_path(sourcePath);
+        if (!_file.open(cachePath)) {
+            return false;
+        }
+
+        // validate header against the source file and the current build
+        if (_file.size < sizeof(MeshCacheHeader)) {
+            close();
+            return false;
+        }
+        _header = (const MeshCacheHeader *) _file.data;
+        if (_header->magic != MESH_CACHE_MAGIC || _header->version != MESH_CACHE_VERSION ||
+            _header->importFlags != importFlags || _header->positionStride != sizeof(PositionVertex) ||
+            _header->attributeStride != sizeof(AttributeVertex) ||
+            _header->sourceModifiedTime != modifiedTime || _header->sourceSize != sourceSize) {
+            std::cout << "Mesh cache " << cachePath << " is stale, rebuilding" << std::endl;
+            close();
+            return false;
+        }
+
+        // make sure every table and blob lies inside the file
+        uint64_t tableEnd = _header->meshTableOffset + (uint64_t) _header->meshCount * sizeof(MeshCacheEntry);
+        if (tableEnd > _file.size || _header->stringTableOffset + _header->stringTableSize > _file.size ||
+            _header->stringTableSize == 0 || _file.data[_header->stringTableOffset + _header->stringTableSize - 1] != '\0') {
+            std::cout << "Mesh cache " << cachePath << " is corrupt, rebuilding" << std::endl;
+            close();
+            return false;
+        }
+        uint64_t nodeTableEnd = _header->nodeTableOffset + (uint64_t) _header->nodeCount * sizeof(MeshCacheNode);
+        if (nodeTableEnd > _file.size) {
+            std::cout << "Mesh cache " << cachePath << " is corrupt, rebuilding" << std::endl;
+            close();
+            return false;
+        }
+        _nodes = (const MeshCacheNode *) (_file.data + _header->nodeTableOffset);
+        for (uint32_t i = 0; i < _header->nodeCount; i++) {
+            if (_nodes[i].parent >= (int32_t) i) {
+                std::cout << "Mesh cache " << cachePath << " is corrupt, rebuilding" << std::endl;
+                close();
+                return false;
+            }
+        }
+        _entries = (const MeshCacheEntry *) (_file.data + _header->meshTableOffset);
+        for (uint32_t i = 0; i < _header->meshCount; i++) {
+            const MeshCacheEntry &entry = _entries[i];
+            bool lodsValid = entry.lodCount > 0 && entry.lodCount <= MAX_LOD_COUNT;
+            for (uint32_t lod = 0; lodsValid && lod < entry.lodCount; lod++) {
+                lodsValid = (uint64_t) entry.lods[lod].indexOffset + entry.lods[lod].indexCount <= entry.indexCount;
+            }
+            bool meshletsValid = entry.meshletOffset + (uint64_t) entry.meshletCount * sizeof(Meshlet) <= _file.size;
+            for (uint32_t m = 0; meshletsValid && m < entry.meshletCount; m++) {
+                const Meshlet &meshlet = ((const Meshlet *) (_file.data + entry.meshletOffset))[m];
+                meshletsValid = (uint64_t) meshlet.indexOffset + meshlet.indexCount <= entry.lods[0].indexCount;
+            }
+            if (!lodsValid || !meshletsValid ||
+                entry.positionOffset + (uint64_t) entry.vertexCount * sizeof(PositionVertex) > _file.size ||
+                entry.attributeOffset + (uint64_t) entry.vertexCount * sizeof(AttributeVertex) > _file.size ||
+                entry.node >= _header->nodeCount ||
+                entry.indexOffset + (uint64_t) entry.indexCount * sizeof(unsigned int) > _file.size ||
+                entry.baseColorString >= _header->stringTableSize || entry.normalString >= _header->stringTableSize ||
+                entry.roughnessString >= _header->stringTableSize || entry.nameString >= _header->stringTableSize) {
+                std::cout << "Mesh cache " << cachePath << " is corrupt, rebuilding" << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        // a different file may have been copied over the same path
+        if (_header->sourcePathString >= _header->stringTableSize ||
+            canonicalPath != get_string(_header->sourcePathString)) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MeshCache::close() {
+        _file.close();
+        _header = nullptr;
+        _entries = nullptr;
+        _nodes = nullptr;
+    }
+
+    uint32_t MeshCache::mesh_count() const {
+        return _header ? _header->meshCount : 0;
+    }
+
+    CachedMesh MeshCache::get_mesh(uint32_t index) const {
+        const MeshCacheEntry &entry = _entries[index];
+        CachedMesh mesh{};
+        mesh.positions = (const PositionVertex *) (_file.data + entry.positionOffset);
+        mesh.attributes = (const AttributeVertex *) (_file.data + entry.attributeOffset);
+        mesh.vertexCount = entry.vertexCount;
+        mesh.bounds.center = glm::vec3(entry.boundsCenter[0], entry.boundsCenter[1], entry.boundsCenter[2]);
+        mesh.bounds.extent = glm::vec3(entry.boundsExtent[0], entry.boundsExtent[1], entry.boundsExtent[2]);
+        mesh.bounds.radius = entry.boundsRadius;
+        mesh.indices = (const unsigned int *) (_file.data + entry.indexOffset);
+        mesh.indexCount = entry.indexCount;
+        mesh.material.baseColor = get_string(entry.baseColorString);
+        mesh.material.normal = get_string(entry.normalString);
+        mesh.material.roughness = get_string(entry.roughnessString);
+        mesh.material.name = get_string(entry.nameString);
+        mesh.node = entry.node;
+        mesh.acmr = entry.acmr;
+        mesh.lods = entry.lods;
+        mesh.lodCount = entry.lodCount;
+        mesh.meshlets = (const Meshlet *) (_file.data + entry.meshletOffset);
+        mesh.meshletCount = entry.meshletCount;
+        return mesh;
+    }
+
+    uint32_t MeshCache::node_count() const {
+        return _header ? _header->nodeCount : 0;
+    }
+
+    NodeData MeshCache::get_node(uint32_t index) const {
+        NodeData node{};
+        node.parent = _nodes[index].parent;
+        std::memcpy(&node.localTransform[0][0], _nodes[index].localTransform, sizeof(_nodes[index].localTransform));
+        return node;
+    }
+
+    bool MeshCache::write(const std::string &sourcePath, uint32_t importFlags, const std::vector<MeshData> &meshes,
+                          const std::vector<NodeData> &nodes) {
+        MeshCacheHeader header{};
+        std::string canonicalPath;
+        if (!get_source_info(sourcePath, canonicalPath, header.sourceModifiedTime, header.sourceSize)) {
+            return false;
+        }
+
+        // string table, offset 0 is always the empty string
+        std::string stringTable(1, '\0');
+        auto add_string = [&stringTable](const std::string &str) -> uint32_t {
+            if (str.empty()) return 0;
+            auto offset = (uint32_t) stringTable.size();
+            stringTable += str;
+            stringTable += '\0';
+            return offset;
+        };
+
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.positionStride = sizeof(PositionVertex);
+        header.attributeStride = sizeof(AttributeVertex);
+        header.meshCount = (uint32_t) meshes.size();
+        header.sourcePathString = add_string(canonicalPath);
+
+        std::vector<MeshCacheEntry> entries(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            entries[i].vertexCount = (uint32_t) meshes[i].positions.size();
+            entries[i].indexCount = (uint32_t) meshes[i].indices.size();
+            entries[i].baseColorString = add_string(meshes[i].material.baseColor);
+            entries[i].normalString = add_string(meshes[i].material.normal);
+            entries[i].roughnessString = add_string(meshes[i].material.roughness);
+            entries[i].nameString = add_string(meshes[i].material.name);
+            entries[i].node = meshes[i].node;
+            entries[i].acmr = meshes[i].optimization.acmrAfter;
+            entries[i].lodCount = (uint32_t) meshes[i].lods.size();
+            std::copy(meshes[i].lods.begin(), meshes[i].lods.end(), entries[i].lods);
+            entries[i].meshletCount = (uint32_t) meshes[i].meshlets.size();
+            for (int axis = 0; axis < 3; axis++) {
+                entries[i].boundsCenter[axis] = meshes[i].bounds.center[axis];
+                entries[i].boundsExtent[axis] = meshes[i].bounds.extent[axis];
+            }
+            entries[i].boundsRadius = meshes[i].bounds.radius;
+        }
+
+        std::vector<MeshCacheNode> cacheNodes(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            cacheNodes[i].parent = nodes[i].parent;
+            std::memcpy(cacheNodes[i].localTransform, &nodes[i].localTransform[0][0],
+                        sizeof(cacheNodes[i].localTransform));
+        }
+        header.nodeCount = (uint32_t) cacheNodes.size();
+
+        // header, mesh table, node table and strings first, then 16-byte aligned position, attribute, index and
+        // meshlet blobs
+        auto align = [](uint64_t offset) { return (offset + 15) & ~(uint64_t) 15; };
+        header.meshTableOffset = sizeof(MeshCacheHeader);
+        header.nodeTableOffset = header.meshTableOffset + entries.size() * sizeof(MeshCacheEntry);
+        header.stringTableOffset = header.nodeTableOffset + cacheNodes.size() * sizeof(MeshCacheNode);
+        header.stringTableSize = stringTable.size();
+        uint64_t offset = align(header.stringTableOffset + header.stringTableSize);
+        for (size_t i = 0; i < meshes.size(); i++) {
+            entries[i].positionOffset = offset;
+            offset = align(offset + meshes[i].positions.size() * sizeof(PositionVertex));
+            entries[i].attributeOffset = offset;
+            offset = align(offset + meshes[i].attributes.size() * sizeof(AttributeVertex));
+            entries[i].indexOffset = offset;
+            offset = align(offset + meshes[i].indices.size() * sizeof(unsigned int));
+            entries[i].meshletOffset = offset;
+            offset = align(offset + meshes[i].meshlets.size() * sizeof(Meshlet));
+        }
+
+        // write to a temporary file and swap it in so a crash never leaves a half-written cache
+        std::string cachePath = cache_path(sourcePath);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "Failed to write mesh cache " << cachePath << std::endl;
+            return false;
+        }
+
+        const char padding[16] = {};
+        auto pad_to = [&file, &padding](uint64_t target) {
+            auto position = (uint64_t) file.tellp();
+            if (target > position) file.write(padding, (std::streamsize) (target - position));
+        };
+
+        file.write((const char *) &header, sizeof(header));
+        file.write((const char *) entries.data(), (std::streamsize) (entries.size() * sizeof(MeshCacheEntry)));
+        file.write((const char *) cacheNodes.data(), (std::streamsize) (cacheNodes.size() * sizeof(MeshCacheNode)));
+        file.write(stringTable.data(), (std::streamsize) stringTable.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            pad_to(entries[i].positionOffset);
+            file.write((const char *) meshes[i].positions.data(),
+                       (std::streamsize) (meshes[i].positions.size() * sizeof(PositionVertex)));
+            pad_to(entries[i].attributeOffset);
+            file.write((const char *) meshes[i].attributes.data(),
+                       (std::streamsize) (meshes[i].attributes.size() * sizeof(AttributeVertex)));
+            pad_to(entries[i].indexOffset);
+            file.write((const char *) meshes[i].indices.data(),
+                       (std::streamsize) (meshes[i].indices.size() * sizeof(unsigned int)));
+            pad_to(entries[i].meshletOffset);
+            file.write((const char *) meshes[i].meshlets.data(),
+                       (std::streamsize) (meshes[i].meshlets.size() * sizeof(Meshlet)));
+        }
+        file.close();
+        if (!file) {
+            std::cout << "Failed to write mesh cache " << cachePath << std::endl;
+            std::filesystem::remove(tempPath);
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        if (error) {
+            std::cout << "Failed to write mesh cache " << cachePath << ": " << error.message() << std::endl;
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+
+        std::cout << "Wrote mesh cache " << cachePath << std::endl;
+        return true;
+    }
+
+    std::string MeshCache::cache_path(const std::string &sourcePath) {
+        return sourcePath + ".meshcache";
+    }
+
+    const char *MeshCache::get_string(uint32_t offset) const {
+        return (const char *) (_file.data + _header->stringTableOffset + offset);
+    }
+
+    bool MeshCache::get_source_info(const std::string &sourcePath, std::string &canonicalPath,
+                                    int64_t &modifiedTime, uint64_t &size) {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(sourcePath, error);
+        if (error) return false;
+        auto writeTime = std::filesystem::last_write_time(canonical, error);
+        if (error) return false;
+        size = (uint64_t) std::filesystem::file_size(canonical, error);
+        if (error) return false;
+
+        canonicalPath = canonical.string();
+        modifiedTime = (int64_t) writeTime.time_since_epoch().count();
+        return true;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gl/mesh.h>
+
+namespace GLRenderer {
+    constexpr uint32_t MESH_CACHE_MAGIC = 0x4843534d; // "MSCH"
+    constexpr uint32_t MESH_CACHE_VERSION = 6;
+
+    // on-disk layout, all offsets are from the start of the file
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t importFlags;
+        uint32_t positionStride;
+        int64_t sourceModifiedTime;
+        uint64_t sourceSize;
+        uint32_t meshCount;
+        uint32_t sourcePathString;
+        uint64_t meshTableOffset;
+        uint64_t stringTableOffset;
+        uint64_t stringTableSize;
+        uint64_t nodeTableOffset;
+        uint32_t nodeCount;
+        uint32_t attributeStride;
+    };
+
+    struct MeshCacheNode {
+        int32_t parent;
+        uint32_t padding;
+        // column-major, same as glm
+        float localTransform[16];
+    };
+
+    // vertices are stored as the packed GPU streams, so a warm load uploads them as they are
+    struct MeshCacheEntry {
+        uint64_t positionOffset;
+        uint64_t attributeOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        // offsets into the string table
+        uint32_t baseColorString;
+        uint32_t normalString;
+        uint32_t roughnessString;
+        uint32_t nameString;
+        uint32_t node;
+        // of the optimized index order, stored so cached loads can still report it
+        float acmr;
+        uint32_t lodCount;
+        uint32_t padding;
+        // ranges of the index blob
+        MeshLod lods[MAX_LOD_COUNT];
+        uint64_t meshletOffset;
+        uint32_t meshletCount;
+        // box the positions are quantized in, and the bounding sphere radius
+        float boundsCenter[3];
+        float boundsExtent[3];
+        float boundsRadius;
+    };
+
+    // view into a mapped cache file, only valid while the cache is open
+    struct CachedMesh {
+        const PositionVertex *positions;
+        const AttributeVertex *attributes;
+        uint32_t vertexCount;
+        MeshBounds bounds;
+        const unsigned int *indices;
+        uint32_t indexCount;
+        MaterialRef material;
+        uint32_t node;
+        float acmr;
+        const MeshLod *lods;
+        uint32_t lodCount;
+        const Meshlet *meshlets;
+        uint32_t meshletCount;
+    };
+
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        // owns the descriptor and the mapping, a copy would release them twice
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        bool open(const std::string &filePath);
+
+        void close();
+
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+
+    private:
+#ifdef _WIN32
+        void *_file = nullptr;
+        void *_mapping = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+
+    class MeshCache {
+    public:
+        // maps the cache for a source file, fails if it is missing or stale
+        bool open(const std::string &sourcePath, uint32_t importFlags);
+
+        void close();
+
+        uint32_t mesh_count() const;
+
+        CachedMesh get_mesh(uint32_t index) const;
+
+        uint32_t node_count() const;
+
+        NodeData get_node(uint32_t index) const;
+
+        static bool write(const std::string &sourcePath, uint32_t importFlags, const std::vector<MeshData> &meshes,
+                          const std::vector<NodeData> &nodes);
+
+        static std::string cache_path(const std::string &sourcePath);
+
+    private:
+        MappedFile _file;
+        const MeshCacheHeader *_header = nullptr;
+        const MeshCacheEntry *_entries = nullptr;
+        const MeshCacheNode *_nodes = nullptr;
+
+        const char *get_string(uint32_t offset) const;
+
+        static bool get_source_info(const std::string &sourcePath, std::string &canonicalPath,
+                                    int64_t &modifiedTime, uint64_t &size);
+    };
+}
@@ -0,0 +1,309 @@
+#include "mesh_optimizer.h"
+
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <gl/geometry_pool.h>
+#include <gl/mesh_simplifier.h>
+
+namespace GLRenderer {
+    static uint64_t hash_vertex(const Vertex &vertex) {
+        // FNV-1a over the raw bytes, Vertex has no padding
+        const auto *bytes = reinterpret_cast<const unsigned char *>(&vertex);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    size_t weld_vertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+        std::unordered_multimap<uint64_t, unsigned int> unique;
+        unique.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<Vertex> welded;
+        welded.reserve(vertices.size());
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+            uint64_t hash = hash_vertex(vertices[i]);
+            auto range = unique.equal_range(hash);
+            auto match = std::find_if(range.first, range.second, [&](const auto &entry) {
+                return std::memcmp(&welded[entry.second], &vertices[i], sizeof(Vertex)) == 0;
+            });
+            if (match != range.second) {
+                remap[i] = match->second;
+                continue;
+            }
+            remap[i] = (unsigned int) welded.size();
+            unique.emplace(hash, remap[i]);
+            welded.push_back(vertices[i]);
+        }
+
+        for (auto &index: indices) {
+            index = remap[index];
+        }
+        vertices.swap(welded);
+        return vertices.size();
+    }
+
+    void optimize_vertex_cache(std::vector<unsigned int> &indices, size_t vertexCount) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // triangles using each vertex
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (unsigned int index: indices) {
+            adjacencyOffsets[index + 1]++;
+        }
+        for (size_t i = 0; i < vertexCount; i++) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = (uint32_t) (i / 3);
+        }
+
+        std::vector<uint32_t> liveTriangles(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+        }
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+
+        const uint32_t cacheSize = VERTEX_CACHE_SIZE;
+        uint32_t time = cacheSize + 1;
+        size_t cursor = 0;
+        int64_t fanVertex = 0;
+
+        while (fanVertex >= 0) {
+            // emit every remaining triangle around the fanning vertex
+            candidates.clear();
+            auto vertex = (unsigned int) fanVertex;
+            for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; i++) {
+                uint32_t triangle = adjacency[i];
+                if (emitted[triangle]) {
+                    continue;
+                }
+                emitted[triangle] = true;
+                for (size_t corner = 0; corner < 3; corner++) {
+                    unsigned int v = indices[triangle * 3 + corner];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = time++;
+                    }
+                }
+            }
+
+            // next fan from the oldest cached vertex whose triangles still fit in the cache
+            fanVertex = -1;
+            int64_t bestPriority = -1;
+            for (unsigned int v: candidates) {
+                if (liveTriangles[v] == 0) {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                    priority = time - cacheTime[v];
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    fanVertex = v;
+                }
+            }
+
+            // dead end, fall back to recently used vertices and then to input order
+            while (fanVertex < 0 && !deadEnd.empty()) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0) {
+                    fanVertex = v;
+                }
+            }
+            while (fanVertex < 0 && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0) {
+                    fanVertex = (int64_t) cursor;
+                }
+                cursor++;
+            }
+        }
+
+        indices.swap(output);
+    }
+
+    void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // clusters start where every vertex of a triangle misses the cache, reordering those keeps the ACMR
+        std::vector<size_t> clusterStarts = {0};
+        std::vector<uint32_t> cacheTime(vertices.size(), 0);
+        uint32_t time = VERTEX_CACHE_SIZE + 1;
+        for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+            int misses = 0;
+            for (size_t corner = 0; corner < 3; corner++) {
+                unsigned int v = indices[triangle * 3 + corner];
+                if (time - cacheTime[v] > VERTEX_CACHE_SIZE) {
+                    cacheTime[v] = time++;
+                    misses++;
+                }
+            }
+            if (misses == 3 && triangle > 0) {
+                clusterStarts.push_back(triangle);
+            }
+        }
+        clusterStarts.push_back(triangleCount);
+
+        // area weighted centroid and normal per cluster
+        struct Cluster {
+            size_t first;
+            size_t count;
+            glm::vec3 centroid;
+            glm::vec3 normal;
+            float sortKey;
+        };
+        std::vector<Cluster> clusters;
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+            Cluster cluster{clusterStarts[c], clusterStarts[c + 1] - clusterStarts[c], glm::vec3(0.0f),
+                            glm::vec3(0.0f), 0.0f};
+            float clusterArea = 0.0f;
+            for (size_t triangle = cluster.first; triangle < cluster.first + cluster.count; triangle++) {
+                const glm::vec3 &p0 = vertices[indices[triangle * 3]].position;
+                const glm::vec3 &p1 = vertices[indices[triangle * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[triangle * 3 + 2]].position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                cluster.normal += normal;
+                cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+                clusterArea += area;
+            }
+            meshCentroid += cluster.centroid;
+            meshArea += clusterArea;
+            cluster.centroid = clusterArea > 0.0f ? cluster.centroid / clusterArea : glm::vec3(0.0f);
+            float normalLength = glm::length(cluster.normal);
+            cluster.normal = normalLength > 0.0f ? cluster.normal / normalLength : glm::vec3(0.0f);
+            clusters.push_back(cluster);
+        }
+        meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+        // clusters facing away from the center are likely in front, draw them first
+        for (auto &cluster: clusters) {
+            cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal);
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+        for (auto &cluster: clusters) {
+            output.insert(output.end(), indices.begin() + (ptrdiff_t) (cluster.first * 3),
+                          indices.begin() + (ptrdiff_t) ((cluster.first + cluster.count) * 3));
+        }
+        indices.swap(output);
+    }
+
+    void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+        std::vector<unsigned int> remap(vertices.size(), UINT32_MAX);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (auto &index: indices) {
+            if (remap[index] == UINT32_MAX) {
+                remap[index] = (unsigned int) ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+    float compute_acmr(const unsigned int *indices, size_t indexCount, size_t vertexCount) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return 0.0f;
+        }
+        // FIFO cache, a vertex is resident while fewer than cache size misses happened since it was loaded
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        uint32_t time = VERTEX_CACHE_SIZE + 1;
+        size_t misses = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            if (time - cacheTime[indices[i]] > VERTEX_CACHE_SIZE) {
+                cacheTime[indices[i]] = time++;
+                misses++;
+            }
+        }
+        return (float) misses / (float) triangleCount;
+    }
+
+    static size_t gpu_bytes(size_t vertexCount, size_t indexCount) {
+        size_t indexSize = vertexCount <= SHORT_INDEX_VERTEX_LIMIT ? sizeof(uint16_t) : sizeof(uint32_t);
+        return vertexCount * (sizeof(PositionVertex) + sizeof(AttributeVertex)) + indexCount * indexSize;
+    }
+
+    MeshOptimizationStats optimize_mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                                        std::vector<MeshLod> &lods) {
+        MeshOptimizationStats stats;
+        stats.vertexCountBefore = (uint32_t) vertices.size();
+        stats.acmrBefore = compute_acmr(indices.data(), indices.size(), vertices.size());
+        // unoptimized meshes were always uploaded with 32-bit indices
+        stats.bytesBefore = vertices.size() * (sizeof(PositionVertex) + sizeof(AttributeVertex)) +
+                            indices.size() * sizeof(uint32_t);
+
+        weld_vertices(vertices, indices);
+
+        // each level aims for half the triangles of the previous one, the chain ends when that stops working
+        std::vector<std::vector<unsigned int>> levels = {indices};
+        std::vector<float> levelErrors = {0.0f};
+        if (!vertices.empty()) {
+            glm::vec3 boundsMin = vertices[0].position;
+            glm::vec3 boundsMax = vertices[0].position;
+            for (auto &vertex: vertices) {
+                boundsMin = glm::min(boundsMin, vertex.position);
+                boundsMax = glm::max(boundsMax, vertex.position);
+            }
+            glm::vec3 size = boundsMax - boundsMin;
+            float maxError = LOD_MAX_RELATIVE_ERROR * std::max(size.x, std::max(size.y, size.z));
+            while (levels.size() < MAX_LOD_COUNT) {
+                const std::vector<unsigned int> &previous = levels.back();
+                float error = 0.0f;
+                std::vector<unsigned int> simplified = simplify_mesh(vertices, previous, previous.size() / 6 * 3,
+                                                                     maxError, error);
+                if (simplified.empty() || simplified.size() > previous.size() * 3 / 4) {
+                    break;
+                }
+                // errors are measured against the previous level, their sum bounds the error to the full mesh
+                levelErrors.push_back(levelErrors.back() + error);
+                levels.push_back(std::move(simplified));
+            }
+        }
+
+        indices.clear();
+        lods.clear();
+        for (size_t level = 0; level < levels.size(); level++) {
+            optimize_vertex_cache(levels[level], vertices.size());
+            optimize_overdraw(levels[level], vertices);
+            lods.push_back({(uint32_t) indices.size(), (uint32_t) levels[level].size(), levelErrors[level]});
+            indices.insert(indices.end(), levels[level].begin(), levels[level].end());
+        }
+        // the full level comes first, so fetch order follows it
+        optimize_vertex_fetch(vertices, indices);
+
+        stats.vertexCountAfter = (uint32_t) vertices.size();
+        stats.acmrAfter = compute_acmr(indices.data(), lods[0].indexCount, vertices.size());
+        stats.bytesAfter = gpu_bytes(vertices.size(), indices.size());
+        return stats;
+    }
+}
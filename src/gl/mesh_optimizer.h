@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <gl/vertex.h>
+
+namespace GLRenderer {
+    // FIFO size assumed for the post-transform cache, both when ordering and when measuring
+    constexpr unsigned int VERTEX_CACHE_SIZE = 16;
+
+    // detail levels per mesh including the full one
+    constexpr uint32_t MAX_LOD_COUNT = 4;
+    // simplification stops before the error exceeds this fraction of the mesh size
+    constexpr float LOD_MAX_RELATIVE_ERROR = 0.05f;
+
+    // one detail level, a range of the mesh's index list; all levels share the vertices
+    struct MeshLod {
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        // geometric error against the full mesh, in mesh units
+        float error = 0.0f;
+    };
+
+    struct MeshOptimizationStats {
+        uint32_t vertexCountBefore = 0;
+        uint32_t vertexCountAfter = 0;
+        // average cache miss ratio, transformed vertices per triangle
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+        // packed vertex and index bytes as uploaded to the geometry pool
+        size_t bytesBefore = 0;
+        size_t bytesAfter = 0;
+    };
+
+    // merges bitwise identical vertices and remaps the indices, returns the new vertex count
+    size_t weld_vertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+    // reorders triangles for the post-transform cache (Tipsify, Sander et al. 2007)
+    void optimize_vertex_cache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+    // sorts the cache-cold clusters of a cache optimized index list so outward facing ones come first,
+    // which keeps the cache order inside each cluster and cuts overdraw from any direction
+    void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices);
+
+    // renumbers vertices in first use order and drops unreferenced ones
+    void optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+    float compute_acmr(const unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+    // runs the whole pipeline on an imported mesh, indices end up holding every level back to back
+    MeshOptimizationStats optimize_mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                                        std::vector<MeshLod> &lods);
+}
@@ -0,0 +1,279 @@
+#include "mesh_simplifier.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+namespace GLRenderer {
+    // symmetric 4x4 plane quadric, upper triangle only, plus the total plane weight
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        void add_plane(double a, double b, double c, double d, double weight) {
+            a00 += weight * a * a;
+            a01 += weight * a * b;
+            a02 += weight * a * c;
+            a03 += weight * a * d;
+            a11 += weight * b * b;
+            a12 += weight * b * c;
+            a13 += weight * b * d;
+            a22 += weight * c * c;
+            a23 += weight * c * d;
+            a33 += weight * d * d;
+            this->weight += weight;
+        }
+
+        void add(const Quadric &other) {
+            a00 += other.a00;
+            a01 += other.a01;
+            a02 += other.a02;
+            a03 += other.a03;
+            a11 += other.a11;
+            a12 += other.a12;
+            a13 += other.a13;
+            a22 += other.a22;
+            a23 += other.a23;
+            a33 += other.a33;
+            weight += other.weight;
+        }
+
+        // weighted mean squared distance of p to the accumulated planes
+        double error(const glm::vec3 &p) const {
+            if (weight <= 0) {
+                return 0.0;
+            }
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                            a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                            a22 * z * z + 2 * a23 * z + a33;
+            return std::max(result / weight, 0.0);
+        }
+    };
+
+    struct Collapse {
+        unsigned int source;
+        unsigned int target;
+        double cost;
+    };
+
+    static uint64_t edge_key(unsigned int a, unsigned int b) {
+        return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+    }
+
+    std::vector<unsigned int> simplify_mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                            size_t targetIndexCount, float maxError, float &resultError) {
+        resultError = 0.0f;
+        std::vector<unsigned int> result = indices;
+        size_t vertexCount = vertices.size();
+        if (vertexCount == 0 || result.size() <= targetIndexCount) {
+            return result;
+        }
+
+        // work in a unit box so the quadrics stay well conditioned
+        glm::vec3 boundsMin = vertices[0].position;
+        glm::vec3 boundsMax = vertices[0].position;
+        for (auto &vertex: vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+        glm::vec3 size = boundsMax - boundsMin;
+        float scale = std::max(size.x, std::max(size.y, size.z));
+        if (scale <= 0.0f) {
+            return result;
+        }
+        std::vector<glm::vec3> positions(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            positions[i] = (vertices[i].position - boundsMin) / scale;
+        }
+        double maxCost = (double) (maxError / scale) * (double) (maxError / scale);
+
+        // vertices sharing a position are wedges of one corner, edges are counted between corners
+        std::vector<unsigned int> corner(vertexCount);
+        std::vector<uint32_t> wedgeCount(vertexCount, 0);
+        std::unordered_map<uint64_t, unsigned int> firstAtPosition;
+        firstAtPosition.reserve(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            uint32_t bits[3];
+            std::memcpy(bits, &vertices[i].position, sizeof(bits));
+            uint64_t hash = ((uint64_t) bits[0] * 73856093u) ^ ((uint64_t) bits[1] * 19349663u) ^
+                            ((uint64_t) bits[2] * 83492791u) ^ ((uint64_t) bits[2] << 32);
+            auto it = firstAtPosition.find(hash);
+            if (it != firstAtPosition.end() && vertices[it->second].position == vertices[i].position) {
+                corner[i] = it->second;
+            } else {
+                corner[i] = (unsigned int) i;
+                firstAtPosition[hash] = (unsigned int) i;
+            }
+            wedgeCount[corner[i]]++;
+        }
+
+        std::unordered_map<uint64_t, uint32_t> edgeUse;
+        edgeUse.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t e = 0; e < 3; e++) {
+                edgeUse[edge_key(corner[result[i + e]], corner[result[i + (e + 1) % 3]])]++;
+            }
+        }
+        std::vector<bool> locked(vertexCount, false);
+        for (size_t i = 0; i < vertexCount; i++) {
+            locked[i] = wedgeCount[corner[i]] > 1;
+        }
+        for (auto &edge: edgeUse) {
+            if (edge.second == 1) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xffffffffu] = true;
+            }
+        }
+        for (size_t i = 0; i < vertexCount; i++) {
+            if (locked[corner[i]]) {
+                locked[i] = true;
+            }
+        }
+
+        // area weighted face planes, accumulated per corner
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const glm::vec3 &p0 = positions[result[i]];
+            glm::vec3 normal = glm::cross(positions[result[i + 1]] - p0, positions[result[i + 2]] - p0);
+            float length = glm::length(normal);
+            if (length <= 0.0f) {
+                continue;
+            }
+            normal /= length;
+            double d = -(double) glm::dot(normal, p0);
+            for (size_t c = 0; c < 3; c++) {
+                quadrics[corner[result[i + c]]].add_plane(normal.x, normal.y, normal.z, d, length * 0.5);
+            }
+        }
+
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+        std::vector<uint32_t> fill;
+        std::vector<bool> touched(vertexCount);
+        std::vector<Collapse> collapses;
+
+        // each pass collapses the cheapest independent edges, then drops the degenerate triangles
+        while (result.size() > targetIndexCount) {
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (unsigned int index: result) {
+                adjacencyOffsets[index + 1]++;
+            }
+            for (size_t i = 0; i < vertexCount; i++) {
+                adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+            }
+            adjacency.resize(result.size());
+            fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacency[fill[result[i]]++] = (uint32_t) (i / 3);
+            }
+
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (size_t e = 0; e < 3; e++) {
+                    unsigned int a = result[i + e];
+                    unsigned int b = result[i + (e + 1) % 3];
+                    // each interior edge shows up twice, once in each direction
+                    if (a > b) {
+                        continue;
+                    }
+                    Quadric q = quadrics[corner[a]];
+                    q.add(quadrics[corner[b]]);
+                    double costToB = locked[a] ? INFINITY : q.error(positions[b]);
+                    double costToA = locked[b] ? INFINITY : q.error(positions[a]);
+                    if (costToB <= costToA && costToB <= maxCost) {
+                        collapses.push_back({a, b, costToB});
+                    } else if (costToA < costToB && costToA <= maxCost) {
+                        collapses.push_back({b, a, costToA});
+                    }
+                }
+            }
+            if (collapses.empty()) {
+                break;
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+                return x.cost < y.cost;
+            });
+
+            // every collapse removes about two triangles, stop once the target would be reached
+            size_t collapseBudget = (result.size() - targetIndexCount) / 6 + 1;
+            size_t collapsed = 0;
+            std::fill(touched.begin(), touched.end(), false);
+            for (auto &collapse: collapses) {
+                if (collapsed >= collapseBudget) {
+                    break;
+                }
+                if (touched[collapse.source] || touched[collapse.target]) {
+                    continue;
+                }
+
+                // reject collapses that flip a surviving triangle around the source
+                bool flips = false;
+                const glm::vec3 &newPosition = positions[collapse.target];
+                for (uint32_t a = adjacencyOffsets[collapse.source]; a < adjacencyOffsets[collapse.source + 1]; a++) {
+                    const unsigned int *triangle = &result[adjacency[a] * 3];
+                    if (triangle[0] == collapse.target || triangle[1] == collapse.target ||
+                        triangle[2] == collapse.target) {
+                        continue;
+                    }
+                    glm::vec3 p[3];
+                    for (size_t c = 0; c < 3; c++) {
+                        p[c] = positions[triangle[c]];
+                    }
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    for (size_t c = 0; c < 3; c++) {
+                        if (triangle[c] == collapse.source) {
+                            p[c] = newPosition;
+                        }
+                    }
+                    glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    // also reject large rotations, they tend to fold over in the next pass
+                    if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+                        flips = true;
+                        break;
+                    }
+                }
+                if (flips) {
+                    continue;
+                }
+
+                // the neighborhood changes, leave it alone for the rest of the pass
+                for (uint32_t a = adjacencyOffsets[collapse.source]; a < adjacencyOffsets[collapse.source + 1]; a++) {
+                    unsigned int *triangle = &result[adjacency[a] * 3];
+                    for (size_t c = 0; c < 3; c++) {
+                        touched[triangle[c]] = true;
+                        if (triangle[c] == collapse.source) {
+                            triangle[c] = collapse.target;
+                        }
+                    }
+                }
+                touched[collapse.source] = true;
+                touched[collapse.target] = true;
+                quadrics[corner[collapse.target]].add(quadrics[corner[collapse.source]]);
+                resultError = std::max(resultError, (float) std::sqrt(collapse.cost) * scale);
+                collapsed++;
+            }
+
+            size_t writeIndex = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                unsigned int a = result[i], b = result[i + 1], c = result[i + 2];
+                if (a == b || b == c || a == c) {
+                    continue;
+                }
+                result[writeIndex++] = a;
+                result[writeIndex++] = b;
+                result[writeIndex++] = c;
+            }
+            result.resize(writeIndex);
+            if (collapsed == 0) {
+                break;
+            }
+        }
+        return result;
+    }
+}
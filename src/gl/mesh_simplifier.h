@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <gl/vertex.h>
+
+namespace GLRenderer {
+    // quadric error edge collapse (Garland and Heckbert 1997) onto existing vertices, so the result indexes
+    // the same vertex buffer; stops at targetIndexCount or before a collapse would exceed maxError.
+    // seam and border vertices are locked to keep UVs, hard edges and silhouettes of open meshes intact.
+    // errors are distances in mesh units, resultError is the largest one accepted
+    std::vector<unsigned int> simplify_mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                            size_t targetIndexCount, float maxError, float &resultError);
+}
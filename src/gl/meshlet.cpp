@@ -0,0 +1,81 @@
+#include "meshlet.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace GLRenderer {
+    // cosine of the largest angle between a triangle and the running average before a meshlet past the
+    // minimum size is split
+    constexpr float MESHLET_SPLIT_COS = 0.7f;
+    // cones wider than this are not worth testing
+    constexpr float MESHLET_MIN_CONE_DOT = 0.1f;
+
+    static void finish_meshlet(const std::vector<Vertex> &vertices, const unsigned int *indices, Meshlet &meshlet) {
+        const unsigned int *triangles = indices + meshlet.indexOffset;
+
+        // sphere around the box center
+        glm::vec3 boundsMin = vertices[triangles[0]].position;
+        glm::vec3 boundsMax = boundsMin;
+        for (uint32_t i = 1; i < meshlet.indexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertices[triangles[i]].position);
+            boundsMax = glm::max(boundsMax, vertices[triangles[i]].position);
+        }
+        meshlet.center = (boundsMin + boundsMax) * 0.5f;
+        float radiusSq = 0.0f;
+        for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+            glm::vec3 offset = vertices[triangles[i]].position - meshlet.center;
+            radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+        }
+        meshlet.radius = std::sqrt(radiusSq);
+
+        // cone around the average face normal, as wide as the furthest one
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (uint32_t i = 0; i < meshlet.indexCount; i += 3) {
+            const glm::vec3 &p0 = vertices[triangles[i]].position;
+            glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].position - p0, vertices[triangles[i + 2]].position - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            }
+        }
+        float axisLength = glm::length(axis);
+        meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (auto &normal: normals) {
+            minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+        }
+        meshlet.coneCutoff = minDot < MESHLET_MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+
+    void build_meshlets(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount,
+                        std::vector<Meshlet> &meshlets) {
+        meshlets.clear();
+        Meshlet current{};
+        glm::vec3 normalSum(0.0f);
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            const glm::vec3 &p0 = vertices[indices[i]].position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - p0, vertices[indices[i + 2]].position - p0);
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+            uint32_t triangleCount = current.indexCount / 3;
+            float sumLength = glm::length(normalSum);
+            bool diverges = sumLength > 0.0f && glm::dot(normal, normalSum / sumLength) < MESHLET_SPLIT_COS;
+            if (triangleCount >= MESHLET_MAX_TRIANGLES || (triangleCount >= MESHLET_MIN_TRIANGLES && diverges)) {
+                finish_meshlet(vertices, indices, current);
+                meshlets.push_back(current);
+                current = {};
+                current.indexOffset = (uint32_t) i;
+                normalSum = glm::vec3(0.0f);
+            }
+            current.indexCount += 3;
+            normalSum += normal;
+        }
+        if (current.indexCount > 0) {
+            finish_meshlet(vertices, indices, current);
+            meshlets.push_back(current);
+        }
+    }
+}
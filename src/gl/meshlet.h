@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include <gl/vertex.h>
+
+namespace GLRenderer {
+    constexpr uint32_t MESHLET_MAX_TRIANGLES = 128;
+    // past this size a meshlet is closed as soon as a triangle would widen its normal cone too much
+    constexpr uint32_t MESHLET_MIN_TRIANGLES = 64;
+
+    // a contiguous run of the full detail index range, in mesh space
+    struct Meshlet {
+        glm::vec3 center;
+        float radius;
+        glm::vec3 coneAxis;
+        // sine of the cone's half angle, 1 if the triangles face too many ways to ever be culled
+        float coneCutoff;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+    };
+
+    // splits indices in their existing order, which the cache optimization already made spatially coherent
+    void build_meshlets(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount,
+                        std::vector<Meshlet> &meshlets);
+
+    // every triangle faces away from a viewer at position, all inputs in the same space
+    inline bool meshlet_backfacing(const glm::vec3 &center, float radius, const glm::vec3 &coneAxis, float coneCutoff,
+                                   const glm::vec3 &position) {
+        glm::vec3 offset = center - position;
+        return glm::dot(offset, coneAxis) >= coneCutoff * glm::length(offset) + radius;
+    }
+}
@@ -1,35 +1,137 @@
 #include "model.h"
 
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <glm/gtx/transform.hpp>
+#include <gl/mesh_cache.h>
+#include <gl/occlusion_culler.h>
+#include <thread_pool.h>
+#include <profiler.h>
 
 namespace GLRenderer {
-    void Model::init(const std::string &filePath, Shader *shader) {
-        _textureManager = new TextureManager("../assets/devtex/dev_black.png");
-        _modelShader = shader;
+    // part of the mesh cache key, changing these invalidates existing caches
+    constexpr unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    void Model::init(const std::string &filePath, Shader *shader, TextureManager *textureManager,
+                     GeometryPool *geometryPool, ThreadPool *pool) {
+        PROFILE_ZONE("Model::init");
+        _textureManager = textureManager;
+        _geometryPool = geometryPool;
+        set_shader(shader);
+        _directory = filePath.substr(0, filePath.find_last_of('/'));
+
+        auto importTimerStart = std::chrono::high_resolution_clock::now();
+
+        // use the cached meshes if they are still up to date, Assimp is never touched in that case
+        MeshCache cache;
+        if (cache.open(filePath, IMPORT_FLAGS)) {
+            std::vector<NodeData> nodes;
+            for (uint32_t i = 0; i < cache.node_count(); i++) {
+                nodes.push_back(cache.get_node(i));
+            }
+            init_scene_graph(nodes);
+
+            std::vector<CachedMesh> cachedMeshes;
+            std::vector<const MaterialRef *> materials;
+            for (uint32_t i = 0; i < cache.mesh_count(); i++) {
+                cachedMeshes.push_back(cache.get_mesh(i));
+            }
+            for (auto &cachedMesh: cachedMeshes) {
+                materials.push_back(&cachedMesh.material);
+            }
+            preload_textures(materials, pool);
+
+            for (auto &cachedMesh: cachedMeshes) {
+                meshes.push_back(create_mesh(cachedMesh.positions, cachedMesh.attributes, cachedMesh.vertexCount,
+                                             cachedMesh.indices, cachedMesh.indexCount, cachedMesh.bounds,
+                                             cachedMesh.lods, cachedMesh.lodCount, cachedMesh.material,
+                                             cachedMesh.node));
+                meshes.back().acmr = cachedMesh.acmr;
+                meshes.back().meshlets.assign(cachedMesh.meshlets, cachedMesh.meshlets + cachedMesh.meshletCount);
+            }
+            select_occluders();
+
+            std::chrono::duration<double, std::milli> importDuration =
+                    std::chrono::high_resolution_clock::now() - importTimerStart;
+            std::cout << "Loaded " << filePath << " from mesh cache in " << importDuration.count() << " ms"
+                      << std::endl;
+            return;
+        }
 
         Assimp::Importer importer;
-        const aiScene *modelScene = importer.ReadFile(filePath,
-                                                      aiProcess_Triangulate |
-                                                      aiProcess_FlipUVs |
-                                                      aiProcess_CalcTangentSpace);
+        const aiScene *modelScene = importer.ReadFile(filePath, IMPORT_FLAGS);
 
         if (!modelScene || modelScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !modelScene->mRootNode) {
             std::cout << "Assimp error: " << importer.GetErrorString() << std::endl;
             return;
         }
 
-        _directory = filePath.substr(0, filePath.find_last_of('/'));
-        process_node(modelScene->mRootNode, modelScene);
+        // convert and optimize meshes on the pool, keeping the serial node traversal order
+        std::vector<aiMesh *> sceneMeshes;
+        std::vector<uint32_t> meshNodes;
+        std::vector<NodeData> nodes;
+        process_node(modelScene->mRootNode, modelScene, -1, sceneMeshes, meshNodes, nodes);
+        init_scene_graph(nodes);
+        std::vector<MeshData> meshData(sceneMeshes.size());
+        pool->parallel_for(sceneMeshes.size(), [this, &sceneMeshes, &meshNodes, &meshData, modelScene](size_t i) {
+            meshData[i] = process_mesh(sceneMeshes[i], modelScene);
+            meshData[i].node = meshNodes[i];
+            PROFILE_ZONE("optimize_mesh");
+            meshData[i].optimization = optimize_mesh(meshData[i].vertices, meshData[i].indices, meshData[i].lods);
+            build_meshlets(meshData[i].vertices, meshData[i].indices.data(), meshData[i].lods[0].indexCount,
+                           meshData[i].meshlets);
+            encode_mesh(meshData[i]);
+        });
+
+        size_t bytesBefore = 0;
+        size_t bytesAfter = 0;
+        for (auto &data: meshData) {
+            bytesBefore += data.optimization.bytesBefore;
+            bytesAfter += data.optimization.bytesAfter;
+        }
+        std::cout << "Mesh optimization saved " << (bytesBefore - bytesAfter) / 1024 << " KB of "
+                  << bytesBefore / 1024 << " KB" << std::endl;
+
+        std::vector<const MaterialRef *> materials;
+        for (auto &data: meshData) {
+            materials.push_back(&data.material);
+        }
+        preload_textures(materials, pool);
+
+        // GL objects can only be created on the context thread
+        for (auto &data: meshData) {
+            meshes.push_back(create_mesh(data.positions.data(), data.attributes.data(), data.positions.size(),
+                                         data.indices.data(), data.indices.size(), data.bounds, data.lods.data(),
+                                         data.lods.size(), data.material, data.node));
+            meshes.back().acmr = data.optimization.acmrAfter;
+            meshes.back().meshlets = data.meshlets;
+        }
+        select_occluders();
+
+        std::chrono::duration<double, std::milli> importDuration =
+                std::chrono::high_resolution_clock::now() - importTimerStart;
+        std::cout << "Imported " << filePath << " with Assimp in " << importDuration.count() << " ms" << std::endl;
+
+        MeshCache::write(filePath, IMPORT_FLAGS, meshData, nodes);
     }
 
     void Model::set_shader(Shader *shader) {
         _modelShader = shader;
     }
 
-    void Model::update_transform() {
+    bool Model::update_transform() {
+        // nothing was imported
+        if (_sceneGraph.node_count() == 0) {
+            return false;
+        }
+        if (!_transformDirty) {
+            return _sceneGraph.update() > 0;
+        }
+        _transformDirty = false;
+
         glm::mat4 newTransform = glm::mat4{1.0f};
 
         // translate
@@ -43,33 +145,47 @@ namespace GLRenderer {
         // scale
         newTransform = glm::scale(newTransform, glm::vec3(scale[0], scale[1], scale[2]));
 
-        _modelMatrix = newTransform;
+        _sceneGraph.set_local_transform(0, newTransform);
+        return _sceneGraph.update() > 0;
     }
 
-    void Model::draw_model(unsigned int depthTexture) {
-        for (auto &mesh: meshes) {
-            mesh.draw_mesh(_modelMatrix, _modelShader, depthTexture);
+    void Model::init_scene_graph(const std::vector<NodeData> &nodes) {
+        // imported node i becomes graph node i + 1, under the model's own transform
+        _sceneGraph.clear();
+        _sceneGraph.add_node(-1, glm::mat4{1.0f});
+        for (auto &node: nodes) {
+            _sceneGraph.add_node(node.parent < 0 ? 0 : node.parent + 1, node.localTransform);
         }
+        _transformDirty = true;
     }
 
-    void Model::draw_model_untextured(Shader *shader) {
-        for (auto &mesh: meshes) {
-            mesh.draw_mesh_untextured(_modelMatrix, shader);
-        }
-    }
+    void Model::process_node(aiNode *node, const aiScene *scene, int32_t parent, std::vector<aiMesh *> &sceneMeshes,
+                             std::vector<uint32_t> &meshNodes, std::vector<NodeData> &nodes) {
+        // assimp matrices are row-major
+        const aiMatrix4x4 &t = node->mTransformation;
+        NodeData nodeData{};
+        nodeData.parent = parent;
+        nodeData.localTransform[0] = glm::vec4(t.a1, t.b1, t.c1, t.d1);
+        nodeData.localTransform[1] = glm::vec4(t.a2, t.b2, t.c2, t.d2);
+        nodeData.localTransform[2] = glm::vec4(t.a3, t.b3, t.c3, t.d3);
+        nodeData.localTransform[3] = glm::vec4(t.a4, t.b4, t.c4, t.d4);
+        auto nodeIndex = (uint32_t) nodes.size();
+        nodes.push_back(nodeData);
 
-    void Model::process_node(aiNode *node, const aiScene *scene) {
+        // mesh nodes are graph indices, the model's own transform is node 0
         for (size_t i = 0; i < node->mNumMeshes; i++) {
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(process_mesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(nodeIndex + 1);
         }
         for (size_t i = 0; i < node->mNumChildren; i++) {
-            process_node(node->mChildren[i], scene);
+            process_node(node->mChildren[i], scene, (int32_t) nodeIndex, sceneMeshes, meshNodes, nodes);
         }
     }
 
-    Mesh Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
-        Mesh newMesh;
+    MeshData Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
+        PROFILE_ZONE("Model::process_mesh");
+        MeshData newMesh;
+        newMesh.vertices.reserve(mesh->mNumVertices);
         for (size_t i = 0; i < mesh->mNumVertices; i++) {
             Vertex newVertex{};
             newVertex.position.x = mesh->mVertices[i].x;
@@ -101,54 +217,152 @@ namespace GLRenderer {
             }
         }
 
-        newMesh.texture = nullptr;
+        // store texture paths only, textures are created when the mesh is uploaded
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-        std::vector<Texture *> textureMaps;
-        textureMaps.push_back(create_texture(material, aiTextureType_BASE_COLOR, "texture_base"));
-        textureMaps.push_back(create_texture(material, aiTextureType_NORMALS, "texture_normal"));
-        textureMaps.push_back(create_texture(material, aiTextureType_DIFFUSE_ROUGHNESS, "texture_roughness"));
+        auto get_texture_path = [material](aiTextureType textureType) -> std::string {
+            if (!material->GetTextureCount(textureType)) {
+                return "";
+            }
+            aiString str;
+            material->GetTexture(textureType, 0, &str);
+            return str.C_Str();
+        };
+        newMesh.material.baseColor = get_texture_path(aiTextureType_BASE_COLOR);
+        newMesh.material.normal = get_texture_path(aiTextureType_NORMALS);
+        newMesh.material.roughness = get_texture_path(aiTextureType_DIFFUSE_ROUGHNESS);
 
         // just use the base color path as name
         aiString str;
         material->GetTexture(aiTextureType_DIFFUSE, 0, &str);
-        std::string fullPath = _directory + '/' + str.C_Str();
-        PBRTexture *existingTexture = _textureManager->get_pbr_texture(fullPath);
-        if (existingTexture) {
-            newMesh.pbrTexture = existingTexture;
-        } else {
+        newMesh.material.name = str.C_Str();
+
+        return newMesh;
+    }
+
+    void Model::preload_textures(const std::vector<const MaterialRef *> &materials, ThreadPool *pool) {
+        std::vector<std::string> texturePaths;
+        for (auto material: materials) {
+            for (auto texturePath: {&material->baseColor, &material->normal, &material->roughness}) {
+                if (!texturePath->empty()) {
+                    texturePaths.push_back(_directory + '/' + *texturePath);
+                }
+            }
+        }
+        _textureManager->preload_textures(texturePaths, pool);
+    }
+
+    Mesh Model::create_mesh(const PositionVertex *positions, const AttributeVertex *attributes, size_t vertexCount,
+                            const unsigned int *indices, size_t indexCount, const MeshBounds &bounds,
+                            const MeshLod *lods, size_t lodCount, const MaterialRef &material, uint32_t node) {
+        Mesh newMesh{};
+        newMesh.node = node;
+        std::string fullPath = _directory + '/' + material.name;
+        newMesh.pbrTexture = _textureManager->acquire_pbr_texture(fullPath);
+        if (!newMesh.pbrTexture) {
+            std::vector<Texture *> textureMaps;
+            textureMaps.push_back(create_texture(material.baseColor, "texture_base"));
+            textureMaps.push_back(create_texture(material.normal, "texture_normal"));
+            textureMaps.push_back(create_texture(material.roughness, "texture_roughness"));
             newMesh.pbrTexture = _textureManager->create_pbr_texture(textureMaps, fullPath);
         }
 
-        newMesh.texture = textureMaps[0];
+        newMesh.texture = newMesh.pbrTexture->albedo;
+
+        newMesh.setup_mesh(_geometryPool, positions, attributes, vertexCount, indices, indexCount, bounds);
+        if (lodCount > 0) {
+            newMesh.lodCount = (uint32_t) std::min(lodCount, (size_t) MAX_LOD_COUNT);
+            std::copy(lods, lods + newMesh.lodCount, newMesh.lods);
+        }
 
-        newMesh.setup_mesh();
+        // simple enough to be an occluder, whether it is large enough is only known once every mesh is in
+        size_t occluderIndexCount = newMesh.lods[0].indexCount;
+        if (occluderIndexCount > 0 && occluderIndexCount / 3 <= OCCLUDER_MAX_TRIANGLES) {
+            // the quantized positions, the same ones the depth buffer sees
+            newMesh.occluderPositions.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++) {
+                newMesh.occluderPositions[i] = decode_position(positions[i], bounds.center, bounds.extent);
+            }
+            newMesh.occluderIndices.assign(indices + newMesh.lods[0].indexOffset,
+                                           indices + newMesh.lods[0].indexOffset + occluderIndexCount);
+        }
         return newMesh;
     }
 
-    Texture *Model::create_texture(aiMaterial *material, aiTextureType textureType, const std::string &typeName) {
-        if (!material->GetTextureCount(textureType)) {
-            // no textures of this type
-            return _textureManager->_defaultTexture;
+    void Model::select_occluders() {
+        // compared in mesh space, node transforms are ignored
+        float largestRadius = 0.0f;
+        for (auto &mesh: meshes) {
+            largestRadius = std::max(largestRadius, mesh.bounds.radius);
+        }
+        size_t occluderCount = 0;
+        for (auto &mesh: meshes) {
+            if (mesh.bounds.radius < largestRadius * OCCLUDER_MIN_RADIUS_FRACTION) {
+                mesh.occluderPositions = {};
+                mesh.occluderIndices = {};
+            }
+            occluderCount += mesh.occluderIndices.empty() ? 0 : 1;
+        }
+        std::cout << occluderCount << " of " << meshes.size() << " meshes picked as occluders" << std::endl;
+    }
+
+    Texture *Model::create_texture(const std::string &texturePath, const std::string &typeName) {
+        if (texturePath.empty()) {
+            // no textures of this type, use the default
+            return _textureManager->acquire_texture("", typeName);
         }
 
-        aiString str;
-        material->GetTexture(textureType, 0, &str);
-        std::string fullPath = _directory + '/' + str.C_Str();
-        // check if it already exists
-        Texture *existingTexture = _textureManager->get_texture(fullPath);
-        if (existingTexture) {
-            return existingTexture;
-        } else {
-            // create new texture
-            return _textureManager->create_texture(fullPath, typeName);
+        return _textureManager->acquire_texture(_directory + '/' + texturePath, typeName);
+    }
+
+    void Model::cleanup() {
+        for (auto &mesh: meshes) {
+            _textureManager->release_pbr_texture(mesh.pbrTexture);
+            mesh.cleanup(_geometryPool);
         }
+        meshes.clear();
+    }
+
+    ModelManager::ModelManager(unsigned int importThreadCount, size_t textureBudgetBytes) {
+        _importPool = new ThreadPool(importThreadCount);
+        std::cout << "Importing models with " << _importPool->thread_count() << " threads" << std::endl;
+        textureManager = new TextureManager("../assets/devtex/dev_black.png", textureBudgetBytes);
+        geometryPool = new GeometryPool(1 << 20, 1 << 22);
     }
 
     Model *ModelManager::create_model(const std::string &filePath, const std::string &name, Shader *shader) {
+        // a reused name releases the old model's geometry and texture references first
+        destroy_model(name);
+
         Model newModel;
-        newModel.init(filePath, shader);
+        newModel.init(filePath, shader, textureManager, geometryPool, _importPool);
         models[name] = newModel;
+        version++;
 
         return &models[name];
     }
+
+    void ModelManager::destroy_model(const std::string &name) {
+        auto model = models.find(name);
+        if (model == models.end()) {
+            return;
+        }
+        model->second.cleanup();
+        models.erase(model);
+        version++;
+    }
+
+    void ModelManager::cleanup() {
+        for (auto &it: models) {
+            it.second.cleanup();
+        }
+        models.clear();
+        textureManager->cleanup();
+        delete textureManager;
+        textureManager = nullptr;
+        geometryPool->cleanup();
+        delete geometryPool;
+        geometryPool = nullptr;
+        delete _importPool;
+        _importPool = nullptr;
+    }
 }
\ No newline at end of file
@@ -6,19 +6,30 @@
 #include <gl/texture.h>
 #include <gl/mesh.h>
 #include <gl/shader.h>
+#include <gl/scene_graph.h>
+
+class ThreadPool;
 
 namespace GLRenderer {
     class Model {
     public:
-        void init(const std::string &filePath, Shader *shader);
+        void init(const std::string &filePath, Shader *shader, TextureManager *textureManager, GeometryPool *geometryPool,
+                  ThreadPool *pool);
+
+        // releases textures and GL buffers, the model is empty afterwards
+        void cleanup();
 
         void set_shader(Shader *newShader);
 
-        void update_transform();
+        // call after editing translation, rotation or scale, the matrices are rebuilt in update_transform
+        void mark_transform_dirty() { _transformDirty = true; }
 
-        void draw_model(unsigned int depthTexture);
+        // recomputes dirty nodes, returns true if any world transform changed
+        bool update_transform();
 
-        void draw_model_untextured(Shader *shader);
+        const glm::mat4 &get_world_transform(uint32_t node) const { return _sceneGraph.get_world_transform(node); }
+
+        size_t node_count() const { return _sceneGraph.node_count(); }
 
         std::vector<Mesh> meshes;
 
@@ -26,24 +37,59 @@ namespace GLRenderer {
         float translation[3] = {0.0f, 0.0f, 0.0f};
         float rotation[3] = {0.0f, 0.0f, 0.0f};
         float scale[3] = {1.0f, 1.0f, 1.0f};
+
+        // dynamic models skip the static shadow cache and are redrawn into the shadow map whenever they move
+        bool dynamic = false;
         Shader *_modelShader;
 
     private:
-        glm::mat4 _modelMatrix = glm::mat4{1.0f};
+        // node 0 holds translation/rotation/scale, the imported hierarchy hangs below it
+        SceneGraph _sceneGraph;
+        bool _transformDirty = true;
         TextureManager *_textureManager;
+        GeometryPool *_geometryPool;
         std::string _directory;
 
-        void process_node(aiNode *node, const aiScene *scene);
+        void process_node(aiNode *node, const aiScene *scene, int32_t parent, std::vector<aiMesh *> &sceneMeshes,
+                          std::vector<uint32_t> &meshNodes, std::vector<NodeData> &nodes);
+
+        void init_scene_graph(const std::vector<NodeData> &nodes);
+
+        // keeps the occluder copies of the meshes that are large next to the rest of the model
+        void select_occluders();
+
+        MeshData process_mesh(aiMesh *mesh, const aiScene *scene);
+
+        void preload_textures(const std::vector<const MaterialRef *> &materials, ThreadPool *pool);
 
-        Mesh process_mesh(aiMesh *mesh, const aiScene *scene);
+        Mesh create_mesh(const PositionVertex *positions, const AttributeVertex *attributes, size_t vertexCount,
+                         const unsigned int *indices, size_t indexCount, const MeshBounds &bounds,
+                         const MeshLod *lods, size_t lodCount, const MaterialRef &material, uint32_t node);
 
-        Texture *create_texture(aiMaterial *material, aiTextureType textureType, const std::string &typeName);
+        Texture *create_texture(const std::string &texturePath, const std::string &typeName);
     };
 
     class ModelManager {
     public:
+        // 0 uses every hardware thread, 1 imports serially
+        ModelManager(unsigned int importThreadCount, size_t textureBudgetBytes);
+
         std::unordered_map<std::string, Model> models;
 
+        // shared by every model
+        TextureManager *textureManager = nullptr;
+        GeometryPool *geometryPool = nullptr;
+
         Model *create_model(const std::string &filePath, const std::string &name, Shader *shader);
+
+        void destroy_model(const std::string &name);
+
+        // bumped whenever a model is added or removed
+        uint32_t version = 0;
+
+        void cleanup();
+
+    private:
+        ThreadPool *_importPool = nullptr;
     };
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "occlusion_culler.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+namespace GLRenderer {
+    constexpr uint32_t OCCLUSION_SIMD_WIDTH = 4;
+    static_assert(OCCLUSION_BUFFER_WIDTH % OCCLUSION_SIMD_WIDTH == 0, "rows must hold whole SIMD groups");
+
+    OcclusionCuller::OcclusionCuller() {
+        uint32_t width = OCCLUSION_BUFFER_WIDTH;
+        uint32_t height = OCCLUSION_BUFFER_HEIGHT;
+        while (true) {
+            _levels.push_back({width, height, std::vector<float>((size_t) width * height, 0.0f)});
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = std::max((width + 1) / 2, 1u);
+            height = std::max((height + 1) / 2, 1u);
+        }
+    }
+
+    void OcclusionCuller::begin(const glm::mat4 &viewProj) {
+        _viewProj = viewProj;
+        _stats = OcclusionStats{};
+        std::fill(_levels[0].depth.begin(), _levels[0].depth.end(), 0.0f);
+    }
+
+    void OcclusionCuller::rasterize(const glm::vec3 *positions, size_t vertexCount, const uint32_t *indices,
+                                    size_t indexCount, const glm::mat4 &modelMatrix) {
+        _stats.occluders++;
+        glm::mat4 transform = _viewProj * modelMatrix;
+        _clipPositions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            _clipPositions[i] = transform * glm::vec4(positions[i], 1.0f);
+        }
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            const glm::vec4 &a = _clipPositions[indices[i]];
+            const glm::vec4 &b = _clipPositions[indices[i + 1]];
+            const glm::vec4 &c = _clipPositions[indices[i + 2]];
+            // fully outside one of the side planes
+            if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+                (a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w)) {
+                continue;
+            }
+
+            // distance in front of the near plane, z >= -w
+            float distances[3] = {a.z + a.w, b.z + b.w, c.z + c.w};
+            if (distances[0] >= 0.0f && distances[1] >= 0.0f && distances[2] >= 0.0f) {
+                draw_triangle(a, b, c);
+                continue;
+            }
+            if (distances[0] < 0.0f && distances[1] < 0.0f && distances[2] < 0.0f) {
+                continue;
+            }
+
+            // clipping one or two corners away leaves a triangle or a quad, in the same winding
+            const glm::vec4 *corners[3] = {&a, &b, &c};
+            glm::vec4 clipped[4];
+            uint32_t clippedCount = 0;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t next = (corner + 1) % 3;
+                if (distances[corner] >= 0.0f) {
+                    clipped[clippedCount++] = *corners[corner];
+                }
+                if ((distances[corner] >= 0.0f) != (distances[next] >= 0.0f)) {
+                    float t = distances[corner] / (distances[corner] - distances[next]);
+                    clipped[clippedCount++] = *corners[corner] + (*corners[next] - *corners[corner]) * t;
+                }
+            }
+            draw_triangle(clipped[0], clipped[1], clipped[2]);
+            if (clippedCount == 4) {
+                draw_triangle(clipped[0], clipped[2], clipped[3]);
+            }
+        }
+    }
+
+    void OcclusionCuller::draw_triangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+        DepthLevel &target = _levels[0];
+        auto width = (float) target.width;
+        auto height = (float) target.height;
+        // buffer pixels with y up like the window, so front faces still wind counter-clockwise
+        auto to_screen = [width, height](const glm::vec4 &v) {
+            float invW = 1.0f / v.w;
+            return glm::vec3((v.x * invW * 0.5f + 0.5f) * width, (v.y * invW * 0.5f + 0.5f) * height, invW);
+        };
+        glm::vec3 p0 = to_screen(a);
+        glm::vec3 p1 = to_screen(b);
+        glm::vec3 p2 = to_screen(c);
+
+        // back faces are skipped: the scene pass enables GL_CULL_FACE, and dropping an occluder triangle can
+        // only keep more objects visible, never hide one
+        float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+        if (!(area > 0.0f)) {
+            return;
+        }
+
+        // pixels whose centers are inside the bounds, clamped before converting so far vertices cannot overflow
+        auto first_pixel = [](float low, float size) {
+            return (int) std::ceil(std::clamp(low, -1.0f, size + 1.0f) - 0.5f);
+        };
+        auto last_pixel = [](float high, float size) {
+            return (int) std::floor(std::clamp(high, -1.0f, size + 1.0f) - 0.5f);
+        };
+        int minX = std::max(first_pixel(std::min({p0.x, p1.x, p2.x}), width), 0);
+        int maxX = std::min(last_pixel(std::max({p0.x, p1.x, p2.x}), width), (int) target.width - 1);
+        int minY = std::max(first_pixel(std::min({p0.y, p1.y, p2.y}), height), 0);
+        int maxY = std::min(last_pixel(std::max({p0.y, p1.y, p2.y}), height), (int) target.height - 1);
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+        _stats.occluderTriangles++;
+
+        // edge i is opposite corner i, each is a * x + b * y + c and non-negative inside
+        glm::vec3 corners[3] = {p0, p1, p2};
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (uint32_t edge = 0; edge < 3; edge++) {
+            const glm::vec3 &from = corners[(edge + 1) % 3];
+            const glm::vec3 &to = corners[(edge + 2) % 3];
+            edgeA[edge] = from.y - to.y;
+            edgeB[edge] = to.x - from.x;
+            edgeC[edge] = -(edgeA[edge] * from.x + edgeB[edge] * from.y);
+        }
+        // the edge values are barycentrics scaled by the area, so 1 / w is a plane over them
+        float invArea = 1.0f / area;
+        float depthA = (edgeA[0] * p0.z + edgeA[1] * p1.z + edgeA[2] * p2.z) * invArea;
+        float depthB = (edgeB[0] * p0.z + edgeB[1] * p1.z + edgeB[2] * p2.z) * invArea;
+        float depthC = (edgeC[0] * p0.z + edgeC[1] * p1.z + edgeC[2] * p2.z) * invArea;
+
+        // rows start on a SIMD group, the edge tests mask the pixels left of the bounds
+        int firstX = minX & ~(int) (OCCLUSION_SIMD_WIDTH - 1);
+        for (int y = minY; y <= maxY; y++) {
+            float pixelY = (float) y + 0.5f;
+            float *row = &target.depth[(size_t) y * target.width];
+#ifdef OCCLUSION_SSE
+            __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 rowEdge0 = _mm_set1_ps(edgeB[0] * pixelY + edgeC[0]);
+            __m128 rowEdge1 = _mm_set1_ps(edgeB[1] * pixelY + edgeC[1]);
+            __m128 rowEdge2 = _mm_set1_ps(edgeB[2] * pixelY + edgeC[2]);
+            __m128 rowDepth = _mm_set1_ps(depthB * pixelY + depthC);
+            for (int x = firstX; x <= maxX; x += (int) OCCLUSION_SIMD_WIDTH) {
+                __m128 pixelX = _mm_add_ps(_mm_set1_ps((float) x), laneOffsets);
+                __m128 edge0 = _mm_add_ps(_mm_mul_ps(pixelX, _mm_set1_ps(edgeA[0])), rowEdge0);
+                __m128 edge1 = _mm_add_ps(_mm_mul_ps(pixelX, _mm_set1_ps(edgeA[1])), rowEdge1);
+                __m128 edge2 = _mm_add_ps(_mm_mul_ps(pixelX, _mm_set1_ps(edgeA[2])), rowEdge2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, _mm_setzero_ps()),
+                                                      _mm_cmpge_ps(edge1, _mm_setzero_ps())),
+                                           _mm_cmpge_ps(edge2, _mm_setzero_ps()));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 depth = _mm_add_ps(_mm_mul_ps(pixelX, _mm_set1_ps(depthA)), rowDepth);
+                __m128 previous = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_max_ps(previous, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+            }
+#else
+            for (int x = firstX; x <= maxX; x++) {
+                float pixelX = (float) x + 0.5f;
+                bool inside = true;
+                for (uint32_t edge = 0; edge < 3; edge++) {
+                    inside = inside && edgeA[edge] * pixelX + edgeB[edge] * pixelY + edgeC[edge] >= 0.0f;
+                }
+                if (inside) {
+                    row[x] = std::max(row[x], depthA * pixelX + depthB * pixelY + depthC);
+                }
+            }
+#endif
+        }
+    }
+
+    void OcclusionCuller::build_pyramid() {
+        for (size_t level = 1; level < _levels.size(); level++) {
+            const DepthLevel &source = _levels[level - 1];
+            DepthLevel &target = _levels[level];
+            for (uint32_t y = 0; y < target.height; y++) {
+                // odd sizes repeat the last row or column
+                uint32_t y0 = std::min(y * 2, source.height - 1);
+                uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+                for (uint32_t x = 0; x < target.width; x++) {
+                    uint32_t x0 = std::min(x * 2, source.width - 1);
+                    uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+                    target.depth[(size_t) y * target.width + x] = std::min(
+                            std::min(source.depth[(size_t) y0 * source.width + x0],
+                                     source.depth[(size_t) y0 * source.width + x1]),
+                            std::min(source.depth[(size_t) y1 * source.width + x0],
+                                     source.depth[(size_t) y1 * source.width + x1]));
+                }
+            }
+        }
+    }
+
+    bool OcclusionCuller::is_occluded(const AABB &bounds) {
+        _stats.tested++;
+        glm::vec2 screenMin = glm::vec2(1.0f);
+        glm::vec2 screenMax = glm::vec2(-1.0f);
+        float nearestDepth = 0.0f;
+        for (uint32_t corner = 0; corner < 8; corner++) {
+            glm::vec3 position = glm::vec3(corner & 1 ? bounds.max.x : bounds.min.x,
+                                           corner & 2 ? bounds.max.y : bounds.min.y,
+                                           corner & 4 ? bounds.max.z : bounds.min.z);
+            glm::vec4 clip = _viewProj * glm::vec4(position, 1.0f);
+            if (clip.w <= 0.0f || clip.z < -clip.w) {
+                return false;
+            }
+            float invW = 1.0f / clip.w;
+            glm::vec2 ndc = glm::vec2(clip.x * invW, clip.y * invW);
+            screenMin = glm::min(screenMin, ndc);
+            screenMax = glm::max(screenMax, ndc);
+            nearestDepth = std::max(nearestDepth, invW);
+        }
+
+        // every pixel the box touches
+        auto pixel = [](float ndc, uint32_t size) {
+            float position = std::clamp((ndc * 0.5f + 0.5f) * (float) size, 0.0f, (float) (size - 1));
+            return (uint32_t) position;
+        };
+        uint32_t minX = pixel(screenMin.x, OCCLUSION_BUFFER_WIDTH);
+        uint32_t maxX = pixel(screenMax.x, OCCLUSION_BUFFER_WIDTH);
+        uint32_t minY = pixel(screenMin.y, OCCLUSION_BUFFER_HEIGHT);
+        uint32_t maxY = pixel(screenMax.y, OCCLUSION_BUFFER_HEIGHT);
+
+        // the finest level where the rectangle spans at most 4x4 texels, coarser levels reach further past it
+        size_t level = 0;
+        while (level + 1 < _levels.size() && ((maxX >> level) - (minX >> level) > 3 ||
+                                              (maxY >> level) - (minY >> level) > 3)) {
+            level++;
+        }
+        const DepthLevel &depthLevel = _levels[level];
+        for (uint32_t y = minY >> level; y <= maxY >> level; y++) {
+            for (uint32_t x = minX >> level; x <= maxX >> level; x++) {
+                // an occluder has to be nearer than the box's nearest corner, empty texels are 0
+                if (depthLevel.depth[(size_t) y * depthLevel.width + x] <= nearestDepth) {
+                    return false;
+                }
+            }
+        }
+        _stats.occluded++;
+        return true;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include <gl/culling.h>
+
+namespace GLRenderer {
+    // low resolution depth buffer the occluders are drawn into, the width is a multiple of the SIMD width
+    constexpr uint32_t OCCLUSION_BUFFER_WIDTH = 256;
+    constexpr uint32_t OCCLUSION_BUFFER_HEIGHT = 144;
+    // meshes picked as occluders at import are simple, at most this many triangles, and large, a radius of at
+    // least this fraction of the model's largest mesh
+    constexpr uint32_t OCCLUDER_MAX_TRIANGLES = 2048;
+    constexpr float OCCLUDER_MIN_RADIUS_FRACTION = 0.05f;
+
+    struct OcclusionStats {
+        uint32_t occluders = 0;
+        // after near plane clipping and back face culling
+        uint64_t occluderTriangles = 0;
+        uint32_t tested = 0;
+        uint32_t occluded = 0;
+    };
+
+    // software rasterizer for the occluders plus a min-depth pyramid to test bounds against; everything runs on
+    // the calling thread in submission order, so results only depend on the inputs
+    class OcclusionCuller {
+    public:
+        OcclusionCuller();
+
+        // clears the depth buffer and the stats for a new view
+        void begin(const glm::mat4 &viewProj);
+
+        // draws the front faces of an occluder, positions in mesh space
+        void rasterize(const glm::vec3 *positions, size_t vertexCount, const uint32_t *indices, size_t indexCount,
+                       const glm::mat4 &modelMatrix);
+
+        // reduces the depth buffer into the pyramid, after the last occluder
+        void build_pyramid();
+
+        // true only if the box is behind the occluders everywhere it covers; boxes crossing the near plane
+        // are never occluded
+        bool is_occluded(const AABB &bounds);
+
+        const OcclusionStats &get_stats() const { return _stats; }
+
+    private:
+        // depth is stored as 1 / w, which is linear in screen space, 0 where nothing was drawn
+        struct DepthLevel {
+            uint32_t width;
+            uint32_t height;
+            std::vector<float> depth;
+        };
+
+        // level 0 is the depth buffer, every level holds the farthest depth of its 2x2 block below
+        std::vector<DepthLevel> _levels;
+        std::vector<glm::vec4> _clipPositions;
+        glm::mat4 _viewProj = glm::mat4(1.0f);
+        OcclusionStats _stats;
+
+        // clip space vertices, all in front of the near plane
+        void draw_triangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+    };
+}
@@ -0,0 +1,50 @@
+#include "render_queue.h"
+#include <algorithm>
+
+namespace GLRenderer {
+    uint64_t make_render_key(uint32_t pass, uint32_t shader, uint32_t material, uint32_t geometry, float depth) {
+        auto field = [](uint64_t value, uint32_t bits) { return value & ((1ull << bits) - 1); };
+        auto depthBits = (uint64_t) (std::clamp(depth, 0.0f, 1.0f) * (float) ((1u << RENDER_KEY_DEPTH_BITS) - 1));
+
+        uint64_t key = field(pass, RENDER_KEY_PASS_BITS);
+        key = (key << RENDER_KEY_SHADER_BITS) | field(shader, RENDER_KEY_SHADER_BITS);
+        key = (key << RENDER_KEY_MATERIAL_BITS) | field(material, RENDER_KEY_MATERIAL_BITS);
+        key = (key << RENDER_KEY_GEOMETRY_BITS) | field(geometry, RENDER_KEY_GEOMETRY_BITS);
+        key = (key << RENDER_KEY_DEPTH_BITS) | depthBits;
+        return key;
+    }
+
+    void RenderQueue::sort() {
+        // LSD radix sort on bytes, small queues are cheaper to compare sort
+        constexpr uint32_t DIGIT_BITS = 8;
+        constexpr uint32_t BUCKETS = 1u << DIGIT_BITS;
+        if (_items.size() < 512) {
+            std::stable_sort(_items.begin(), _items.end(),
+                             [](const RenderItem &a, const RenderItem &b) { return a.key < b.key; });
+            return;
+        }
+
+        _scratch.resize(_items.size());
+        std::vector<uint32_t> offsets(BUCKETS);
+        for (uint32_t shift = 0; shift < 64; shift += DIGIT_BITS) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (auto &item: _items) {
+                offsets[(item.key >> shift) & (BUCKETS - 1)]++;
+            }
+            // a digit every item shares leaves the order as it is
+            if (offsets[(_items[0].key >> shift) & (BUCKETS - 1)] == _items.size()) {
+                continue;
+            }
+            uint32_t sum = 0;
+            for (auto &offset: offsets) {
+                uint32_t count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (auto &item: _items) {
+                _scratch[offsets[(item.key >> shift) & (BUCKETS - 1)]++] = item;
+            }
+            _items.swap(_scratch);
+        }
+    }
+}
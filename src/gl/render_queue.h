@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace GLRenderer {
+    enum RenderPass : uint32_t {
+        RENDER_PASS_OPAQUE = 0,
+        // depth only, keyed by geometry and depth alone so it runs strictly front to back
+        RENDER_PASS_DEPTH_PREPASS = 1
+    };
+
+    // pass | shader | material | geometry | depth from the most to the least significant bits, so sorting
+    // groups draws by the state they need and orders each group front to back
+    constexpr uint32_t RENDER_KEY_PASS_BITS = 4;
+    constexpr uint32_t RENDER_KEY_SHADER_BITS = 10;
+    constexpr uint32_t RENDER_KEY_MATERIAL_BITS = 20;
+    constexpr uint32_t RENDER_KEY_GEOMETRY_BITS = 6;
+    constexpr uint32_t RENDER_KEY_DEPTH_BITS = 24;
+    static_assert(RENDER_KEY_PASS_BITS + RENDER_KEY_SHADER_BITS + RENDER_KEY_MATERIAL_BITS +
+                  RENDER_KEY_GEOMETRY_BITS + RENDER_KEY_DEPTH_BITS == 64, "render key must use all 64 bits");
+
+    // ids past their field width are truncated, depth is a fraction of the far plane clamped to [0, 1]
+    uint64_t make_render_key(uint32_t pass, uint32_t shader, uint32_t material, uint32_t geometry, float depth);
+
+    struct RenderItem {
+        uint64_t key;
+        // index into the renderer's instances
+        uint32_t instance;
+    };
+
+    // refilled every frame
+    class RenderQueue {
+    public:
+        void clear() { _items.clear(); }
+
+        void push(uint64_t key, uint32_t instance) { _items.push_back({key, instance}); }
+
+        // stable for equal keys, so instances keep their relative order
+        void sort();
+
+        const std::vector<RenderItem> &items() const { return _items; }
+
+    private:
+        std::vector<RenderItem> _items;
+        std::vector<RenderItem> _scratch;
+    };
+}
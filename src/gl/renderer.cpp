@@ -1,19 +1,31 @@
 #include "renderer.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <cmath>
+#include <random>
 #include <imgui_impl_opengl3.h>
 #include <implot.h>
 #include <gl/check.h>
+#include <profiler.h>
 
 namespace GLRenderer {
     void Renderer::init(FlyCamera *camera, uint32_t windowWidth, uint32_t windowHeight) {
+        PROFILE_ZONE("Renderer::init");
         _flyCamera = camera;
         _windowWidth = windowWidth;
         _windowHeight = windowHeight;
-        _modelManager = new ModelManager;
+        _modelManager = new ModelManager(importThreadCount, (size_t) textureBudgetMB * 1024 * 1024);
 
         init_shaders();
+        init_uniform_buffers();
+        _lightClusters = new LightClusters();
         init_scene();
         init_shadow_map();
+        _gpuProfiler = new GpuProfiler();
+        glCreateQueries(GL_SAMPLES_PASSED, (GLsizei) GPU_PROFILER_FRAME_LAG, _sampleQueries);
 
         isInitialized = true;
     }
@@ -26,9 +38,42 @@ namespace GLRenderer {
     }
 
     void Renderer::init_shaders() {
-        _pbrShader = new Shader("../shaders/pbr.vert.spv", "../shaders/pbr.frag.spv");
+        // the bindless variant needs the extension in the driver and in its SPIR-V consumer, fall back if either fails
+        _pbrShader = nullptr;
+        if (useBindless && _bindlessFunctions.load(procAddressLoader)) {
+            auto bindlessShader = new Shader("../shaders/pbr.vert.spv", "../shaders/pbr_bindless.frag.spv");
+            if (bindlessShader->isLinked) {
+                _pbrShader = bindlessShader;
+                _bindless = true;
+                _modelManager->textureManager->get_pools()->enable_bindless(_bindlessFunctions);
+            } else {
+                std::cout << "Bindless shader unavailable, binding texture pools instead" << std::endl;
+                glDeleteProgram(bindlessShader->programID);
+                delete bindlessShader;
+            }
+        }
+        if (!_pbrShader) {
+            _pbrShader = new Shader("../shaders/pbr.vert.spv", "../shaders/pbr.frag.spv");
+        }
         _depthShader = new Shader("../shaders/depth.vert.spv", "../shaders/depth.frag.spv",
                                   "../shaders/depth.geom.spv");
+        _depthFaceShader = new Shader("../shaders/depth_face.vert.spv", "../shaders/depth.frag.spv");
+        _shadowAtlasShader = new Shader("../shaders/shadow_atlas.vert.spv", "../shaders/shadow_atlas.frag.spv");
+        _depthPrepassShader = new Shader("../shaders/depth_prepass.vert.spv", "../shaders/depth_prepass.frag.spv");
+        _overdrawShader = new Shader("../shaders/pbr.vert.spv", "../shaders/overdraw.frag.spv");
+
+        // SPIR-V programs need not keep uniform names, so the handles come from the explicit locations
+        _depthDrawOffset = _depthShader->get_uniform<int>(DEPTH_DRAW_OFFSET_LOCATION, "draw_offset");
+        _depthFaceDrawOffset = _depthFaceShader->get_uniform<int>(DEPTH_DRAW_OFFSET_LOCATION, "draw_offset");
+        _depthFaceUniform = _depthFaceShader->get_uniform<int>(DEPTH_FACE_LOCATION, "face");
+        _atlasDrawOffset = _shadowAtlasShader->get_uniform<int>(DEPTH_DRAW_OFFSET_LOCATION, "draw_offset");
+        _atlasFaceMatrix = _shadowAtlasShader->get_uniform<glm::mat4>(ATLAS_FACE_MATRIX_LOCATION, "face_matrix");
+        _atlasLightPosition = _shadowAtlasShader->get_uniform<glm::vec3>(ATLAS_LIGHT_POSITION_LOCATION,
+                                                                         "light_position");
+        _atlasLightRadius = _shadowAtlasShader->get_uniform<float>(ATLAS_LIGHT_RADIUS_LOCATION, "light_radius");
+        _prepassDrawOffset = _depthPrepassShader->get_uniform<int>(SCENE_DRAW_OFFSET_LOCATION, "draw_offset");
+        _overdrawDrawOffset = _overdrawShader->get_uniform<int>(SCENE_DRAW_OFFSET_LOCATION, "draw_offset");
+
     }
 
     void Renderer::init_scene() {
@@ -41,35 +86,693 @@ namespace GLRenderer {
         _modelManager->models["helmet"].scale[0] = 3.0f;
         _modelManager->models["helmet"].scale[1] = 3.0f;
         _modelManager->models["helmet"].scale[2] = 3.0f;
+        _modelManager->models["helmet"].dynamic = true;
     }
 
     void Renderer::init_shadow_map() {
-        // create framebuffer and cubemap
-        glGenFramebuffers(1, &depthMapFBO);
-        glGenTextures(1, &depthCubemap);
+        auto create_cubemap = [this](unsigned int &cubemap) {
+            glGenTextures(1, &cubemap);
 
-        // create textures for cubemap
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-        for (unsigned int i = 0; i < 6; i++) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, (GLsizei) SHADOW_MAP_RES,
-                         (GLsizei) SHADOW_MAP_RES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-        }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            // create textures for cubemap
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+            for (unsigned int i = 0; i < 6; i++) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, (GLsizei) SHADOW_MAP_RES,
+                             (GLsizei) SHADOW_MAP_RES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        };
+        auto create_face_framebuffers = [](unsigned int cubemap, unsigned int *framebuffers) {
+            glCreateFramebuffers(6, framebuffers);
+            for (unsigned int i = 0; i < 6; i++) {
+                glNamedFramebufferTextureLayer(framebuffers[i], GL_DEPTH_ATTACHMENT, cubemap, 0, (GLint) i);
+                glNamedFramebufferDrawBuffer(framebuffers[i], GL_NONE);
+                glNamedFramebufferReadBuffer(framebuffers[i], GL_NONE);
+            }
+        };
+
+        // the cubemap sampled by the scene, and the cache of static casters it is composited from
+        create_cubemap(depthCubemap);
+        create_cubemap(_staticShadowCubemap);
 
         // attach cubemap to framebuffer
+        glGenFramebuffers(1, &depthMapFBO);
         glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
         glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
         glDrawBuffer(GL_NONE);
         glReadBuffer(GL_NONE);
 
+        // one framebuffer per face for the per-face mode
+        create_face_framebuffers(depthCubemap, _shadowFaceFBOs);
+        create_face_framebuffers(_staticShadowCubemap, _staticShadowFaceFBOs);
+
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        _shadowAtlas = new ShadowAtlas();
+    }
+
+    void Renderer::init_uniform_buffers() {
+        _frameBuffer = new UniformBuffer(sizeof(FrameData), FRAME_DATA_BINDING);
+        _lightBuffer = new UniformBuffer(sizeof(LightData), LIGHT_DATA_BINDING);
+        _drawBuffer = new UniformBuffer(sizeof(DrawData), DRAW_DATA_BINDING, GL_SHADER_STORAGE_BUFFER);
+        _materialBuffer = new UniformBuffer(sizeof(MaterialData), MATERIAL_DATA_BINDING, GL_SHADER_STORAGE_BUFFER);
+        _poolHandleBuffer = new UniformBuffer(sizeof(GLuint64) * MAX_TEXTURE_POOLS, TEXTURE_POOL_HANDLES_BINDING,
+                                              GL_SHADER_STORAGE_BUFFER);
+        glCreateBuffers(1, &_indirectBuffer);
+    }
+
+    void Renderer::update_uniform_buffers() {
+        FrameData frameData{};
+        frameData.view = _flyCamera->get_view_matrix();
+        frameData.viewProj = _flyCamera->projection * frameData.view;
+        frameData.camPos = glm::vec4(_flyCamera->position, 1.0f);
+        frameData.gamma = _gamma;
+        frameData.exposure = _exposure;
+        frameData.shadowBias = _shadowBias;
+        _lightClusters->set_view(_flyCamera->projection, _flyCamera->get_near(), _flyCamera->get_far(), _windowWidth,
+                                 _windowHeight);
+        _lightClusters->fill_frame_data(frameData);
+        _frameBuffer->update(frameData);
+
+        // create projection
+        glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float) SHADOW_MAP_RES / (float) SHADOW_MAP_RES,
+                                                _shadowNear, _shadowFar);
+
+        // convert light pos to glm vec3 for cleanliness
+        glm::vec3 glmLightPos = glm::vec3(_lightPos[0], _lightPos[1], _lightPos[2]);
+
+        // generate transform matrices for each part of cubemap
+        LightData lightData{};
+        lightData.shadowMatrices[0] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(1.0f, 0.0f, 0.0f),
+                                                               glm::vec3(0.0f, -1.0f, 0.0f));
+        lightData.shadowMatrices[1] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(-1.0f, 0.0f, 0.0f),
+                                                               glm::vec3(0.0f, -1.0f, 0.0f));
+        lightData.shadowMatrices[2] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 1.0f, 0.0f),
+                                                               glm::vec3(0.0f, 0.0f, 1.0f));
+        lightData.shadowMatrices[3] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, -1.0f, 0.0f),
+                                                               glm::vec3(0.0f, 0.0f, -1.0f));
+        lightData.shadowMatrices[4] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 0.0f, 1.0f),
+                                                               glm::vec3(0.0f, -1.0f, 0.0f));
+        lightData.shadowMatrices[5] = shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 0.0f, -1.0f),
+                                                               glm::vec3(0.0f, -1.0f, 0.0f));
+        std::copy(std::begin(lightData.shadowMatrices), std::end(lightData.shadowMatrices), std::begin(_shadowMatrices));
+        lightData.positionRadius = glm::vec4(glmLightPos, _lightRadius);
+        lightData.colorPower = glm::vec4(_lightColor[0], _lightColor[1], _lightColor[2], _lightPower);
+        lightData.farPlane = _shadowFar;
+        _lightBuffer->update(lightData);
+    }
+
+    void Renderer::update_point_lights() {
+        auto count = (size_t) std::clamp(pointLightCount, 0, (int) MAX_POINT_LIGHTS);
+        if (count != _pointLights.size() && !_instanceBounds.empty()) {
+            AABB sceneBounds = _instanceBounds[0];
+            for (auto &bounds: _instanceBounds) {
+                sceneBounds.grow(bounds);
+            }
+            // a fixed seed, so light i is the same whatever the count
+            std::mt19937 random(1337);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            _pointLights.resize(count);
+            _pointLightOrigins.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                glm::vec3 position = glm::vec3(unit(random), unit(random), unit(random));
+                glm::vec3 color = glm::vec3(unit(random), unit(random), unit(random)) * 0.8f + 0.2f;
+                _pointLightOrigins[i] = sceneBounds.min + position * (sceneBounds.max - sceneBounds.min);
+                _pointLights[i].colorPower = glm::vec4(color, 0.0f);
+            }
+        }
+        if (_pointLights.empty()) {
+            return;
+        }
+
+        if (_animatePointLights) {
+            _pointLightTime += 1.0f / 60.0f;
+        }
+        const float orbitRadius = 5.0f;
+        for (size_t i = 0; i < _pointLights.size(); i++) {
+            // golden angle phases spread the lights around their orbits
+            float angle = _pointLightTime + (float) i * 2.39996f;
+            glm::vec3 offset = glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * orbitRadius;
+            _pointLights[i].positionRadius = glm::vec4(_pointLightOrigins[i] + offset, _pointLightRadius);
+            _pointLights[i].colorPower.w = _pointLightPower;
+        }
+    }
+
+    void Renderer::bin_point_lights() {
+        _lightClusters->upload_lights(_pointLights);
+        if (gpuLightCulling && _lightClusters->has_compute()) {
+            _lightClusters->dispatch(_glState, (uint32_t) _pointLights.size());
+            _lightBinTime = 0.0;
+            return;
+        }
+        auto binTimerStart = std::chrono::high_resolution_clock::now();
+        _lightClusters->bin_lights(_pointLights, _flyCamera->get_view_matrix());
+        std::chrono::duration<double, std::milli> binDuration = std::chrono::high_resolution_clock::now() - binTimerStart;
+        _lightBinTime = binDuration.count();
+    }
+
+    void Renderer::update_instances() {
+        // a new or removed model changes the instance set, rebuild everything
+        bool rebuild = _modelManager->version != _instanceVersion;
+        _movedModels.clear();
+        _movedStaticBounds.clear();
+        _movedBounds.clear();
+        _dynamicCasterMoved = false;
+        for (auto &it: _modelManager->models) {
+            if (it.second.update_transform()) {
+                _movedModels.push_back(&it.second);
+            }
+        }
+        if (!rebuild && _movedModels.empty()) {
+            return;
+        }
+
+        if (rebuild) {
+            _instances.clear();
+            for (auto &it: _modelManager->models) {
+                for (auto &mesh: it.second.meshes) {
+                    DrawInstance instance{};
+                    instance.model = &it.second;
+                    instance.shader = it.second._modelShader;
+                    instance.material = mesh.pbrTexture;
+                    instance.mesh = &mesh;
+                    _instances.push_back(instance);
+                }
+            }
+
+            for (auto &instance: _instances) {
+                instance.drawOffset = instance.shader->get_uniform<int>(SCENE_DRAW_OFFSET_LOCATION, "draw_offset");
+                instance.texturePools = instance.material->albedo->slot.pool |
+                                        instance.material->normal->slot.pool << 8 |
+                                        instance.material->metalroughness->slot.pool << 16;
+            }
+
+            // sorted by shader, texture pools and material so visible instances fall into batches in order
+            std::stable_sort(_instances.begin(), _instances.end(), [](const DrawInstance &a, const DrawInstance &b) {
+                if (a.shader != b.shader) return a.shader < b.shader;
+                if (a.texturePools != b.texturePools) return a.texturePools < b.texturePools;
+                return a.material < b.material;
+            });
+            for (size_t i = 1; i < _instances.size(); i++) {
+                const DrawInstance &previous = _instances[i - 1];
+                bool newShader = _instances[i].shader != previous.shader;
+                _instances[i].shaderId = previous.shaderId + (newShader ? 1 : 0);
+                _instances[i].materialId = previous.materialId + (newShader || _instances[i].material !=
+                                                                                previous.material ? 1 : 0);
+            }
+
+            // material records in materialId order, the same material under two shaders gets two records
+            _materials.clear();
+            for (auto &instance: _instances) {
+                if (instance.materialId < _materials.size()) {
+                    continue;
+                }
+                MaterialData material{};
+                material.albedo = instance.material->albedo->slot.packed();
+                material.normal = instance.material->normal->slot.packed();
+                material.metalRoughness = instance.material->metalroughness->slot.packed();
+                material.baseColorFactor = glm::vec4(1.0f);
+                material.metalRoughnessFactor = glm::vec4(1.0f);
+                _materials.push_back(material);
+            }
+            size_t materialSize = _materials.size() * sizeof(MaterialData);
+            _materialBuffer->reserve(materialSize);
+            _materialBuffer->update(_materials.data(), materialSize);
+        }
+
+        _instanceBounds.resize(_instances.size());
+        _drawBounds.clear();
+        for (size_t i = 0; i < _instances.size(); i++) {
+            const DrawInstance &instance = _instances[i];
+            MeshBounds worldBounds = transform_bounds(instance.mesh->bounds,
+                                                      instance.model->get_world_transform(instance.mesh->node));
+            AABB bounds = {worldBounds.center - worldBounds.extent, worldBounds.center + worldBounds.extent};
+
+            // the shadow caches need to know where moved casters were and where they are now
+            if (!rebuild && std::find(_movedModels.begin(), _movedModels.end(), instance.model) !=
+                            _movedModels.end()) {
+                _movedBounds.push_back(_instanceBounds[i]);
+                _movedBounds.push_back(bounds);
+                if (instance.model->dynamic) {
+                    _dynamicCasterMoved = true;
+                } else {
+                    _movedStaticBounds.push_back(_instanceBounds[i]);
+                    _movedStaticBounds.push_back(bounds);
+                }
+            }
+
+            _instanceBounds[i] = bounds;
+            _drawBounds.add(worldBounds);
+        }
+
+        if (rebuild) {
+            _bvh.build(_instanceBounds);
+            _instanceVersion = _modelManager->version;
+            _shadowCacheInvalid = true;
+            if (_pickedInstance >= _instances.size()) {
+                _pickedInstance = UINT32_MAX;
+            }
+        } else {
+            _bvh.refit(_instanceBounds);
+        }
+    }
+
+    void Renderer::cull_instances(const Frustum *frustum, const glm::vec3 &center, float radius,
+                                  uint32_t &visibleCount) {
+        _visible.assign(_instances.size(), 0);
+        if (_cullMode == CULL_NONE) {
+            _visible.assign(_instances.size(), 1);
+            visibleCount = (uint32_t) _instances.size();
+        } else if (_cullMode == CULL_LINEAR) {
+            visibleCount = (uint32_t) (frustum ? _drawBounds.cull_frustum(*frustum, _visible)
+                                               : _drawBounds.cull_sphere(center, radius, _visible));
+        } else {
+            _queryResults.clear();
+            _bvhNodesVisited += frustum ? _bvh.query_frustum(*frustum, _queryResults)
+                                        : _bvh.query_sphere(center, radius, _queryResults);
+            for (uint32_t index: _queryResults) {
+                _visible[index] = 1;
+            }
+            visibleCount = (uint32_t) _queryResults.size();
+        }
+    }
+
+    void Renderer::select_lods() {
+        // pixels covered by one world unit at distance one
+        float pixelScale = _flyCamera->projection[1][1] * (float) _windowHeight * 0.5f;
+        std::fill(std::begin(_lodCounts), std::end(_lodCounts), 0);
+        for (size_t i = 0; i < _instances.size(); i++) {
+            DrawInstance &instance = _instances[i];
+            const Mesh *mesh = instance.mesh;
+            uint32_t lod = 0;
+            if (_forcedLod >= 0) {
+                lod = std::min((uint32_t) _forcedLod, mesh->lodCount - 1);
+            } else if (mesh->lodCount > 1) {
+                // errors are in mesh units, scale them like the bounds and measure from the nearest point
+                glm::mat4 transform = instance.model->get_world_transform(mesh->node);
+                float worldScale = std::max(glm::length(glm::vec3(transform[0])),
+                                            std::max(glm::length(glm::vec3(transform[1])),
+                                                     glm::length(glm::vec3(transform[2]))));
+                const AABB &bounds = _instanceBounds[i];
+                float distance = glm::length(bounds.center() - _flyCamera->position) - glm::length(bounds.extent());
+                distance = std::max(distance, 0.001f);
+                for (uint32_t level = mesh->lodCount - 1; level > 0; level--) {
+                    float threshold = _lodErrorPixels * (level > instance.lod ? 1.0f - _lodHysteresis : 1.0f);
+                    if (mesh->lods[level].error * worldScale * pixelScale / distance <= threshold) {
+                        lod = level;
+                        break;
+                    }
+                }
+            }
+
+            // a cached shadow drawn with the old level has to be redrawn
+            if (lod != instance.lod) {
+                if (instance.model->dynamic) {
+                    _dynamicCasterMoved = true;
+                } else {
+                    _movedStaticBounds.push_back(_instanceBounds[i]);
+                }
+                instance.lod = lod;
+            }
+        }
+    }
+
+    void Renderer::build_draws() {
+        PROFILE_ZONE("Renderer::build_draws");
+        update_instances();
+        // lights are spawned inside the instance bounds
+        update_point_lights();
+        select_lods();
+        _sceneTriangles = 0;
+        _shadowTriangles = 0;
+        _atlasTriangles = 0;
+        _prepassTriangles = 0;
+        _meshletsTested = 0;
+        _meshletsFrustumCulled = 0;
+        _meshletsBackfaceCulled = 0;
+        _meshletTrianglesTested = 0;
+        _meshletTrianglesRejected = 0;
+
+        _drawCommands.clear();
+        _drawData.clear();
+        _drawBatches.clear();
+        _bvhNodesVisited = 0;
+        auto cullTimerStart = std::chrono::high_resolution_clock::now();
+
+        // main pass, camera frustum
+        glm::mat4 view = _flyCamera->get_view_matrix();
+        glm::mat4 viewProj = _flyCamera->projection * view;
+        Frustum frustum = Frustum::from_matrix(viewProj);
+        cull_instances(&frustum, glm::vec3(0.0f), 0.0f, _cullVisible);
+        _occlusionTime = 0.0;
+        if (occlusionCulling && _cullMode != CULL_NONE) {
+            cull_occluded(viewProj);
+        }
+
+        // sorted by state, then front to back so early depth testing rejects more inside each batch
+        _renderQueue.clear();
+        _prepassQueue.clear();
+        if (depthPrepass) {
+            _instanceCommands.assign(_instances.size(), {0, 0});
+        }
+        float depthScale = 1.0f / _flyCamera->get_far();
+        for (uint32_t i = 0; i < (uint32_t) _instances.size(); i++) {
+            if (!_visible[i]) {
+                continue;
+            }
+            const DrawInstance &instance = _instances[i];
+            float depth = -(view * glm::vec4(_instanceBounds[i].center(), 1.0f)).z * depthScale;
+            uint32_t geometry = instance.mesh->geometry.indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+            _renderQueue.push(make_render_key(RENDER_PASS_OPAQUE, instance.shaderId, instance.materialId, geometry,
+                                              depth), i);
+            if (depthPrepass) {
+                _prepassQueue.push(make_render_key(RENDER_PASS_DEPTH_PREPASS, 0, 0, geometry, depth), i);
+            }
+        }
+        _renderQueue.sort();
+        _prepassQueue.sort();
+
+        for (const RenderItem &item: _renderQueue.items()) {
+            uint32_t i = item.instance;
+            const DrawInstance &instance = _instances[i];
+            GLenum indexType = instance.mesh->geometry.indexType;
+            bool newBatch = _drawBatches.empty() || _drawBatches.back().shader != instance.shader ||
+                            _drawBatches.back().indexType != indexType ||
+                            _drawBatches.back().texturePools != instance.texturePools;
+            auto first = (uint32_t) _drawCommands.size();
+
+            DrawData drawData = make_draw_data(instance);
+            uint32_t added = 1;
+            if (_meshletCulling && _cullMode != CULL_NONE && instance.lod == 0 && !instance.mesh->meshlets.empty()) {
+                bool inside = frustum.classify(_instanceBounds[i]) == CullResult::Inside;
+                added = add_meshlet_draws(instance, viewProj, inside, drawData);
+            } else {
+                _drawData.push_back(drawData);
+                _drawCommands.push_back(instance.mesh->get_draw_command(instance.lod));
+            }
+            if (added == 0) {
+                continue;
+            }
+            if (depthPrepass) {
+                _instanceCommands[i] = {first, added};
+            }
+            if (newBatch) {
+                _drawBatches.push_back({instance.shader, instance.drawOffset, indexType, instance.texturePools, first,
+                                        0});
+            }
+            _drawBatches.back().count += added;
+            _lodCounts[instance.lod]++;
+        }
+
+        // the pre-pass draws exactly the scene commands, so every depth it writes is matched by the scene pass;
+        // its queue ignores state, so 16-bit index draws come first and each index type runs front to back
+        _prepassRange = DrawRange{};
+        _prepassRange.first = (uint32_t) _drawCommands.size();
+        for (const RenderItem &item: _prepassQueue.items()) {
+            auto commands = _instanceCommands[item.instance];
+            for (uint32_t command = commands.first; command < commands.first + commands.second; command++) {
+                DrawCommand drawCommand = _drawCommands[command];
+                DrawData drawData = _drawData[command];
+                _drawCommands.push_back(drawCommand);
+                _drawData.push_back(drawData);
+            }
+            if (_instances[item.instance].mesh->geometry.indexType == GL_UNSIGNED_SHORT) {
+                _prepassRange.shortCount += commands.second;
+            }
+        }
+        _prepassRange.count = (uint32_t) _drawCommands.size() - _prepassRange.first;
+
+        build_atlas_draws();
+        build_shadow_draws();
+
+        std::chrono::duration<double, std::milli> cullDuration =
+                std::chrono::high_resolution_clock::now() - cullTimerStart;
+        _cullTime = cullDuration.count();
+    }
+
+    void Renderer::cull_occluded(const glm::mat4 &viewProj) {
+        PROFILE_ZONE("Renderer::cull_occluded");
+        auto occlusionTimerStart = std::chrono::high_resolution_clock::now();
+        _occlusionCuller.begin(viewProj);
+        for (size_t i = 0; i < _instances.size(); i++) {
+            const Mesh *mesh = _instances[i].mesh;
+            if (!_visible[i] || mesh->occluderIndices.empty()) {
+                continue;
+            }
+            _occlusionCuller.rasterize(mesh->occluderPositions.data(), mesh->occluderPositions.size(),
+                                       mesh->occluderIndices.data(), mesh->occluderIndices.size(),
+                                       _instances[i].model->get_world_transform(mesh->node));
+        }
+        _occlusionCuller.build_pyramid();
+
+        // occluders are tested too, their bounds are always nearer than their own surface
+        for (size_t i = 0; i < _instances.size(); i++) {
+            if (_visible[i] && _occlusionCuller.is_occluded(_instanceBounds[i])) {
+                _visible[i] = 0;
+                _cullVisible--;
+            }
+        }
+        std::chrono::duration<double, std::milli> occlusionDuration =
+                std::chrono::high_resolution_clock::now() - occlusionTimerStart;
+        _occlusionTime = occlusionDuration.count();
+    }
+
+    DrawData Renderer::make_draw_data(const DrawInstance &instance) {
+        DrawData drawData{};
+        drawData.model = instance.model->get_world_transform(instance.mesh->node);
+        drawData.positionScale = glm::vec4(instance.mesh->bounds.extent, 0.0f);
+        drawData.positionOffset = glm::vec4(instance.mesh->bounds.center, 1.0f);
+        drawData.materialIndex = instance.materialId;
+        return drawData;
+    }
+
+    uint32_t Renderer::add_meshlet_draws(const DrawInstance &instance, const glm::mat4 &viewProj, bool insideFrustum,
+                                         const DrawData &drawData) {
+        // test in mesh space, so only the frustum and the camera need transforming
+        const Mesh *mesh = instance.mesh;
+        Frustum localFrustum = Frustum::from_matrix(viewProj * drawData.model);
+        // a mirroring transform swaps which side of the triangles faces the camera
+        bool coneCulling = glm::determinant(drawData.model) > 0.0f;
+        glm::vec3 localCamera = glm::vec3(glm::inverse(drawData.model) * glm::vec4(_flyCamera->position, 1.0f));
+
+        DrawCommand baseCommand = mesh->get_draw_command(0);
+        uint32_t added = 0;
+        bool extending = false;
+        for (const Meshlet &meshlet: mesh->meshlets) {
+            _meshletsTested++;
+            _meshletTrianglesTested += meshlet.indexCount / 3;
+            bool visible = true;
+            if (!insideFrustum && !localFrustum.intersects_sphere(meshlet.center, meshlet.radius)) {
+                _meshletsFrustumCulled++;
+                visible = false;
+            } else if (coneCulling && meshlet_backfacing(meshlet.center, meshlet.radius, meshlet.coneAxis,
+                                                         meshlet.coneCutoff, localCamera)) {
+                _meshletsBackfaceCulled++;
+                visible = false;
+            }
+            if (!visible) {
+                _meshletTrianglesRejected += meshlet.indexCount / 3;
+                extending = false;
+                continue;
+            }
+
+            // meshlets are consecutive in the index buffer, so a run of visible ones is one command
+            if (extending) {
+                _drawCommands.back().count += meshlet.indexCount;
+                continue;
+            }
+            DrawCommand command = baseCommand;
+            command.firstIndex += meshlet.indexOffset;
+            command.count = meshlet.indexCount;
+            _drawCommands.push_back(command);
+            _drawData.push_back(drawData);
+            extending = true;
+            added++;
+        }
+        return added;
+    }
+
+    void Renderer::add_shadow_range(DrawRange &range) {
+        range.first = (uint32_t) _drawCommands.size();
+        for (GLenum indexType: {GL_UNSIGNED_SHORT, GL_UNSIGNED_INT}) {
+            for (size_t i = 0; i < _instances.size(); i++) {
+                if (!_visible[i] || _instances[i].mesh->geometry.indexType != indexType) {
+                    continue;
+                }
+                _drawData.push_back(make_draw_data(_instances[i]));
+                _drawCommands.push_back(_instances[i].mesh->get_draw_command(_instances[i].lod));
+            }
+            if (indexType == GL_UNSIGNED_SHORT) {
+                range.shortCount = (uint32_t) _drawCommands.size() - range.first;
+            }
+        }
+        range.count = (uint32_t) _drawCommands.size() - range.first;
+    }
+
+    void Renderer::build_atlas_draws() {
+        float pixelScale = _flyCamera->projection[1][1] * (float) _windowHeight * 0.5f;
+        Frustum frustum = Frustum::from_matrix(_flyCamera->projection * _flyCamera->get_view_matrix());
+        _shadowAtlas->schedule(_pointLights, frustum, _flyCamera->position, pixelScale,
+                               (uint32_t) _shadowedLightCount, _shadowAtlasBudget, _movedBounds,
+                               _shadowCacheInvalid);
+
+        // every caster goes into every face it touches, the face frustum ends at the light radius
+        _atlasRanges.clear();
+        for (auto &refresh: _shadowAtlas->get_refreshes()) {
+            for (auto &faceMatrix: refresh.faceMatrices) {
+                Frustum faceFrustum = Frustum::from_matrix(faceMatrix);
+                uint32_t casterCount = 0;
+                cull_instances(&faceFrustum, glm::vec3(0.0f), 0.0f, casterCount);
+                _atlasRanges.emplace_back();
+                add_shadow_range(_atlasRanges.back());
+            }
+        }
+    }
+
+    void Renderer::build_shadow_draws() {
+        // moving the light, switching modes or changing the caster set dirties every face
+        bool lightMoved = !std::equal(std::begin(_prevLightPos), std::end(_prevLightPos), std::begin(_lightPos));
+        bool invalidated = lightMoved || _shadowMode != _prevShadowMode || _shadowCacheInvalid;
+        std::copy(std::begin(_lightPos), std::end(_lightPos), std::begin(_prevLightPos));
+        _prevShadowMode = _shadowMode;
+        _shadowCacheInvalid = false;
+        if (invalidated) {
+            std::fill(std::begin(_shadowFaceDirty), std::end(_shadowFaceDirty), true);
+            _dynamicInstances.clear();
+            for (uint32_t i = 0; i < (uint32_t) _instances.size(); i++) {
+                if (_instances[i].model->dynamic) {
+                    _dynamicInstances.push_back(i);
+                }
+            }
+        }
+
+        // a moved static caster dirties the faces it left and the ones it entered
+        Frustum faceFrusta[6];
+        for (unsigned int face = 0; face < 6; face++) {
+            faceFrusta[face] = Frustum::from_matrix(_shadowMatrices[face]);
+            for (auto &bounds: _movedStaticBounds) {
+                if (faceFrusta[face].classify(bounds) != CullResult::Outside) {
+                    _shadowFaceDirty[face] = true;
+                }
+            }
+        }
+
+        std::fill(std::begin(_refreshShadowFace), std::end(_refreshShadowFace), false);
+        std::fill(std::begin(_compositeShadowFace), std::end(_compositeShadowFace), false);
+        _shadowCount = 0;
+        _shadowFacesRefreshed = 0;
+        _shadowFacesComposited = 0;
+
+        if (_shadowMode == SHADOW_GEOMETRY_SHADER) {
+            // no cache, all six faces are redrawn in one pass whenever anything changed
+            bool anyDirty = std::find(std::begin(_shadowFaceDirty), std::end(_shadowFaceDirty), true) !=
+                            std::end(_shadowFaceDirty);
+            _shadowPassNeeded = anyDirty || _dynamicCasterMoved;
+            std::fill(std::begin(_shadowFaceDirty), std::end(_shadowFaceDirty), false);
+            if (!_shadowPassNeeded) {
+                return;
+            }
+            glm::vec3 lightPos = glm::vec3(_lightPos[0], _lightPos[1], _lightPos[2]);
+            uint32_t casterCount = 0;
+            cull_instances(nullptr, lightPos, std::min(_lightRadius, _shadowFar), casterCount);
+            add_shadow_range(_shadowRanges[0]);
+            _shadowCount = _shadowRanges[0].count;
+            _shadowFacesRefreshed = 6;
+            return;
+        }
+
+        // refresh at most the budgeted number of dirty faces in the static cache, round robin so
+        // every face gets its turn; after an invalidation the cached faces hold depth for the old light (or
+        // nothing at all on the first frame), so all six are redrawn at once and the budget only spreads out
+        // the faces dirtied by moving casters
+        unsigned int startFace = _nextShadowFace;
+        for (unsigned int i = 0; i < 6 && (invalidated || _shadowFacesRefreshed < (uint32_t) _shadowFaceBudget); i++) {
+            unsigned int face = (startFace + i) % 6;
+            if (!_shadowFaceDirty[face]) {
+                continue;
+            }
+            _shadowFaceDirty[face] = false;
+            _refreshShadowFace[face] = true;
+            _shadowFacesRefreshed++;
+            _nextShadowFace = (face + 1) % 6;
+
+            // only static casters go into the cache
+            uint32_t casterCount = 0;
+            cull_instances(&faceFrusta[face], glm::vec3(0.0f), 0.0f, casterCount);
+            for (uint32_t index: _dynamicInstances) {
+                _visible[index] = 0;
+            }
+            add_shadow_range(_shadowRanges[face]);
+            _shadowCount += _shadowRanges[face].count;
+        }
+
+        // dynamic casters are few, test them directly against each face; a face is recomposited when its
+        // cache changed or when dynamic casters on it (now or last time) may have moved
+        bool dynamicChanged = _dynamicCasterMoved || invalidated;
+        for (unsigned int face = 0; face < 6; face++) {
+            _visible.assign(_instances.size(), 0);
+            for (uint32_t index: _dynamicInstances) {
+                if (faceFrusta[face].classify(_instanceBounds[index]) != CullResult::Outside) {
+                    _visible[index] = 1;
+                }
+            }
+            add_shadow_range(_dynamicShadowRanges[face]);
+            _shadowCount += _dynamicShadowRanges[face].count;
+
+            bool hasDynamic = _dynamicShadowRanges[face].count > 0;
+            _compositeShadowFace[face] = _refreshShadowFace[face] ||
+                                         ((hasDynamic || _shadowFaceHadDynamic[face]) && dynamicChanged);
+            _shadowFaceHadDynamic[face] = hasDynamic;
+            if (_compositeShadowFace[face]) {
+                _shadowFacesComposited++;
+            }
+        }
+        _shadowPassNeeded = _shadowFacesComposited > 0;
+    }
+
+    void Renderer::pick(int x, int y) {
+        // unproject the cursor at the near and far planes
+        float ndcX = 2.0f * (float) x / (float) _windowWidth - 1.0f;
+        float ndcY = 1.0f - 2.0f * (float) y / (float) _windowHeight;
+        glm::mat4 invViewProj = glm::inverse(_flyCamera->projection * _flyCamera->get_view_matrix());
+        glm::vec4 nearPoint = invViewProj * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+        glm::vec4 farPoint = invViewProj * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 rayEnd = glm::vec3(farPoint) / farPoint.w;
+
+        uint32_t instance = 0;
+        float distance = 0.0f;
+        if (_bvh.raycast(origin, glm::normalize(rayEnd - origin), glm::length(rayEnd - origin), instance, distance)) {
+            _pickedInstance = instance;
+        } else {
+            _pickedInstance = UINT32_MAX;
+        }
+        _pickChanged = true;
+    }
+
+    void Renderer::upload_draws() {
+        PROFILE_ZONE("Renderer::upload_draws");
+        if (_drawCommands.empty()) {
+            return;
+        }
+
+        size_t drawDataSize = _drawData.size() * sizeof(DrawData);
+        _drawBuffer->reserve(drawDataSize);
+        _drawBuffer->update(_drawData.data(), drawDataSize);
+
+        size_t commandSize = _drawCommands.size() * sizeof(DrawCommand);
+        if (commandSize > _indirectBufferSize) {
+            _indirectBufferSize = commandSize;
+            glNamedBufferData(_indirectBuffer, (GLsizeiptr) _indirectBufferSize, nullptr, GL_DYNAMIC_DRAW);
+        }
+        glNamedBufferSubData(_indirectBuffer, 0, (GLsizeiptr) commandSize, _drawCommands.data());
     }
 
     void Renderer::update_ui() {
+        PROFILE_ZONE("Renderer::update_ui");
         // frametime plot
         static ScrollingBuffer sdata;
         static float t = 0;
@@ -85,6 +788,10 @@ namespace GLRenderer {
         ImGui::Begin("Frametime Plot", nullptr, windowFlags);
         ImGui::PushItemWidth(500);
         ImGui::SliderFloat("##History", &history, 1, 15, "%.1f s");
+        ImGui::Text("Uniform calls: %u issued, %u skipped", _uniformStats.issued, _uniformStats.skipped);
+        ImGui::Text("Draw calls: %u, binds: %u program, %u texture, %u VAO, %u framebuffer, %u skipped",
+                    _glStateStats.drawCalls, _glStateStats.programBinds, _glStateStats.textureBinds,
+                    _glStateStats.vaoBinds, _glStateStats.framebufferBinds, _glStateStats.skipped);
 
         if (ImPlot::BeginPlot("##Frametime Plot", ImVec2(500, 150))) {
             ImPlot::SetupAxes(nullptr, nullptr);
@@ -95,6 +802,55 @@ namespace GLRenderer {
                              2 * sizeof(float));
             ImPlot::EndPlot();
         }
+
+        // one point per frame with results, passes that did not run that frame count as 0
+        const GpuFrame &gpuFrame = _gpuProfiler->get_last_frame();
+        if (gpuFrame.frame != _gpuPlottedFrame && !gpuFrame.zones.empty()) {
+            _gpuPlottedFrame = gpuFrame.frame;
+            for (auto &zone: gpuFrame.zones) {
+                if (zone.depth > 1) {
+                    continue;
+                }
+                auto known = std::find_if(_gpuPassHistory.begin(), _gpuPassHistory.end(),
+                                          [&zone](const auto &pass) { return strcmp(pass.first, zone.name) == 0; });
+                if (known == _gpuPassHistory.end()) {
+                    _gpuPassHistory.emplace_back(zone.name, ScrollingBuffer());
+                }
+            }
+            for (auto &pass: _gpuPassHistory) {
+                pass.second.AddPoint(t, (float) gpuFrame.get_time(pass.first));
+            }
+        }
+        ImGui::Text("GPU: %.3f ms, results %llu frames behind, %u dropped", gpuFrame.get_time("Frame"),
+                    (unsigned long long) (_gpuPlottedFrame == UINT64_MAX ? 0 : _gpuProfiler->get_frame_index() - _gpuPlottedFrame),
+                    _gpuProfiler->get_dropped_frames());
+        if (ImPlot::BeginPlot("##GPU Pass Plot", ImVec2(500, 150))) {
+            ImPlot::SetupAxes(nullptr, nullptr);
+            ImPlot::SetupAxisLimits(ImAxis_X1, t - history, t, ImGuiCond_Always);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, 0, 5);
+            for (auto &pass: _gpuPassHistory) {
+                ImPlot::PlotLine(pass.first, &pass.second.Data[0].x, &pass.second.Data[0].y, pass.second.Data.size(),
+                                 0, pass.second.Offset, 2 * sizeof(float));
+            }
+            ImPlot::EndPlot();
+        }
+        if (_gpuTraceRequested && !_gpuProfiler->is_capturing()) {
+            _gpuTraceRequested = false;
+            if (_gpuProfiler->write_trace("gpu_trace.json")) {
+                std::cout << "GPU trace written to gpu_trace.json" << std::endl;
+            }
+        }
+        if (ImGui::Button(_gpuTraceRequested ? "Capturing..." : "Capture GPU Trace") && !_gpuTraceRequested) {
+            _gpuProfiler->start_capture(GPU_TRACE_FRAMES);
+            _gpuTraceRequested = true;
+        }
+#ifdef ENABLE_CPU_PROFILER
+        ImGui::SameLine();
+        if (ImGui::Button(CpuProfiler::is_capturing() ? "Capturing...##CPU" : "Capture CPU Trace") &&
+            !CpuProfiler::is_capturing()) {
+            CpuProfiler::start_capture(GPU_TRACE_FRAMES, "cpu_trace.json");
+        }
+#endif
         ImGui::End();
 
         // scene editor
@@ -109,109 +865,467 @@ namespace GLRenderer {
         ImGui::DragFloat3("Light Position", _lightPos, 1.0f, 0.0f, 0.0f, "%.1f");
         ImGui::ColorEdit3("Light Color", _lightColor);
         ImGui::DragFloat("Gamma", &_gamma, 0.1f, 0.0f, 10.0f, "%.1f");
+        ImGui::DragFloat("Exposure", &_exposure, 0.05f, 0.0f, 16.0f, "%.2f");
         ImGui::DragFloat("Shadow Bias", &_shadowBias, 0.01f, 0.0f, 10.0f, "%.2f");
+        ImGui::Combo("Culling", &_cullMode, "None\0Linear (SIMD)\0BVH\0");
+        ImGui::Text("Meshes: %zu tested, %u visible, %u shadow casters", _instances.size(), _cullVisible, _shadowCount);
+        ImGui::SliderInt("Force LOD", &_forcedLod, -1, (int) MAX_LOD_COUNT - 1, _forcedLod < 0 ? "Auto" : "%d");
+        ImGui::SliderFloat("LOD Error (px)", &_lodErrorPixels, 0.25f, 16.0f, "%.2f");
+        ImGui::Text("LOD usage: %u %u %u %u", _lodCounts[0], _lodCounts[1], _lodCounts[2], _lodCounts[3]);
+        ImGui::Text("Triangles: %llu scene, %llu shadow", (unsigned long long) _sceneTriangles,
+                    (unsigned long long) _shadowTriangles);
+        ImGui::Checkbox("Meshlet Culling", &_meshletCulling);
+        ImGui::Text("Meshlets: %u tested, %u off-frustum, %u backfacing", _meshletsTested, _meshletsFrustumCulled,
+                    _meshletsBackfaceCulled);
+        ImGui::Text("Meshlet triangles rejected: %.1f%%", _meshletTrianglesTested > 0 ?
+                    100.0 * (double) _meshletTrianglesRejected / (double) _meshletTrianglesTested : 0.0);
+        ImGui::Text("BVH: %zu nodes, %u visited, culling %.3f ms", _bvh.node_count(), _bvhNodesVisited, _cullTime);
+        ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+        if (occlusionCulling) {
+            const OcclusionStats &occlusionStats = _occlusionCuller.get_stats();
+            ImGui::Text("Occlusion: %u of %u tested occluded, %u occluders, %llu triangles, %.3f ms",
+                        occlusionStats.occluded, occlusionStats.tested, occlusionStats.occluders,
+                        (unsigned long long) occlusionStats.occluderTriangles, _occlusionTime);
+        }
+        ImGui::Checkbox("Depth Pre-Pass", &depthPrepass);
+        ImGui::SameLine();
+        ImGui::Checkbox("Show Overdraw", &_showOverdraw);
+        const GpuFrame &lastFrame = _gpuProfiler->get_last_frame();
+        double pixels = (double) _windowWidth * (double) _windowHeight;
+        ImGui::Text("Shaded samples: %.2f per pixel, pre-pass %.3f ms, scene %.3f ms",
+                    pixels > 0.0 ? (double) _shadedSamples / pixels : 0.0, lastFrame.get_time("Depth Pre-Pass"),
+                    lastFrame.get_time("Scene"));
+        ImGui::Combo("Shadow Mode", &_shadowMode, "Geometry Shader\0Per-Face Culled\0");
+        if (_shadowMode == SHADOW_PER_FACE) {
+            ImGui::Text("Static casters per face (last refresh): %u %u %u %u %u %u", _shadowFaceCasters[0],
+                        _shadowFaceCasters[1], _shadowFaceCasters[2], _shadowFaceCasters[3], _shadowFaceCasters[4],
+                        _shadowFaceCasters[5]);
+            ImGui::Text("Dynamic casters per face: %u %u %u %u %u %u", _dynamicShadowRanges[0].count,
+                        _dynamicShadowRanges[1].count, _dynamicShadowRanges[2].count, _dynamicShadowRanges[3].count,
+                        _dynamicShadowRanges[4].count, _dynamicShadowRanges[5].count);
+        }
+        ImGui::Text("Shadow pass: %.3f ms (GPU, last redraw)", _shadowPassTime);
+        if (_shadowMode == SHADOW_PER_FACE) {
+            ImGui::SliderInt("Shadow Face Budget", &_shadowFaceBudget, 1, 6);
+            uint32_t dirtyFaces = (uint32_t) std::count(std::begin(_shadowFaceDirty), std::end(_shadowFaceDirty), true);
+            ImGui::Text("Shadow faces: %u refreshed, %u composited, %u still dirty", _shadowFacesRefreshed,
+                        _shadowFacesComposited, dirtyFaces);
+        }
+        ImGui::SliderInt("Point Lights", &pointLightCount, 0, (int) MAX_POINT_LIGHTS);
+        ImGui::DragFloat("Point Light Radius", &_pointLightRadius, 0.5f, 0.0f, 500.0f, "%.1f");
+        ImGui::DragFloat("Point Light Power", &_pointLightPower, 1.0f, 0.0f, 0.0f, "%.1f");
+        ImGui::Checkbox("Animate Point Lights", &_animatePointLights);
+        if (_lightClusters->has_compute()) {
+            ImGui::Checkbox("GPU Light Culling", &gpuLightCulling);
+        }
+        if (gpuLightCulling && _lightClusters->has_compute()) {
+            ImGui::Text("Light clusters: binned on the GPU, %.3f ms",
+                        _gpuProfiler->get_last_frame().get_time("Light Culling"));
+        } else {
+            const LightClusterStats &clusterStats = _lightClusters->get_stats();
+            ImGui::Text("Light clusters: %u of %u occupied, max %u lights, %u references, %u dropped",
+                        clusterStats.occupiedClusters, CLUSTER_COUNT, clusterStats.maxClusterLights,
+                        clusterStats.lightReferences, clusterStats.overflow);
+            ImGui::Text("Light binning: %.3f ms", _lightBinTime);
+        }
+        ImGui::SliderInt("Shadowed Lights", &_shadowedLightCount, 0, (int) MAX_SHADOWED_LIGHTS);
+        ImGui::SliderFloat("Atlas Budget (ms)", &_shadowAtlasBudget, 0.1f, 8.0f, "%.1f");
+        const ShadowAtlasStats &atlasStats = _shadowAtlas->get_stats();
+        ImGui::Text("Shadow atlas: %u lights, %.1f%% occupied, faces %u x1024 %u x512 %u x256 %u x128",
+                    atlasStats.shadowedLights, 100.0f * atlasStats.occupancy, atlasStats.tilesBySize[0],
+                    atlasStats.tilesBySize[1], atlasStats.tilesBySize[2], atlasStats.tilesBySize[3]);
+        ImGui::Text("Atlas updates: %u of %u stale lights, %.3f ms GPU, %.3f ms estimated (%.3f ms per face)",
+                    atlasStats.refreshedLights, atlasStats.staleLights,
+                    _gpuProfiler->get_last_frame().get_time("Shadow Atlas"), atlasStats.estimatedCost,
+                    _shadowAtlas->get_face_cost());
+        Model *pickedModel = _pickedInstance < _instances.size() ? _instances[_pickedInstance].model : nullptr;
+        TextureManager *textureManager = _modelManager->textureManager;
+        GeometryPool *geometryPool = _modelManager->geometryPool;
+        ImGui::Text("Vertices: %zu, %.1f MB (%.1f MB unpacked)", geometryPool->get_vertex_count(),
+                    (double) geometryPool->get_vertex_bytes() / (1024.0 * 1024.0),
+                    (double) geometryPool->get_unpacked_vertex_bytes() / (1024.0 * 1024.0));
+        ImGui::Text("Indices: %zu, %.1f MB", geometryPool->get_index_count(),
+                    (double) geometryPool->get_index_bytes() / (1024.0 * 1024.0));
+        ImGui::Text("Textures: %zu resident, %.1f / %.1f MB", textureManager->get_texture_count(),
+                    (double) textureManager->get_resident_bytes() / (1024.0 * 1024.0),
+                    (double) textureManager->get_budget() / (1024.0 * 1024.0));
+        ImGui::Text("Texture pools: %u of %u, %.1f MB allocated, %s", textureManager->get_pools()->get_pool_count(),
+                    MAX_TEXTURE_POOLS, (double) textureManager->get_pools()->get_bytes() / (1024.0 * 1024.0),
+                    _bindless ? "bindless" : "bound");
+        if (textureManager->get_resized_texture_count() > 0 || textureManager->get_unpooled_texture_count() > 0) {
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Texture pools full: %u resized, %u using default",
+                               textureManager->get_resized_texture_count(),
+                               textureManager->get_unpooled_texture_count());
+        }
+        ImGui::Text("Materials: %zu, scene batches: %zu", _materials.size(), _drawBatches.size());
+        if (ImGui::DragInt("Texture Budget (MB)", &textureBudgetMB, 16.0f, 0, 65536)) {
+            textureManager->set_budget((size_t) textureBudgetMB * 1024 * 1024);
+        }
         for (auto &it: _modelManager->models) {
+            // open the picked model's node once
+            if (_pickChanged) {
+                ImGui::SetNextItemOpen(&it.second == pickedModel);
+            }
             if (ImGui::TreeNode(it.first.c_str())) {
-                ImGui::DragFloat3("Translation", it.second.translation, 1.0f, 0.0f, 0.0f, "%.1f");
-                ImGui::DragFloat3("Rotation", it.second.rotation, 1.0f, -360.0f, 360.0f, "%.1f deg");
-                ImGui::DragFloat3("Scale", it.second.scale, 1.0f, 0.0f, 0.0f, "%.1f");
+                // edits only mark the model dirty, its nodes are updated once per frame
+                bool edited = ImGui::DragFloat3("Translation", it.second.translation, 1.0f, 0.0f, 0.0f, "%.1f");
+                edited |= ImGui::DragFloat3("Rotation", it.second.rotation, 1.0f, -360.0f, 360.0f, "%.1f deg");
+                edited |= ImGui::DragFloat3("Scale", it.second.scale, 1.0f, 0.0f, 0.0f, "%.1f");
+                if (edited) {
+                    it.second.mark_transform_dirty();
+                }
+                // triangle weighted, so small meshes do not dominate
+                double missCount = 0.0;
+                size_t triangleCount = 0;
+                for (auto &mesh: it.second.meshes) {
+                    missCount += (double) mesh.acmr * (mesh.geometry.indexCount / 3);
+                    triangleCount += mesh.geometry.indexCount / 3;
+                }
+                ImGui::Text("%zu nodes, %zu meshes, %zu triangles, ACMR %.3f", it.second.node_count(),
+                            it.second.meshes.size(), triangleCount,
+                            triangleCount > 0 ? missCount / (double) triangleCount : 0.0);
+                if (ImGui::Checkbox("Dynamic Shadow Caster", &it.second.dynamic)) {
+                    _shadowCacheInvalid = true;
+                }
                 ImGui::TreePop();
             }
         }
+        _pickChanged = false;
         ImGui::End();
     }
 
     void Renderer::draw(double delta) {
+        PROFILE_FRAME();
+        PROFILE_ZONE("Renderer::draw");
         _delta = delta;
-        update_ui();
-        ImGui::Render();
 
-        // only re-render the shadow map if the light position updated
-        if(!std::equal(std::begin(_prevLightPos), std::end(_prevLightPos), std::begin(_lightPos))) {
+        // show the previous frame's uniform and state counts
+        _uniformStats = Shader::stats;
+        Shader::reset_stats();
+        _glStateStats = _glState.take_stats();
+        // ImGui and texture uploads bind behind the cache's back
+        _glState.invalidate();
+
+        _gpuProfiler->begin_frame();
+        // the atlas cost model learns from frames as their GPU times arrive
+        const GpuFrame &lastGpuFrame = _gpuProfiler->get_last_frame();
+        if (lastGpuFrame.frame != _atlasCostFrame && !lastGpuFrame.zones.empty()) {
+            _atlasCostFrame = lastGpuFrame.frame;
+            _shadowAtlas->record_cost(lastGpuFrame.get_time("Shadow Atlas"),
+                                      _atlasFaceHistory[lastGpuFrame.frame % std::size(_atlasFaceHistory)]);
+        }
+        collect_sample_queries();
+        // the shadow time shown is from the last frame that redrew it
+        double shadowTime = _gpuProfiler->get_last_frame().get_time("Shadow");
+        if (shadowTime > 0.0) {
+            _shadowPassTime = shadowTime;
+        }
+
+        if (drawUI) {
+            update_ui();
+            ImGui::Render();
+        }
+        update_uniform_buffers();
+        build_draws();
+        {
+            GpuZoneScope zone(_gpuProfiler, "Light Culling");
+            bin_point_lights();
+        }
+        {
+            GpuZoneScope zone(_gpuProfiler, "Upload");
+            upload_draws();
+        }
+
+        // only touch the shadow map when a face was refreshed or dynamic casters need recompositing
+        if (_shadowPassNeeded) {
+            GpuZoneScope zone(_gpuProfiler, "Shadow");
             draw_shadow_map();
         }
-        draw_scene();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        _atlasFaceHistory[_gpuProfiler->get_frame_index() % std::size(_atlasFaceHistory)] =
+                (uint32_t) _atlasRanges.size();
+        if (!_atlasRanges.empty()) {
+            GpuZoneScope zone(_gpuProfiler, "Shadow Atlas");
+            draw_shadow_atlas();
+        }
+        if (depthPrepass) {
+            GpuZoneScope zone(_gpuProfiler, "Depth Pre-Pass");
+            draw_depth_prepass();
+        }
+        {
+            GpuZoneScope zone(_gpuProfiler, "Scene");
+            draw_scene();
+        }
+        if (drawUI) {
+            GpuZoneScope zone(_gpuProfiler, "UI");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        _gpuProfiler->end_frame();
+    }
 
-        // store the light position
-        std::copy(std::begin(_lightPos), std::end(_lightPos), std::begin(_prevLightPos));
+    void Renderer::collect_gpu_timings() {
+        _gpuProfiler->collect();
+        collect_sample_queries();
+        double shadowTime = _gpuProfiler->get_last_frame().get_time("Shadow");
+        if (shadowTime > 0.0) {
+            _shadowPassTime = shadowTime;
+        }
+    }
+
+    FrameStats Renderer::get_frame_stats() const {
+        FrameStats stats{};
+        stats.cullTime = _cullTime;
+        stats.shadowPassTime = _shadowPassTime;
+        stats.gpu = _gpuProfiler->get_last_frame();
+        stats.glState = _glStateStats;
+        stats.sceneTriangles = _sceneTriangles;
+        stats.shadowTriangles = _shadowTriangles;
+        stats.drawCommands = (uint32_t) _drawCommands.size();
+        stats.visibleMeshes = _cullVisible;
+        stats.lightBinTime = _lightBinTime;
+        stats.lightClusters = _lightClusters->get_stats();
+        stats.shadowAtlas = _shadowAtlas->get_stats();
+        stats.atlasTriangles = _atlasTriangles;
+        stats.depthPrepass = depthPrepass;
+        stats.prepassTriangles = _prepassTriangles;
+        stats.shadedSamples = _shadedSamples;
+        stats.occlusion = _occlusionCuller.get_stats();
+        stats.occlusionTime = _occlusionTime;
+        return stats;
+    }
+
+    void Renderer::collect_sample_queries() {
+        for (uint32_t slot = 0; slot < GPU_PROFILER_FRAME_LAG; slot++) {
+            if (!_sampleQueryPending[slot]) {
+                continue;
+            }
+            GLuint available = 0;
+            glGetQueryObjectuiv(_sampleQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            _sampleQueryPending[slot] = false;
+            if (_sampleQueryFrames[slot] < _shadedSamplesFrame) {
+                continue;
+            }
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(_sampleQueries[slot], GL_QUERY_RESULT, &samples);
+            _shadedSamplesFrame = _sampleQueryFrames[slot];
+            _shadedSamples = samples;
+        }
     }
 
     void Renderer::draw_shadow_map() {
+        PROFILE_ZONE("Renderer::draw_shadow_map");
         // set viewport to map size and clear buffers
         glViewport(0, 0, (GLsizei) SHADOW_MAP_RES, (GLsizei) SHADOW_MAP_RES);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // create projection
-        glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float) SHADOW_MAP_RES / (float) SHADOW_MAP_RES,
-                                                _shadowNear, _shadowFar);
+        // casters draw both faces, culling is only on for the camera passes
+        _glState.enable_culling(false);
+        _glState.bind_vertex_array(_modelManager->geometryPool->depthVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
 
-        // convert light pos to glm vec3 for cleanliness
-        glm::vec3 glmLightPos = glm::vec3(_lightPos[0], _lightPos[1], _lightPos[2]);
+        if (_shadowMode == SHADOW_GEOMETRY_SHADER) {
+            // clear framebuffer's depth buffer
+            _glState.bind_framebuffer(depthMapFBO);
+            glClear(GL_DEPTH_BUFFER_BIT);
 
-        // generate transform matrices for each part of cubemap
-        std::vector<glm::mat4> shadowTransforms;
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(1.0f, 0.0f, 0.0f),
-                                                            glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(-1.0f, 0.0f, 0.0f),
-                                                            glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 1.0f, 0.0f),
-                                                            glm::vec3(0.0f, 0.0f, 1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, -1.0f, 0.0f),
-                                                            glm::vec3(0.0f, 0.0f, -1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 0.0f, 1.0f),
-                                                            glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(glmLightPos, glmLightPos + glm::vec3(0.0f, 0.0f, -1.0f),
-                                                            glm::vec3(0.0f, -1.0f, 0.0f)));
-
-        // clear framebuffer's depth buffer
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
+            // shadow matrices and light parameters come from the light buffer, the geometry shader
+            // sends every triangle to all six faces
+            _glState.use_program(_depthShader->programID);
+            _shadowTriangles += multi_draw(_depthShader, _depthDrawOffset, _shadowRanges[0]);
+        } else {
+            // each face only gets the casters inside its own frustum
+            _glState.use_program(_depthFaceShader->programID);
+            static const char *faceZoneNames[6] = {"Shadow +X", "Shadow -X", "Shadow +Y", "Shadow -Y", "Shadow +Z",
+                                                   "Shadow -Z"};
+            for (unsigned int face = 0; face < 6; face++) {
+                if (!_compositeShadowFace[face]) {
+                    continue;
+                }
+                GpuZoneScope zone(_gpuProfiler, faceZoneNames[face]);
+                _depthFaceShader->set(_depthFaceUniform, (int) face);
+
+                // static casters into the cache
+                if (_refreshShadowFace[face]) {
+                    _glState.bind_framebuffer(_staticShadowFaceFBOs[face]);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    _shadowTriangles += multi_draw(_depthFaceShader, _depthFaceDrawOffset, _shadowRanges[face]);
+                    _shadowFaceCasters[face] = _shadowRanges[face].count;
+                }
 
-        // send matrices and uniforms to depth shader
-        _depthShader->bind();
-        for (unsigned int i = 0; i < 6; i++) {
-            _depthShader->set_mat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+                // start from the cached face and draw the dynamic casters on top
+                glCopyImageSubData(_staticShadowCubemap, GL_TEXTURE_CUBE_MAP, 0, 0, 0, (GLint) face,
+                                   depthCubemap, GL_TEXTURE_CUBE_MAP, 0, 0, 0, (GLint) face,
+                                   (GLsizei) SHADOW_MAP_RES, (GLsizei) SHADOW_MAP_RES, 1);
+                _glState.bind_framebuffer(_shadowFaceFBOs[face]);
+                _shadowTriangles += multi_draw(_depthFaceShader, _depthFaceDrawOffset, _dynamicShadowRanges[face]);
+            }
         }
-        _depthShader->set_float("far_plane", _shadowFar);
-        _depthShader->set_float_vec3("lightPos", _lightPos[0], _lightPos[1], _lightPos[2]);
+    }
 
-        // draw shadows
-        glCullFace(GL_FRONT);
-        for (auto &it: _modelManager->models) {
-            it.second.update_transform();
-            it.second.draw_model_untextured(_depthShader);
+    void Renderer::draw_shadow_atlas() {
+        PROFILE_ZONE("Renderer::draw_shadow_atlas");
+        _glState.bind_framebuffer(_shadowAtlas->framebuffer);
+        _glState.enable_culling(false);
+        _glState.bind_vertex_array(_modelManager->geometryPool->depthVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+        _glState.use_program(_shadowAtlasShader->programID);
+
+        // the scissor limits the clear to the tile
+        glEnable(GL_SCISSOR_TEST);
+        const std::vector<ShadowRefresh> &refreshes = _shadowAtlas->get_refreshes();
+        for (size_t i = 0; i < refreshes.size(); i++) {
+            _shadowAtlasShader->set(_atlasLightPosition, refreshes[i].position);
+            _shadowAtlasShader->set(_atlasLightRadius, refreshes[i].radius);
+            for (unsigned int face = 0; face < 6; face++) {
+                const AtlasTile &tile = refreshes[i].faces[face];
+                glViewport((GLint) tile.x, (GLint) tile.y, (GLsizei) tile.size, (GLsizei) tile.size);
+                glScissor((GLint) tile.x, (GLint) tile.y, (GLsizei) tile.size, (GLsizei) tile.size);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                _shadowAtlasShader->set(_atlasFaceMatrix, refreshes[i].faceMatrices[face]);
+                _atlasTriangles += multi_draw(_shadowAtlasShader, _atlasDrawOffset, _atlasRanges[i * 6 + face]);
+            }
         }
+        glDisable(GL_SCISSOR_TEST);
+    }
 
-        // unbind framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    void Renderer::draw_depth_prepass() {
+        PROFILE_ZONE("Renderer::draw_depth_prepass");
+        _glState.bind_framebuffer(outputFramebuffer);
+        glViewport(0, 0, (GLsizei) _windowWidth, (GLsizei) _windowHeight);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        // positions only, from the depth VAO; back faces are culled exactly as in draw_scene, so the scene pass
+        // rasterizes the same triangles and its GL_EQUAL test passes
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        _glState.enable_culling(true);
+        _glState.cull_face(GL_BACK);
+        _glState.bind_vertex_array(_modelManager->geometryPool->depthVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+        _glState.use_program(_depthPrepassShader->programID);
+        _prepassTriangles += multi_draw(_depthPrepassShader, _prepassDrawOffset, _prepassRange);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     }
 
     void Renderer::draw_scene() {
-        // set viewport to window size and clear buffers
+        PROFILE_ZONE("Renderer::draw_scene");
+        // set viewport to window size and clear buffers, the pre-pass already filled the depth buffer
+        _glState.bind_framebuffer(outputFramebuffer);
         glViewport(0, 0, (GLsizei) _windowWidth, (GLsizei) _windowHeight);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(depthPrepass ? GL_COLOR_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (depthPrepass) {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        if (_showOverdraw) {
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        // a query still in flight is skipped rather than waited on
+        auto querySlot = (uint32_t) (_gpuProfiler->get_frame_index() % GPU_PROFILER_FRAME_LAG);
+        bool countSamples = !_sampleQueryPending[querySlot];
+        if (countSamples) {
+            glBeginQuery(GL_SAMPLES_PASSED, _sampleQueries[querySlot]);
+        }
 
-        // set uniforms for each model and draw
-        glCullFace(GL_BACK);
-        for (auto &it: _modelManager->models) {
-            it.second._modelShader->bind();
-            it.second._modelShader->set_mat4("matrix_viewproj", _flyCamera->projection * _flyCamera->get_view_matrix());
-            it.second._modelShader->set_glm_vec3("camPos", _flyCamera->position);
-            it.second._modelShader->set_float("lightRadius", _lightRadius);
-            it.second._modelShader->set_float("lightPower", _lightPower);
-            it.second._modelShader->set_float_vec3("lightColor", _lightColor[0], _lightColor[1], _lightColor[2]);
-            it.second._modelShader->set_float("far_plane", _shadowFar);
-            it.second._modelShader->set_float_vec3("lightPos", _lightPos[0], _lightPos[1], _lightPos[2]);
-            it.second._modelShader->set_float("gamma", _gamma);
-            it.second._modelShader->set_float("shadowBias", _shadowBias);
-            it.second.update_transform();
-            it.second.draw_model(depthCubemap);
+        // per-frame, light and per-draw data are already in their buffers, only textures change per batch
+        // batches are in render key order, so consecutive ones mostly share the program and some textures
+        // back faces are culled by the rasterizer, so meshlet cone culling only drops triangles that would be
+        // culled anyway and both paths give the same image
+        _glState.enable_culling(true);
+        _glState.cull_face(GL_BACK);
+        _glState.bind_vertex_array(_modelManager->geometryPool->VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+        _glState.bind_texture(3, depthCubemap);
+        _glState.bind_texture(SHADOW_ATLAS_UNIT, _shadowAtlas->texture);
+        bind_texture_pools();
+        for (auto &batch: _drawBatches) {
+            Shader *shader = _showOverdraw ? _overdrawShader : batch.shader;
+            Uniform<int> drawOffset = _showOverdraw ? _overdrawDrawOffset : batch.drawOffset;
+            _glState.use_program(shader->programID);
+            _sceneTriangles += multi_draw(shader, drawOffset, batch.first, batch.count, batch.indexType);
+        }
+
+        if (countSamples) {
+            glEndQuery(GL_SAMPLES_PASSED);
+            _sampleQueryPending[querySlot] = true;
+            _sampleQueryFrames[querySlot] = _gpuProfiler->get_frame_index();
+        }
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    void Renderer::bind_texture_pools() {
+        TexturePoolSet *pools = _modelManager->textureManager->get_pools();
+        if (!_bindless) {
+            for (uint32_t pool = 0; pool < pools->get_pool_count(); pool++) {
+                _glState.bind_texture(TEXTURE_POOL_FIRST_UNIT + pool, pools->get_texture(pool));
+            }
+            return;
+        }
+        if (_poolHandleVersion != pools->get_version()) {
+            _poolHandleVersion = pools->get_version();
+            GLuint64 handles[MAX_TEXTURE_POOLS] = {};
+            for (uint32_t pool = 0; pool < pools->get_pool_count(); pool++) {
+                handles[pool] = pools->get_handle(pool);
+            }
+            _poolHandleBuffer->update(handles, sizeof(handles));
         }
     }
 
+    uint64_t Renderer::multi_draw(Shader *shader, Uniform<int> drawOffset, uint32_t first, uint32_t count,
+                                  GLenum indexType) {
+        if (count == 0) {
+            return 0;
+        }
+        shader->set(drawOffset, (int) first);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void *) (first * sizeof(DrawCommand)),
+                                    (GLsizei) count, 0);
+        _glState.count_draw();
+        uint64_t triangles = 0;
+        for (uint32_t i = first; i < first + count; i++) {
+            triangles += _drawCommands[i].count / 3;
+        }
+        return triangles;
+    }
+
+    uint64_t Renderer::multi_draw(Shader *shader, Uniform<int> drawOffset, const DrawRange &range) {
+        return multi_draw(shader, drawOffset, range.first, range.shortCount, GL_UNSIGNED_SHORT) +
+               multi_draw(shader, drawOffset, range.first + range.shortCount, range.count - range.shortCount,
+                          GL_UNSIGNED_INT);
+    }
+
     void Renderer::cleanup() {
+        _modelManager->cleanup();
+        delete _modelManager;
+        _modelManager = nullptr;
+
+        _frameBuffer->cleanup();
+        _lightBuffer->cleanup();
+        _drawBuffer->cleanup();
+        _materialBuffer->cleanup();
+        _poolHandleBuffer->cleanup();
+        _lightClusters->cleanup();
+        delete _lightClusters;
+        _lightClusters = nullptr;
+        _shadowAtlas->cleanup();
+        delete _shadowAtlas;
+        _shadowAtlas = nullptr;
+        delete _materialBuffer;
+        delete _poolHandleBuffer;
+        glDeleteFramebuffers(6, _shadowFaceFBOs);
+        glDeleteFramebuffers(6, _staticShadowFaceFBOs);
+        glDeleteTextures(1, &_staticShadowCubemap);
+        _gpuProfiler->cleanup();
+        delete _gpuProfiler;
+        _gpuProfiler = nullptr;
+        delete _frameBuffer;
+        delete _lightBuffer;
+        delete _drawBuffer;
+        glDeleteBuffers(1, &_indirectBuffer);
+        glDeleteQueries((GLsizei) GPU_PROFILER_FRAME_LAG, _sampleQueries);
     }
 }
\ No newline at end of file
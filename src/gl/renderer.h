@@ -1,10 +1,22 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 #include <imgui.h>
 #include <gl/shader.h>
 #include <gl/model.h>
+#include <gl/uniform_buffer.h>
+#include <gl/shader_data.h>
+#include <gl/culling.h>
+#include <gl/bvh.h>
+#include <gl/gpu_profiler.h>
+#include <gl/render_queue.h>
+#include <gl/gl_state.h>
+#include <gl/bindless.h>
+#include <gl/light_clusters.h>
+#include <gl/shadow_atlas.h>
+#include <gl/occlusion_culler.h>
 #include <camera.h>
 
 namespace GLRenderer {
@@ -36,6 +48,80 @@ namespace GLRenderer {
         }
     };
 
+    // consecutive indirect draws sharing a shader, index type and texture pools, submitted with one multi-draw call;
+    // materials come from the material buffer, but the pool index picks a sampler and has to be dynamically
+    // uniform, so draws reading different pools never share a call
+    struct DrawBatch {
+        Shader *shader;
+        Uniform<int> drawOffset;
+        GLenum indexType;
+        uint32_t texturePools;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // the first shortCount draws use 16-bit indices, the rest 32-bit
+    struct DrawRange {
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t shortCount = 0;
+    };
+
+    // one mesh of one model, the unit culling works on
+    struct DrawInstance {
+        Model *model;
+        Shader *shader;
+        PBRTexture *material;
+        const Mesh *mesh;
+        // detail level kept between frames for hysteresis, shared by the main and shadow passes
+        uint32_t lod = 0;
+        // dense ids for the render key, assigned when the instance set is rebuilt
+        uint32_t shaderId = 0;
+        uint32_t materialId = 0;
+        // pools of the albedo, normal and metal-roughness textures, one byte each
+        uint32_t texturePools = 0;
+        // the shader's draw_offset, looked up when the instance set is rebuilt rather than per batch
+        Uniform<int> drawOffset;
+    };
+
+    enum CullMode {
+        CULL_NONE,
+        CULL_LINEAR,
+        CULL_BVH
+    };
+
+    enum ShadowMode {
+        // one pass, a geometry shader copies every triangle to all six faces
+        SHADOW_GEOMETRY_SHADER,
+        // six passes, each with the casters culled against its face frustum
+        SHADOW_PER_FACE
+    };
+
+    // what the last frame did, read back by the benchmark
+    struct FrameStats {
+        double cullTime;
+        // GPU time of the last shadow redraw, it may be a few frames old
+        double shadowPassTime;
+        // per-pass GPU times of the newest frame with results, gpu.frame says which one
+        GpuFrame gpu;
+        GLStateStats glState;
+        uint64_t sceneTriangles;
+        uint64_t shadowTriangles;
+        uint32_t drawCommands;
+        uint32_t visibleMeshes;
+        // CPU binning time, 0 when the lights are binned on the GPU
+        double lightBinTime;
+        LightClusterStats lightClusters;
+        ShadowAtlasStats shadowAtlas;
+        uint64_t atlasTriangles;
+        bool depthPrepass;
+        uint64_t prepassTriangles;
+        // samples that passed the scene pass depth test, so were shaded; a few frames old like the GPU times
+        uint64_t shadedSamples;
+        OcclusionStats occlusion;
+        double occlusionTime;
+    };
+
     class Renderer {
     public:
         void init(FlyCamera *camera, uint32_t windowWidth, uint32_t windowHeight);
@@ -46,12 +132,55 @@ namespace GLRenderer {
 
         void draw_shadow_map();
 
+        // fills the depth buffer front to back so the scene pass shades each pixel once
+        void draw_depth_prepass();
+
         void draw_scene();
 
+        // selects the model under the cursor, in window coordinates
+        void pick(int x, int y);
+
+        FrameStats get_frame_stats() const;
+
+        // reads back GPU timings that are ready, the benchmark calls this after glFinish so stats are not late
+        void collect_gpu_timings();
+
+        GpuProfiler *get_gpu_profiler() { return _gpuProfiler; }
+
         void cleanup();
 
         bool isInitialized = false;
 
+        // worker threads used for model import, 0 for all hardware threads
+        unsigned int importThreadCount = 0;
+
+        // VRAM budget for textures nothing references anymore
+        int textureBudgetMB = 1024;
+
+        // off for headless runs, where there is no ImGui context
+        bool drawUI = true;
+
+        // the scene pass renders here, 0 for the window
+        unsigned int outputFramebuffer = 0;
+
+        // used to load extension functions the generated loader does not know, set before init
+        GLADloadproc procAddressLoader = nullptr;
+
+        // sample the texture pools through resident handles when ARB_bindless_texture is available
+        bool useBindless = true;
+
+        // stress mode, this many unshadowed point lights are spawned across the scene
+        int pointLightCount = 0;
+
+        // bin point lights with the compute shader instead of on the CPU
+        bool gpuLightCulling = false;
+
+        // lay down depth first, the scene pass then tests with GL_EQUAL and does not write depth
+        bool depthPrepass = false;
+
+        // drop meshes hidden behind the import-time occluders, tested on the CPU before the draws are built
+        bool occlusionCulling = false;
+
     private:
         double _delta = 0;
 
@@ -62,11 +191,142 @@ namespace GLRenderer {
         float _lightPower = 8192.0f;
         float _lightRadius = 8192.0f;
         float _lightPos[3] = {0.0f, 50.0f, 0.0f};
-        float _prevLightPos[3];
+        float _prevLightPos[3] = {0.0f, 0.0f, 0.0f};
         float _gamma = 2.2f;
+        float _exposure = 1.0f;
 
         Shader *_pbrShader = nullptr;
         Shader *_depthShader = nullptr;
+        Shader *_depthFaceShader = nullptr;
+        Shader *_shadowAtlasShader = nullptr;
+        Shader *_depthPrepassShader = nullptr;
+        Shader *_overdrawShader = nullptr;
+        // resolved once in init_shaders, the passes only set them
+        Uniform<int> _depthDrawOffset;
+        Uniform<int> _depthFaceDrawOffset;
+        Uniform<int> _depthFaceUniform;
+        Uniform<int> _atlasDrawOffset;
+        Uniform<glm::mat4> _atlasFaceMatrix;
+        Uniform<glm::vec3> _atlasLightPosition;
+        Uniform<float> _atlasLightRadius;
+        Uniform<int> _prepassDrawOffset;
+        Uniform<int> _overdrawDrawOffset;
+        UniformStats _uniformStats;
+
+        // every program, VAO, texture and framebuffer bind of the passes goes through here
+        GLStateCache _glState;
+        GLStateStats _glStateStats;
+
+        // updated once per frame, shared by every draw
+        UniformBuffer *_frameBuffer = nullptr;
+        UniformBuffer *_lightBuffer = nullptr;
+
+        // point lights orbit their spawn origins at a fixed step per frame, so benchmark runs see the same lights
+        LightClusters *_lightClusters = nullptr;
+        std::vector<PointLight> _pointLights;
+        std::vector<glm::vec3> _pointLightOrigins;
+        float _pointLightRadius = 25.0f;
+        float _pointLightPower = 200.0f;
+        bool _animatePointLights = true;
+        float _pointLightTime = 0.0f;
+        double _lightBinTime = 0.0;
+
+        // rebuilt every frame, commands and draw data share indices
+        std::vector<DrawCommand> _drawCommands;
+        std::vector<DrawData> _drawData;
+        std::vector<DrawBatch> _drawBatches;
+        RenderQueue _renderQueue;
+
+        // the pre-pass reuses the scene commands of every visible instance, first and count by instance,
+        // copied in front to back order
+        RenderQueue _prepassQueue;
+        std::vector<std::pair<uint32_t, uint32_t>> _instanceCommands;
+        DrawRange _prepassRange;
+        uint64_t _prepassTriangles = 0;
+
+        // the overdraw view swaps the material shaders for an additive counter; the sample queries count shaded
+        // samples of the scene pass and are read back without waiting, like the GPU profiler's
+        bool _showOverdraw = false;
+        unsigned int _sampleQueries[GPU_PROFILER_FRAME_LAG] = {};
+        bool _sampleQueryPending[GPU_PROFILER_FRAME_LAG] = {};
+        uint64_t _sampleQueryFrames[GPU_PROFILER_FRAME_LAG] = {};
+        uint64_t _shadedSamplesFrame = 0;
+        uint64_t _shadedSamples = 0;
+
+        // one record per material of the instance set, indexed by materialId
+        std::vector<MaterialData> _materials;
+        UniformBuffer *_materialBuffer = nullptr;
+        // pools are bound to units in the bound path, or listed by handle in the bindless one
+        BindlessFunctions _bindlessFunctions;
+        bool _bindless = false;
+        UniformBuffer *_poolHandleBuffer = nullptr;
+        uint32_t _poolHandleVersion = UINT32_MAX;
+        UniformBuffer *_drawBuffer = nullptr;
+        unsigned int _indirectBuffer = 0;
+        size_t _indirectBufferSize = 0;
+
+        // every mesh in the scene with its world bounds, rebuilt when models are added or removed
+        std::vector<DrawInstance> _instances;
+        std::vector<AABB> _instanceBounds;
+        BoundsList _drawBounds;
+        BVH _bvh;
+        uint32_t _instanceVersion = UINT32_MAX;
+        std::vector<uint8_t> _visible;
+        std::vector<uint32_t> _queryResults;
+        int _cullMode = CULL_BVH;
+        uint32_t _cullVisible = 0;
+        uint32_t _bvhNodesVisited = 0;
+        double _cullTime = 0.0;
+        uint32_t _pickedInstance = UINT32_MAX;
+        bool _pickChanged = false;
+
+        // main pass only, the shadow passes see what the camera cannot
+        OcclusionCuller _occlusionCuller;
+        double _occlusionTime = 0.0;
+
+        // a coarser level is picked once its projected error is below the threshold, reduced by the
+        // hysteresis fraction so levels near the boundary do not flip every frame
+        int _forcedLod = -1;
+        float _lodErrorPixels = 1.0f;
+        float _lodHysteresis = 0.25f;
+        uint32_t _lodCounts[MAX_LOD_COUNT] = {};
+        uint64_t _sceneTriangles = 0;
+        uint64_t _shadowTriangles = 0;
+
+        // full detail meshes are submitted as runs of meshlets that survive frustum and normal cone tests
+        bool _meshletCulling = true;
+        uint32_t _meshletsTested = 0;
+        uint32_t _meshletsFrustumCulled = 0;
+        uint32_t _meshletsBackfaceCulled = 0;
+        uint64_t _meshletTrianglesTested = 0;
+        uint64_t _meshletTrianglesRejected = 0;
+
+        // the main pass uses the batches, the shadow pass one range per face or a single range
+        // for the geometry shader path
+        DrawRange _shadowRanges[6];
+        DrawRange _dynamicShadowRanges[6];
+        uint32_t _shadowCount = 0;
+
+        // static casters are cached per face and only redrawn when the face is dirty, within the budget;
+        // dynamic casters are drawn over a copy of the cached face whenever they move
+        std::vector<Model *> _movedModels;
+        std::vector<AABB> _movedStaticBounds;
+        // where every moved instance was and is, static or dynamic
+        std::vector<AABB> _movedBounds;
+        std::vector<uint32_t> _dynamicInstances;
+        bool _dynamicCasterMoved = false;
+        bool _shadowCacheInvalid = true;
+        bool _shadowFaceDirty[6] = {true, true, true, true, true, true};
+        bool _refreshShadowFace[6] = {};
+        // static casters in each cached face as of its last refresh, the ranges of skipped faces are stale
+        uint32_t _shadowFaceCasters[6] = {};
+        bool _compositeShadowFace[6] = {};
+        bool _shadowFaceHadDynamic[6] = {};
+        bool _shadowPassNeeded = false;
+        int _shadowFaceBudget = 2;
+        unsigned int _nextShadowFace = 0;
+        uint32_t _shadowFacesRefreshed = 0;
+        uint32_t _shadowFacesComposited = 0;
 
         ModelManager *_modelManager = nullptr;
         FlyCamera *_flyCamera = nullptr;
@@ -77,6 +337,30 @@ namespace GLRenderer {
         float _shadowNear = 0.1f;
         float _shadowFar = 2000.0f;
         float _shadowBias = 0.15f;
+        glm::mat4 _shadowMatrices[6];
+        int _shadowMode = SHADOW_PER_FACE;
+        int _prevShadowMode = SHADOW_PER_FACE;
+        unsigned int _shadowFaceFBOs[6] = {};
+        unsigned int _staticShadowCubemap = 0;
+        unsigned int _staticShadowFaceFBOs[6] = {};
+        double _shadowPassTime = 0.0;
+
+        // point light shadows, the scheduler picks which lights hold tiles and which get redrawn; faces drawn per
+        // frame are kept until the GPU time of that frame is known, for the cost model
+        ShadowAtlas *_shadowAtlas = nullptr;
+        std::vector<DrawRange> _atlasRanges;
+        int _shadowedLightCount = 8;
+        float _shadowAtlasBudget = 1.0f;
+        uint32_t _atlasFaceHistory[GPU_PROFILER_FRAME_LAG * 2] = {};
+        uint64_t _atlasCostFrame = UINT64_MAX;
+        uint64_t _atlasTriangles = 0;
+
+        // per-pass GPU times, plotted for the top level passes
+        GpuProfiler *_gpuProfiler = nullptr;
+        std::vector<std::pair<const char *, ScrollingBuffer>> _gpuPassHistory;
+        uint64_t _gpuPlottedFrame = UINT64_MAX;
+        bool _gpuTraceRequested = false;
+        const uint32_t GPU_TRACE_FRAMES = 120;
 
         void init_shaders();
 
@@ -84,6 +368,59 @@ namespace GLRenderer {
 
         void init_shadow_map();
 
+        void init_uniform_buffers();
+
+        void update_uniform_buffers();
+
+        void update_instances();
+
+        // respawns the point lights inside the scene bounds when the count changed, moves and uploads them
+        void update_point_lights();
+
+        void bin_point_lights();
+
+        // fills _visible for the frustum, or for the sphere if frustum is null
+        void cull_instances(const Frustum *frustum, const glm::vec3 &center, float radius, uint32_t &visibleCount);
+
+        // rasterizes the visible occluders and clears _visible for the instances behind them
+        void cull_occluded(const glm::mat4 &viewProj);
+
+        void build_draws();
+
+        static DrawData make_draw_data(const DrawInstance &instance);
+
+        void select_lods();
+
+        // appends commands for the visible meshlets of an instance, returns how many
+        uint32_t add_meshlet_draws(const DrawInstance &instance, const glm::mat4 &viewProj, bool insideFrustum,
+                                   const DrawData &drawData);
+
+        // appends the visible instances as depth draws, 16-bit index draws first
+        void add_shadow_range(DrawRange &range);
+
+        // culls shadow casters and decides which cube faces get refreshed or recomposited this frame
+        void build_shadow_draws();
+
+        // schedules the atlas and culls casters for each face of the lights it refreshes
+        void build_atlas_draws();
+
+        void draw_shadow_atlas();
+
+        void upload_draws();
+
+        // reads the finished sample queries, the newest result wins
+        void collect_sample_queries();
+
+        // gl_DrawID restarts with every multi-draw, so draw_offset is set to the first command of each call;
+        // returns the triangles submitted
+        uint64_t multi_draw(Shader *shader, Uniform<int> drawOffset, uint32_t first, uint32_t count,
+                            GLenum indexType);
+
+        uint64_t multi_draw(Shader *shader, Uniform<int> drawOffset, const DrawRange &range);
+
+        // binds every texture pool, or refreshes the handle table after pools changed
+        void bind_texture_pools();
+
         void update_ui();
     };
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "scene_graph.h"
+
+#include <algorithm>
+
+namespace GLRenderer {
+    uint32_t SceneGraph::add_node(int32_t parent, const glm::mat4 &localTransform) {
+        auto node = (uint32_t) _parents.size();
+        _parents.push_back(parent);
+        _local.push_back(localTransform);
+        _world.push_back(localTransform);
+        _dirty.push_back(1);
+        _updatedIn.push_back(0);
+        _firstDirty = std::min(_firstDirty, node);
+        return node;
+    }
+
+    void SceneGraph::set_local_transform(uint32_t node, const glm::mat4 &localTransform) {
+        _local[node] = localTransform;
+        _dirty[node] = 1;
+        _firstDirty = std::min(_firstDirty, node);
+    }
+
+    uint32_t SceneGraph::update() {
+        if (_firstDirty >= _parents.size()) {
+            return 0;
+        }
+
+        // parents come first, so a node is recomputed if it is dirty or its parent was recomputed in this pass;
+        // nothing before the first dirty node can change
+        _updateIndex++;
+        uint32_t updated = 0;
+        for (size_t i = _firstDirty; i < _parents.size(); i++) {
+            int32_t parent = _parents[i];
+            bool parentUpdated = parent >= 0 && _updatedIn[parent] == _updateIndex;
+            if (!_dirty[i] && !parentUpdated) {
+                continue;
+            }
+            _world[i] = parent < 0 ? _local[i] : _world[parent] * _local[i];
+            _dirty[i] = 0;
+            _updatedIn[i] = _updateIndex;
+            updated++;
+        }
+        _firstDirty = UINT32_MAX;
+        return updated;
+    }
+
+    void SceneGraph::clear() {
+        _parents.clear();
+        _local.clear();
+        _world.clear();
+        _dirty.clear();
+        _updatedIn.clear();
+        _firstDirty = UINT32_MAX;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace GLRenderer {
+    // node hierarchy stored as flat arrays in topological order, a parent always comes before its children
+    class SceneGraph {
+    public:
+        // parent must already exist, -1 for a root; returns the new node's index
+        uint32_t add_node(int32_t parent, const glm::mat4 &localTransform);
+
+        // only marks the node dirty, world matrices are recomputed in update
+        void set_local_transform(uint32_t node, const glm::mat4 &localTransform);
+
+        // recomputes dirty nodes and everything below them in one forward pass, returns the number updated
+        uint32_t update();
+
+        void clear();
+
+        const glm::mat4 &get_world_transform(uint32_t node) const { return _world[node]; }
+
+        int32_t get_parent(uint32_t node) const { return _parents[node]; }
+
+        const glm::mat4 &get_local_transform(uint32_t node) const { return _local[node]; }
+
+        size_t node_count() const { return _parents.size(); }
+
+    private:
+        std::vector<int32_t> _parents;
+        std::vector<glm::mat4> _local;
+        std::vector<glm::mat4> _world;
+        std::vector<uint8_t> _dirty;
+        // index of the last update that recomputed each node
+        std::vector<uint32_t> _updatedIn;
+        uint32_t _updateIndex = 0;
+        // update starts here and returns immediately when nothing was touched
+        uint32_t _firstDirty = UINT32_MAX;
+    };
+}
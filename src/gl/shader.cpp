@@ -3,6 +3,8 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
 
 namespace GLRenderer {
     Shader::Shader(const std::string &vertPath, const std::string &fragPath, const std::string &geomPath) {
@@ -30,50 +32,179 @@ namespace GLRenderer {
             glAttachShader(programID, geomShader);
         }
         glLinkProgram(programID);
+        check_link();
 
-        // check
+        // delete once final program is linked
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragShader);
+        if (!geomPath.empty()) {
+            glDeleteShader(geomShader);
+        }
+
+        reflect_uniforms();
+    }
+
+    Shader::Shader(const std::string &compPath) {
+        uint32_t compShader = 0;
+        if (!load_shader_binary(compPath, compShader, GL_COMPUTE_SHADER)) {
+            std::cout << "Failed to load compute shader" << std::endl;
+        }
+
+        programID = glCreateProgram();
+        glAttachShader(programID, compShader);
+        glLinkProgram(programID);
+        check_link();
+        glDeleteShader(compShader);
+
+        reflect_uniforms();
+    }
+
+    void Shader::check_link() {
         int result = 0;
         glGetProgramiv(programID, GL_LINK_STATUS, &result);
+        isLinked = result != 0;
         if (!result) {
             char infoLog[512];
             glGetProgramInfoLog(programID, 512, nullptr, infoLog);
             std::cout << "Shader linking failed\n" << infoLog << std::endl;
         }
-
-        // delete once final program is linked
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragShader);
-        if (!geomPath.empty()) {
-            glDeleteShader(geomShader);
-        }
     }
 
     void Shader::bind() const {
         glUseProgram(programID);
     }
 
-    void Shader::set_bool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(programID, name.c_str()), (int) value);
+    UniformStats Shader::stats;
+
+    void Shader::reset_stats() {
+        stats = UniformStats{};
+    }
+
+    void Shader::set(Uniform<bool> uniform, bool value) {
+        set(Uniform<int>{uniform.location}, (int) value);
     }
 
-    void Shader::set_int(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(programID, name.c_str()), value);
+    void Shader::set(Uniform<int> uniform, int value) {
+        if (update_value(uniform.location, &value, sizeof(value))) {
+            glProgramUniform1i(programID, uniform.location, value);
+        }
     }
 
-    void Shader::set_float(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(programID, name.c_str()), value);
+    void Shader::set(Uniform<float> uniform, float value) {
+        if (update_value(uniform.location, &value, sizeof(value))) {
+            glProgramUniform1f(programID, uniform.location, value);
+        }
     }
 
-    void Shader::set_mat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(programID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3 &value) {
+        if (update_value(uniform.location, &value[0], sizeof(glm::vec3))) {
+            glProgramUniform3fv(programID, uniform.location, 1, &value[0]);
+        }
     }
 
-    void Shader::set_glm_vec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
+    void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 &value) {
+        if (update_value(uniform.location, &value[0][0], sizeof(glm::mat4))) {
+            glProgramUniformMatrix4fv(programID, uniform.location, 1, GL_FALSE, &value[0][0]);
+        }
     }
 
-    void Shader::set_float_vec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(programID, name.c_str()), x, y, z);
+    void Shader::set_bool(const std::string &name, bool value) {
+        set(get_uniform<bool>(name), value);
+    }
+
+    void Shader::set_int(const std::string &name, int value) {
+        set(get_uniform<int>(name), value);
+    }
+
+    void Shader::set_float(const std::string &name, float value) {
+        set(get_uniform<float>(name), value);
+    }
+
+    void Shader::set_mat4(const std::string &name, const glm::mat4 &mat) {
+        set(get_uniform<glm::mat4>(name), mat);
+    }
+
+    void Shader::set_glm_vec3(const std::string &name, const glm::vec3 &value) {
+        set(get_uniform<glm::vec3>(name), value);
+    }
+
+    void Shader::set_float_vec3(const std::string &name, float x, float y, float z) {
+        set(get_uniform<glm::vec3>(name), glm::vec3(x, y, z));
+    }
+
+    void Shader::reflect_uniforms() {
+        int uniformCount = 0;
+        int maxNameLength = 0;
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+        int maxLocation = -1;
+        for (int i = 0; i < uniformCount; i++) {
+            int arraySize = 0;
+            GLenum type = 0;
+            glGetActiveUniform(programID, (GLuint) i, (GLsizei) nameBuffer.size(), nullptr, &arraySize, &type,
+                               nameBuffer.data());
+            std::string name = nameBuffer.data();
+            int location = glGetUniformLocation(programID, name.c_str());
+            if (location < 0) {
+                // block members have no location
+                continue;
+            }
+
+            // arrays are reported as name[0], register every element with consecutive locations
+            size_t bracket = name.find('[');
+            if (bracket != std::string::npos) {
+                std::string baseName = name.substr(0, bracket);
+                _uniformLocations[baseName] = location;
+                for (int element = 0; element < arraySize; element++) {
+                    _uniformLocations[baseName + "[" + std::to_string(element) + "]"] = location + element;
+                }
+            } else {
+                _uniformLocations[name] = location;
+            }
+            maxLocation = std::max(maxLocation, location + std::max(arraySize, 1) - 1);
+        }
+
+        _uniformValues.resize((size_t) (maxLocation + 1));
+    }
+
+    int Shader::find_uniform(const std::string &name) const {
+        auto it = _uniformLocations.find(name);
+        if (it == _uniformLocations.end()) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    void Shader::check_location(int location, const std::string &name) const {
+#ifndef NDEBUG
+        // drivers that drop names from SPIR-V report nothing to compare against
+        int reflected = find_uniform(name);
+        if (reflected >= 0 && reflected != location) {
+            std::cout << "Uniform " << name << " is at location " << reflected << ", expected " << location
+                      << std::endl;
+        }
+#endif
+    }
+
+    bool Shader::update_value(int location, const void *data, size_t size) {
+        if (location < 0) {
+            return false;
+        }
+        if ((size_t) location >= _uniformValues.size()) {
+            _uniformValues.resize((size_t) location + 1);
+        }
+
+        UniformValue &value = _uniformValues[location];
+        if (value.valid && std::memcmp(value.data, data, size) == 0) {
+            stats.skipped++;
+            return false;
+        }
+        std::memcpy(value.data, data, size);
+        value.valid = true;
+        stats.issued++;
+        return true;
     }
 
     bool Shader::load_shader_binary(const std::string &filePath, uint32_t &id, uint32_t type) {
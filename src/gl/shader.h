@@ -1,31 +1,101 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
 namespace GLRenderer {
+    // typed handle to a uniform location, -1 if the uniform is not active
+    template<typename T>
+    struct Uniform {
+        int location = -1;
+    };
+
+    struct UniformStats {
+        uint32_t issued = 0;
+        uint32_t skipped = 0;
+    };
+
     class Shader {
     public:
         unsigned int programID;
 
+        // false if a stage failed to load or the program did not link
+        bool isLinked = false;
+
         Shader(const std::string &vertPath, const std::string &fragPath, const std::string &geomPath = "");
 
+        // compute program
+        explicit Shader(const std::string &compPath);
+
         void bind() const;
 
-        void set_bool(const std::string &name, bool value) const;
+        // resolved once against the uniforms reflected at link time; SPIR-V programs may come without names,
+        // so shaders loaded from SPIR-V should use the explicit location overload below
+        template<typename T>
+        Uniform<T> get_uniform(const std::string &name) const {
+            return Uniform<T>{find_uniform(name)};
+        }
+
+        // uniform declared with layout (location = N), the name only cross-checks the reflected location in
+        // debug builds when the driver reports one
+        template<typename T>
+        Uniform<T> get_uniform(int location, const std::string &name) const {
+            check_location(location, name);
+            return Uniform<T>{location};
+        }
+
+        void set(Uniform<bool> uniform, bool value);
+
+        void set(Uniform<int> uniform, int value);
+
+        void set(Uniform<float> uniform, float value);
+
+        void set(Uniform<glm::vec3> uniform, const glm::vec3 &value);
 
-        void set_int(const std::string &name, int value) const;
+        void set(Uniform<glm::mat4> uniform, const glm::mat4 &value);
 
-        void set_float(const std::string &name, float value) const;
+        void set_bool(const std::string &name, bool value);
 
-        void set_mat4(const std::string &name, const glm::mat4 &mat) const;
+        void set_int(const std::string &name, int value);
 
-        void set_glm_vec3(const std::string &name, const glm::vec3 &value) const;
+        void set_float(const std::string &name, float value);
 
-        void set_float_vec3(const std::string &name, float x, float y, float z) const;
+        void set_mat4(const std::string &name, const glm::mat4 &mat);
+
+        void set_glm_vec3(const std::string &name, const glm::vec3 &value);
+
+        void set_float_vec3(const std::string &name, float x, float y, float z);
+
+        // uniform calls across all shaders since the last reset
+        static UniformStats stats;
+
+        static void reset_stats();
 
     private:
+        // last value sent to each location, so unchanged values can be skipped
+        struct UniformValue {
+            bool valid = false;
+            unsigned char data[sizeof(glm::mat4)];
+        };
+
+        std::unordered_map<std::string, int> _uniformLocations;
+        std::vector<UniformValue> _uniformValues;
+
+        // logs the info log on failure, sets isLinked
+        void check_link();
+
+        void reflect_uniforms();
+
+        int find_uniform(const std::string &name) const;
+
+        void check_location(int location, const std::string &name) const;
+
+        // returns true if the value differs from the shadow copy and has to be sent
+        bool update_value(int location, const void *data, size_t size);
+
         static bool load_shader_binary(const std::string &filePath, uint32_t &id, uint32_t type);
 
 	static bool load_shader_file(const std::string &filePath, uint32_t &id, uint32_t type);
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// CPU mirrors of the buffer blocks declared in the shaders, laid out for std140 (uniform blocks) or std430 (storage)
+namespace GLRenderer {
+    constexpr unsigned int FRAME_DATA_BINDING = 0;
+    constexpr unsigned int LIGHT_DATA_BINDING = 1;
+    constexpr unsigned int DRAW_DATA_BINDING = 2;
+    constexpr unsigned int MATERIAL_DATA_BINDING = 3;
+    constexpr unsigned int TEXTURE_POOL_HANDLES_BINDING = 4;
+    constexpr unsigned int POINT_LIGHT_BINDING = 5;
+    constexpr unsigned int LIGHT_CLUSTER_BINDING = 6;
+    constexpr unsigned int LIGHT_INDEX_BINDING = 7;
+    constexpr unsigned int SHADOW_TILE_BINDING = 8;
+
+    // explicit uniform locations, matching the layout (location = N) qualifiers in the shaders
+    // depth, depth_face and shadow_atlas
+    constexpr int DEPTH_DRAW_OFFSET_LOCATION = 0;
+    constexpr int DEPTH_FACE_LOCATION = 1;
+    constexpr int ATLAS_FACE_MATRIX_LOCATION = 1;
+    constexpr int ATLAS_LIGHT_POSITION_LOCATION = 2;
+    constexpr int ATLAS_LIGHT_RADIUS_LOCATION = 3;
+    // pbr.vert (every scene shader) and depth_prepass
+    constexpr int SCENE_DRAW_OFFSET_LOCATION = 1;
+    // light_cull
+    constexpr int LIGHT_COUNT_LOCATION = 0;
+
+    struct FrameData {
+        glm::mat4 viewProj;
+        glm::vec4 camPos;
+        float gamma;
+        float exposure;
+        float shadowBias;
+        float padding;
+        glm::mat4 view;
+        // froxel counts in xyz
+        glm::uvec4 clusterGrid;
+        // tile size in pixels in xy, screen size in zw
+        glm::vec4 clusterTile;
+        // log depth to slice scale and bias in xy, near and far in zw
+        glm::vec4 clusterDepth;
+        // projection x and y scale, used to rebuild the cluster bounds in the culling shader
+        glm::vec4 projectionScale;
+    };
+
+    struct LightData {
+        glm::mat4 shadowMatrices[6];
+        // xyz position, w radius
+        glm::vec4 positionRadius;
+        // rgb color, a power
+        glm::vec4 colorPower;
+        float farPlane;
+        float padding[3];
+    };
+
+    // one per indirect draw, indexed by draw_offset + gl_DrawID
+    struct DrawData {
+        glm::mat4 model;
+        // dequantizes the snorm16 positions, extent in xyz
+        glm::vec4 positionScale;
+        // mesh bounds center in xyz
+        glm::vec4 positionOffset;
+        uint32_t materialIndex;
+        uint32_t padding[3];
+    };
+
+    // one per material, indexed by DrawData::materialIndex; textures are TextureSlot::packed() values
+    struct MaterialData {
+        uint32_t albedo;
+        uint32_t normal;
+        uint32_t metalRoughness;
+        uint32_t padding;
+        glm::vec4 baseColorFactor;
+        // metallic in x, roughness in y
+        glm::vec4 metalRoughnessFactor;
+    };
+
+    // local light, indexed through the cluster light lists
+    struct PointLight {
+        // xyz position, w radius
+        glm::vec4 positionRadius;
+        // rgb color, a power
+        glm::vec4 colorPower;
+        // shadow atlas slot, its cube faces are tiles 6 * shadowIndex to 6 * shadowIndex + 5; -1 when unshadowed
+        int32_t shadowIndex;
+        uint32_t padding[3];
+    };
+
+    // one cube face of a shadowed point light, indexed by PointLight::shadowIndex * 6 + face
+    struct ShadowTileData {
+        glm::mat4 viewProj;
+        // atlas uv offset in xy, uv size in z
+        glm::vec4 rect;
+        // the light as the tile was drawn, lookups use it so a stale tile stays consistent
+        glm::vec4 positionRadius;
+    };
+
+    // where a cluster's lights start in the light index list, and how many there are
+    struct LightCluster {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    static_assert(sizeof(FrameData) == 224, "FrameData must match the std140 block");
+    static_assert(sizeof(LightData) == 432, "LightData must match the std140 block");
+    static_assert(sizeof(DrawData) == 112, "DrawData must match the std430 array element");
+    static_assert(sizeof(MaterialData) == 48, "MaterialData must match the std430 array element");
+    static_assert(sizeof(ShadowTileData) == 96, "ShadowTileData must match the std430 array element");
+    static_assert(sizeof(PointLight) == 48, "PointLight must match the std430 array element");
+    static_assert(sizeof(LightCluster) == 8, "LightCluster must match the std430 array element");
+}
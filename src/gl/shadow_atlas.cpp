@@ -0,0 +1,311 @@
+#include "shadow_atlas.h"
+#include <algorithm>
+#include <iterator>
+#include <glad/glad.h>
+#include <glm/gtx/transform.hpp>
+#include <profiler.h>
+
+namespace GLRenderer {
+    ShadowAtlas::ShadowAtlas() {
+        // 16-bit linear distances are plenty for light radii in scene units, and keep the atlas at 32 MB
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, 1, GL_DEPTH_COMPONENT16, (GLsizei) SHADOW_ATLAS_SIZE, (GLsizei) SHADOW_ATLAS_SIZE);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, texture, 0);
+        glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+        glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+        float farDepth = 1.0f;
+        glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &farDepth);
+
+        _entries.resize(MAX_SHADOWED_LIGHTS);
+        _tileData.resize(MAX_SHADOWED_LIGHTS * 6);
+        _tileBuffer = new UniformBuffer(sizeof(ShadowTileData) * _tileData.size(), SHADOW_TILE_BINDING,
+                                        GL_SHADER_STORAGE_BUFFER);
+        _freeTiles.resize(level_of(SHADOW_ATLAS_MIN_TILE) + 1);
+        _freeTiles[0].push_back({0, 0, SHADOW_ATLAS_SIZE});
+    }
+
+    void ShadowAtlas::schedule(std::vector<PointLight> &lights, const Frustum &frustum, const glm::vec3 &cameraPos,
+                               float pixelScale, uint32_t maxLights, double budgetMs,
+                               const std::vector<AABB> &movedBounds, bool invalidateAll) {
+        PROFILE_ZONE("ShadowAtlas::schedule");
+        _frame++;
+        _refreshes.clear();
+
+        // importance is the projected radius in pixels, lights off screen get no tiles
+        _candidates.clear();
+        for (uint32_t light = 0; light < (uint32_t) lights.size(); light++) {
+            glm::vec3 position = glm::vec3(lights[light].positionRadius);
+            float radius = lights[light].positionRadius.w;
+            if (radius <= 0.0f || !frustum.intersects_sphere(position, radius)) {
+                continue;
+            }
+            float distance = std::max(glm::length(position - cameraPos), radius);
+            _candidates.emplace_back(radius * pixelScale / distance, light);
+        }
+        auto count = (uint32_t) std::min({(size_t) maxLights, (size_t) MAX_SHADOWED_LIGHTS, _candidates.size()});
+        std::partial_sort(_candidates.begin(), _candidates.begin() + count, _candidates.end(),
+                          [](const auto &a, const auto &b) {
+                              return a.first != b.first ? a.first > b.first : a.second < b.second;
+                          });
+
+        // lights that dropped out of the top, or no longer exist, give their tiles back first
+        _lightSlots.assign(lights.size(), UINT32_MAX);
+        for (uint32_t slot = 0; slot < MAX_SHADOWED_LIGHTS; slot++) {
+            if (_entries[slot].light != UINT32_MAX && _entries[slot].light < lights.size()) {
+                _lightSlots[_entries[slot].light] = slot;
+            }
+        }
+        std::vector<uint8_t> keep(MAX_SHADOWED_LIGHTS, 0);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t slot = _lightSlots[_candidates[i].second];
+            if (slot != UINT32_MAX) {
+                keep[slot] = 1;
+            }
+        }
+        for (uint32_t slot = 0; slot < MAX_SHADOWED_LIGHTS; slot++) {
+            if (_entries[slot].light != UINT32_MAX && !keep[slot]) {
+                if (_entries[slot].light < lights.size()) {
+                    _lightSlots[_entries[slot].light] = UINT32_MAX;
+                }
+                release(_entries[slot]);
+            }
+        }
+
+        // most important first, so they get their size while the atlas still has room
+        for (uint32_t i = 0; i < count; i++) {
+            float importance = _candidates[i].first;
+            uint32_t light = _candidates[i].second;
+            uint32_t desiredSize = SHADOW_ATLAS_MIN_TILE;
+            while (desiredSize < SHADOW_ATLAS_MAX_TILE && (float) desiredSize < 2.0f * importance) {
+                desiredSize *= 2;
+            }
+
+            uint32_t slot = _lightSlots[light];
+            if (slot == UINT32_MAX) {
+                auto freeEntry = std::find_if(_entries.begin(), _entries.end(),
+                                              [](const ShadowEntry &entry) { return entry.light == UINT32_MAX; });
+                slot = (uint32_t) (freeEntry - _entries.begin());
+                freeEntry->light = light;
+                freeEntry->requestedSize = desiredSize;
+                if (!allocate_faces(*freeEntry, desiredSize)) {
+                    release(*freeEntry);
+                    continue;
+                }
+                _lightSlots[light] = slot;
+            }
+            ShadowEntry &entry = _entries[slot];
+            entry.importance = importance;
+
+            // grow right away, shrink only once two sizes too large so tiles do not flip at a boundary
+            if (desiredSize > entry.requestedSize || desiredSize * 4 <= entry.requestedSize) {
+                entry.requestedSize = desiredSize;
+                AtlasTile previousFaces[6];
+                std::copy(std::begin(entry.faces), std::end(entry.faces), std::begin(previousFaces));
+                for (auto &face: entry.faces) {
+                    free(face);
+                }
+                // the freed tiles fit again at worst
+                allocate_faces(entry, desiredSize);
+                bool moved = !std::equal(std::begin(entry.faces), std::end(entry.faces), std::begin(previousFaces),
+                                         [](const AtlasTile &a, const AtlasTile &b) {
+                                             return a.x == b.x && a.y == b.y && a.size == b.size;
+                                         });
+                if (moved) {
+                    entry.rendered = false;
+                    entry.stale = true;
+                }
+            }
+
+            glm::vec3 position = glm::vec3(lights[light].positionRadius);
+            float radius = lights[light].positionRadius.w;
+            if (invalidateAll || position != entry.position || radius != entry.radius) {
+                entry.stale = true;
+            }
+            for (auto &bounds: movedBounds) {
+                if (!entry.stale && bounds.intersects_sphere(position, radius)) {
+                    entry.stale = true;
+                }
+            }
+        }
+
+        // tiles never drawn come first since their lights are unshadowed until then, the rest by importance
+        // weighted with the frames since their last refresh, so small lights still get their turn
+        _stats = ShadowAtlasStats{};
+        _staleEntries.clear();
+        for (uint32_t slot = 0; slot < MAX_SHADOWED_LIGHTS; slot++) {
+            const ShadowEntry &entry = _entries[slot];
+            if (entry.light == UINT32_MAX || !entry.stale) {
+                continue;
+            }
+            float age = (float) (_frame - entry.lastRefresh);
+            float priority = entry.rendered ? entry.importance * age : 1e9f + entry.importance;
+            _staleEntries.emplace_back(priority, slot);
+        }
+        std::sort(_staleEntries.begin(), _staleEntries.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        _stats.staleLights = (uint32_t) _staleEntries.size();
+
+        // at least one light per frame, so a low budget still makes progress
+        double lightCost = 6.0 * _faceCost;
+        for (auto &stale: _staleEntries) {
+            if (!_refreshes.empty() && _stats.estimatedCost + lightCost > budgetMs) {
+                break;
+            }
+            _stats.estimatedCost += lightCost;
+
+            ShadowEntry &entry = _entries[stale.second];
+            const PointLight &light = lights[entry.light];
+            entry.position = glm::vec3(light.positionRadius);
+            entry.radius = light.positionRadius.w;
+            entry.rendered = true;
+            entry.stale = false;
+            entry.lastRefresh = _frame;
+
+            // same face orientation as the shadow cubemap
+            static const glm::vec3 faceDirections[6] = {{1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                                                        {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+            static const glm::vec3 faceUps[6] = {{0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+                                                 {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+            glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, std::min(0.1f, entry.radius * 0.5f),
+                                                        entry.radius);
+            ShadowRefresh refresh{};
+            refresh.slot = stale.second;
+            refresh.position = entry.position;
+            refresh.radius = entry.radius;
+            for (unsigned int face = 0; face < 6; face++) {
+                entry.faceMatrices[face] = faceProjection * glm::lookAt(entry.position,
+                                                                        entry.position + faceDirections[face],
+                                                                        faceUps[face]);
+                refresh.faceMatrices[face] = entry.faceMatrices[face];
+                refresh.faces[face] = entry.faces[face];
+
+                ShadowTileData &tileData = _tileData[stale.second * 6 + face];
+                tileData.viewProj = entry.faceMatrices[face];
+                tileData.rect = glm::vec4((float) entry.faces[face].x, (float) entry.faces[face].y,
+                                          (float) entry.faces[face].size, 0.0f) / (float) SHADOW_ATLAS_SIZE;
+                tileData.positionRadius = glm::vec4(entry.position, entry.radius);
+            }
+            _tileBuffer->update(&_tileData[stale.second * 6], sizeof(ShadowTileData) * 6,
+                                sizeof(ShadowTileData) * stale.second * 6);
+            _refreshes.push_back(refresh);
+        }
+        _stats.refreshedLights = (uint32_t) _refreshes.size();
+
+        // only lights with drawn tiles are shadowed
+        for (auto &light: lights) {
+            light.shadowIndex = -1;
+        }
+        uint64_t allocatedTexels = 0;
+        for (uint32_t slot = 0; slot < MAX_SHADOWED_LIGHTS; slot++) {
+            const ShadowEntry &entry = _entries[slot];
+            if (entry.light == UINT32_MAX) {
+                continue;
+            }
+            if (entry.rendered) {
+                lights[entry.light].shadowIndex = (int32_t) slot;
+                _stats.shadowedLights++;
+            }
+            uint32_t size = entry.faces[0].size;
+            _stats.tilesBySize[level_of(size) - level_of(SHADOW_ATLAS_MAX_TILE)] += 6;
+            allocatedTexels += 6 * (uint64_t) size * size;
+        }
+        _stats.occupancy = (float) ((double) allocatedTexels / ((double) SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE));
+    }
+
+    void ShadowAtlas::record_cost(double gpuMs, uint32_t faceCount) {
+        if (faceCount == 0) {
+            return;
+        }
+        _faceCost += (gpuMs / (double) faceCount - _faceCost) * 0.1;
+    }
+
+    uint32_t ShadowAtlas::level_of(uint32_t size) {
+        uint32_t level = 0;
+        while ((SHADOW_ATLAS_SIZE >> level) > size) {
+            level++;
+        }
+        return level;
+    }
+
+    bool ShadowAtlas::allocate(uint32_t level, AtlasTile &tile) {
+        if (!_freeTiles[level].empty()) {
+            tile = _freeTiles[level].back();
+            _freeTiles[level].pop_back();
+            return true;
+        }
+        AtlasTile parent;
+        if (level == 0 || !allocate(level - 1, parent)) {
+            return false;
+        }
+        uint32_t size = parent.size / 2;
+        tile = {parent.x, parent.y, size};
+        _freeTiles[level].push_back({parent.x + size, parent.y + size, size});
+        _freeTiles[level].push_back({parent.x, parent.y + size, size});
+        _freeTiles[level].push_back({parent.x + size, parent.y, size});
+        return true;
+    }
+
+    void ShadowAtlas::free(const AtlasTile &tile) {
+        uint32_t level = level_of(tile.size);
+        std::vector<AtlasTile> &freeTiles = _freeTiles[level];
+        if (level == 0) {
+            freeTiles.push_back(tile);
+            return;
+        }
+        uint32_t parentSize = tile.size * 2;
+        uint32_t parentX = tile.x - tile.x % parentSize;
+        uint32_t parentY = tile.y - tile.y % parentSize;
+        auto is_sibling = [&](const AtlasTile &other) {
+            return other.x - other.x % parentSize == parentX && other.y - other.y % parentSize == parentY;
+        };
+        if (std::count_if(freeTiles.begin(), freeTiles.end(), is_sibling) < 3) {
+            freeTiles.push_back(tile);
+            return;
+        }
+        freeTiles.erase(std::remove_if(freeTiles.begin(), freeTiles.end(), is_sibling), freeTiles.end());
+        free({parentX, parentY, parentSize});
+    }
+
+    bool ShadowAtlas::allocate_faces(ShadowEntry &entry, uint32_t size) {
+        for (; size >= SHADOW_ATLAS_MIN_TILE; size /= 2) {
+            uint32_t allocated = 0;
+            while (allocated < 6 && allocate(level_of(size), entry.faces[allocated])) {
+                allocated++;
+            }
+            if (allocated == 6) {
+                return true;
+            }
+            for (uint32_t face = 0; face < allocated; face++) {
+                free(entry.faces[face]);
+            }
+        }
+        for (auto &face: entry.faces) {
+            face = AtlasTile{};
+        }
+        return false;
+    }
+
+    void ShadowAtlas::release(ShadowEntry &entry) {
+        for (auto &face: entry.faces) {
+            if (face.size > 0) {
+                free(face);
+            }
+        }
+        entry = ShadowEntry{};
+    }
+
+    void ShadowAtlas::cleanup() {
+        _tileBuffer->cleanup();
+        delete _tileBuffer;
+        _tileBuffer = nullptr;
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &texture);
+    }
+}
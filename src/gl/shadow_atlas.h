@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <gl/shader_data.h>
+#include <gl/uniform_buffer.h>
+#include <gl/culling.h>
+
+namespace GLRenderer {
+    // one depth texture shared by the shadowed point lights; every light gets six square tiles, one per cube face,
+    // sized by how large the light is on screen
+    constexpr uint32_t SHADOW_ATLAS_SIZE = 4096;
+    constexpr uint32_t SHADOW_ATLAS_MAX_TILE = 1024;
+    constexpr uint32_t SHADOW_ATLAS_MIN_TILE = 128;
+    // tile sizes from the largest down, each a quadtree level
+    constexpr uint32_t SHADOW_ATLAS_TILE_SIZES = 4;
+    constexpr uint32_t MAX_SHADOWED_LIGHTS = 64;
+    constexpr unsigned int SHADOW_ATLAS_UNIT = 2;
+
+    // a square of the atlas in texels
+    struct AtlasTile {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t size = 0;
+    };
+
+    // a shadowed light redrawn this frame
+    struct ShadowRefresh {
+        uint32_t slot;
+        glm::vec3 position;
+        float radius;
+        glm::mat4 faceMatrices[6];
+        AtlasTile faces[6];
+    };
+
+    struct ShadowAtlasStats {
+        uint32_t shadowedLights = 0;
+        // shadowed lights whose tiles are out of date, including the ones redrawn this frame
+        uint32_t staleLights = 0;
+        uint32_t refreshedLights = 0;
+        // faces of allocated tiles at each size, largest first
+        uint32_t tilesBySize[SHADOW_ATLAS_TILE_SIZES] = {};
+        // allocated fraction of the atlas area
+        float occupancy = 0.0f;
+        // cost model estimate for this frame's refreshes
+        double estimatedCost = 0.0;
+    };
+
+    // quadtree allocator for the atlas plus the scheduler deciding which lights hold tiles and which stale ones
+    // get redrawn; the renderer draws the refreshes
+    class ShadowAtlas {
+    public:
+        ShadowAtlas();
+
+        // ranks the lights by projected size, hands tiles to the most important maxLights, sets every light's
+        // shadowIndex and picks the stale lights to redraw within budgetMs, highest priority first
+        void schedule(std::vector<PointLight> &lights, const Frustum &frustum, const glm::vec3 &cameraPos,
+                      float pixelScale, uint32_t maxLights, double budgetMs, const std::vector<AABB> &movedBounds,
+                      bool invalidateAll);
+
+        const std::vector<ShadowRefresh> &get_refreshes() const { return _refreshes; }
+
+        // feeds the cost model with the measured GPU time of a frame that drew faceCount faces
+        void record_cost(double gpuMs, uint32_t faceCount);
+
+        double get_face_cost() const { return _faceCost; }
+
+        const ShadowAtlasStats &get_stats() const { return _stats; }
+
+        unsigned int texture = 0;
+        unsigned int framebuffer = 0;
+
+        void cleanup();
+
+    private:
+        struct ShadowEntry {
+            // UINT32_MAX when the slot is free
+            uint32_t light = UINT32_MAX;
+            float importance = 0.0f;
+            AtlasTile faces[6];
+            // size asked for, the faces may be smaller when the atlas was full
+            uint32_t requestedSize = 0;
+            // the light as its tiles were last drawn
+            glm::vec3 position = glm::vec3(0.0f);
+            float radius = 0.0f;
+            glm::mat4 faceMatrices[6];
+            bool rendered = false;
+            bool stale = true;
+            uint64_t lastRefresh = 0;
+        };
+
+        std::vector<ShadowEntry> _entries;
+        // free tiles of every quadtree level, level 0 is the whole atlas
+        std::vector<std::vector<AtlasTile>> _freeTiles;
+        std::vector<std::pair<float, uint32_t>> _candidates;
+        // entry slot of every light, UINT32_MAX for lights without tiles
+        std::vector<uint32_t> _lightSlots;
+        std::vector<std::pair<float, uint32_t>> _staleEntries;
+        std::vector<ShadowRefresh> _refreshes;
+        std::vector<ShadowTileData> _tileData;
+        UniformBuffer *_tileBuffer = nullptr;
+        ShadowAtlasStats _stats;
+        uint64_t _frame = 0;
+        // exponential moving average of the GPU ms per face
+        double _faceCost = 0.05;
+
+        static uint32_t level_of(uint32_t size);
+
+        bool allocate(uint32_t level, AtlasTile &tile);
+
+        // merges the tile back with its siblings when all four are free
+        void free(const AtlasTile &tile);
+
+        // all six faces at size or smaller, false if not even the smallest tiles fit
+        bool allocate_faces(ShadowEntry &entry, uint32_t size);
+
+        void release(ShadowEntry &entry);
+    };
+}
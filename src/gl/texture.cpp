@@ -6,42 +6,394 @@
 
 #include <stb_image.h>
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <profiler.h>
+#include <thread_pool.h>
 
 namespace GLRenderer {
-    TextureManager::TextureManager(const std::string &defaultTexturePath) {
-        _defaultTexture = create_texture(defaultTexturePath, "texture_base");
+    TextureManager::TextureManager(const std::string &defaultTexturePath, size_t budgetBytes) {
+        _budgetBytes = budgetBytes;
+
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (int i = 0; i < extensionCount; i++) {
+            auto extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+            if (extension && std::string(extension) == "GL_EXT_texture_compression_s3tc") {
+                _s3tcSupported = true;
+            }
+        }
+
+        // the default texture keeps one reference forever so it is never evicted
+        _defaultTexture = nullptr;
+        _defaultTexture = reference(create_texture(canonical_path(defaultTexturePath), "texture_base"));
+    }
+
+    void TextureManager::preload_textures(const std::vector<std::string> &filePaths, ThreadPool *pool) {
+        // skip anything already uploaded or waiting for upload
+        std::vector<std::string> newPaths;
+        for (auto &filePath: filePaths) {
+            std::string canonicalPath = canonical_path(filePath);
+            if (_texturePaths.find(canonicalPath) == _texturePaths.end() &&
+                _preloadedImages.find(canonicalPath) == _preloadedImages.end() &&
+                std::find(newPaths.begin(), newPaths.end(), canonicalPath) == newPaths.end()) {
+                newPaths.push_back(canonicalPath);
+            }
+        }
+
+        // _textures is only read while the workers run, so checking for known contents is safe
+        std::vector<ImageData> images(newPaths.size());
+        pool->parallel_for(newPaths.size(), [this, &newPaths, &images](size_t i) {
+            PROFILE_ZONE("TextureManager::decode");
+            std::vector<unsigned char> contents;
+            uint64_t contentHash = 0;
+            bool isBaked = false;
+            if (!read_texture_file(newPaths[i], contents, contentHash, isBaked)) {
+                return;
+            }
+            if (_textures.find(contentHash) != _textures.end()) {
+                images[i].contentHash = contentHash;
+                return;
+            }
+            images[i] = load_image(newPaths[i], contents, contentHash, isBaked);
+        });
+
+        for (size_t i = 0; i < newPaths.size(); i++) {
+            _preloadedImages[newPaths[i]] = images[i];
+        }
+    }
+
+    Texture *TextureManager::acquire_texture(const std::string &filePath, const std::string &typeName) {
+        // an empty path means the material has no texture of this type
+        if (filePath.empty()) {
+            return reference(_defaultTexture);
+        }
+
+        std::string canonicalPath = canonical_path(filePath);
+        auto existingPath = _texturePaths.find(canonicalPath);
+        if (existingPath != _texturePaths.end()) {
+            return reference(&_textures[existingPath->second]);
+        }
+
+        Texture *texture = reference(create_texture(canonicalPath, typeName));
+        enforce_budget();
+        return texture;
+    }
+
+    void TextureManager::release_texture(Texture *texture) {
+        if (!texture || texture->refCount == 0) {
+            return;
+        }
+        texture->refCount--;
+        if (texture->refCount == 0) {
+            enforce_budget();
+        }
     }
 
-    Texture *TextureManager::create_texture(const std::string &filePath, const std::string &typeName) {
-        int texWidth, texHeight, texChannels;
+    Texture *TextureManager::create_texture(const std::string &canonicalPath, const std::string &typeName) {
+        PROFILE_ZONE("TextureManager::create_texture");
+        // use the preloaded image data if there is any, otherwise read and decode now
+        ImageData image;
+        bool decode = true;
+        auto preloaded = _preloadedImages.find(canonicalPath);
+        if (preloaded != _preloadedImages.end()) {
+            image = preloaded->second;
+            _preloadedImages.erase(preloaded);
+            // the preload skips contents that were already resident, if that texture was evicted since then
+            // the file has to be decoded after all
+            decode = !image.pixels && !image.isBaked && image.contentHash != 0 &&
+                     _textures.find(image.contentHash) == _textures.end();
+        }
+        if (decode) {
+            std::vector<unsigned char> contents;
+            bool isBaked = false;
+            if (read_texture_file(canonicalPath, contents, image.contentHash, isBaked)) {
+                if (_textures.find(image.contentHash) == _textures.end()) {
+                    image = load_image(canonicalPath, contents, image.contentHash, isBaked);
+                }
+            }
+        }
+
+        // same contents under a different path, share the existing texture
+        auto existingTexture = _textures.find(image.contentHash);
+        if (image.contentHash != 0 && existingTexture != _textures.end()) {
+            if (image.pixels) {
+                stbi_image_free(image.pixels);
+            }
+            _texturePaths[canonicalPath] = image.contentHash;
+            std::cout << "Texture " << canonicalPath << " is a duplicate, sharing existing texture" << std::endl;
+            return &existingTexture->second;
+        }
 
-        // load the image data
-        stbi_uc *pixels = stbi_load(filePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        if (!pixels) {
-            std::cout << "Failed to load texture " << filePath << ", substituting for default" << std::endl;
+        int texWidth = image.width;
+        int texHeight = image.height;
+        stbi_uc *pixels = image.pixels;
+        if (!pixels && !image.isBaked) {
+            std::cout << "Failed to load texture " << canonicalPath << ", substituting for default" << std::endl;
             return _defaultTexture;
         }
 
         // create texture
         Texture newTexture;
         newTexture.type = typeName;
+        newTexture.contentHash = image.contentHash;
+
+        if (image.isBaked) {
+            // baked mip chain goes up as-is
+            newTexture.sizeBytes = image.baked.data.size();
+            if (_pools.allocate(image.baked.format, image.baked.width, image.baked.height,
+                                (uint32_t) image.baked.levels.size(), newTexture.sizeBytes, newTexture.slot)) {
+                upload_baked(newTexture.slot, image.baked);
+
+                _textures[newTexture.contentHash] = newTexture;
+                _texturePaths[canonicalPath] = newTexture.contentHash;
+                _residentBytes += newTexture.sizeBytes;
+                std::cout << "Loaded baked texture " << canonicalPath << " (" << baked_format_name(image.baked.format)
+                          << ", " << image.baked.levels.size() << " levels)" << std::endl;
+                return &_textures[newTexture.contentHash];
+            }
+
+            // compressed blocks can't be resized, decode the source to go through the RGBA8 path instead
+            std::cout << "Error: no texture pool for baked texture " << canonicalPath << ", decoding the source"
+                      << std::endl;
+            ImageData source = decode_source(canonicalPath);
+            image.isBaked = false;
+            image.baked = BakedTexture{};
+            image.pixels = source.pixels;
+            image.width = source.width;
+            image.height = source.height;
+            texWidth = image.width;
+            texHeight = image.height;
+            pixels = image.pixels;
+            if (!pixels) {
+                _unpooledTextures++;
+                std::cout << "Error: failed to load texture " << canonicalPath << ", substituting for default"
+                          << std::endl;
+                return _defaultTexture;
+            }
+        }
 
-        // generate and set parameters
-        GLenum format = GL_RGBA;
-        glGenTextures(1, &newTexture.id);
-        glBindTexture(GL_TEXTURE_2D, newTexture.id);
-        glTexImage2D(GL_TEXTURE_2D, 0, (GLint) format, texWidth, texHeight, 0, format, GL_UNSIGNED_BYTE, pixels);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        newTexture.sizeBytes = (size_t) texWidth * (size_t) texHeight * 4;
+        if (!_pools.allocate(GL_RGBA8, (uint32_t) texWidth, (uint32_t) texHeight, 1, newTexture.sizeBytes,
+                             newTexture.slot)) {
+            // out of pools, resize into the closest existing RGBA8 pool rather than dropping the texture
+            uint32_t poolWidth = 0;
+            uint32_t poolHeight = 0;
+            if (!_pools.find_closest_size(GL_RGBA8, 1, (uint32_t) texWidth, (uint32_t) texHeight, poolWidth,
+                                          poolHeight)) {
+                stbi_image_free(pixels);
+                _unpooledTextures++;
+                std::cout << "Error: no texture pool for " << canonicalPath << ", substituting for default"
+                          << std::endl;
+                return _defaultTexture;
+            }
+            std::cout << "Error: no texture pool for " << canonicalPath << ", resizing " << texWidth << "x"
+                      << texHeight << " to " << poolWidth << "x" << poolHeight << std::endl;
+            resize_image(image, (int) poolWidth, (int) poolHeight);
+            texWidth = image.width;
+            texHeight = image.height;
+            pixels = image.pixels;
+            newTexture.sizeBytes = (size_t) texWidth * (size_t) texHeight * 4;
+            _pools.allocate(GL_RGBA8, poolWidth, poolHeight, 1, newTexture.sizeBytes, newTexture.slot);
+            _resizedTextures++;
+        }
+        _pools.upload(newTexture.slot, 0, (uint32_t) texWidth, (uint32_t) texHeight, pixels);
 
-        // just use file path as texture name for now
-        _textures[filePath] = newTexture;
-        std::cout << "Loaded texture " << filePath << std::endl;
+        _textures[newTexture.contentHash] = newTexture;
+        _texturePaths[canonicalPath] = newTexture.contentHash;
+        _residentBytes += newTexture.sizeBytes;
+        std::cout << "Loaded texture " << canonicalPath << std::endl;
 
         stbi_image_free(pixels);
-        return &_textures[filePath];
+        return &_textures[newTexture.contentHash];
+    }
+
+    Texture *TextureManager::reference(Texture *texture) {
+        if (texture) {
+            texture->refCount++;
+            texture->lastUsed = ++_useCounter;
+        }
+        return texture;
+    }
+
+    void TextureManager::enforce_budget() {
+        while (_residentBytes > _budgetBytes) {
+            // find the least recently used texture nobody references
+            auto victim = _textures.end();
+            for (auto it = _textures.begin(); it != _textures.end(); ++it) {
+                if (it->second.refCount == 0 && (victim == _textures.end() || it->second.lastUsed < victim->second.lastUsed)) {
+                    victim = it;
+                }
+            }
+            if (victim == _textures.end()) {
+                // everything resident is in use
+                return;
+            }
+
+            uint64_t contentHash = victim->first;
+            for (auto it = _texturePaths.begin(); it != _texturePaths.end();) {
+                if (it->second == contentHash) {
+                    it = _texturePaths.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            _pools.free(victim->second.slot);
+            _residentBytes -= victim->second.sizeBytes;
+            _textures.erase(victim);
+        }
+    }
+
+    void TextureManager::set_budget(size_t budgetBytes) {
+        _budgetBytes = budgetBytes;
+        enforce_budget();
+    }
+
+    void TextureManager::cleanup() {
+        _pools.cleanup();
+        for (auto &it: _preloadedImages) {
+            if (it.second.pixels) {
+                stbi_image_free(it.second.pixels);
+            }
+        }
+        _textures.clear();
+        _texturePaths.clear();
+        _pbrTextures.clear();
+        _preloadedImages.clear();
+        _residentBytes = 0;
+        _defaultTexture = nullptr;
+    }
+
+    std::string TextureManager::canonical_path(const std::string &filePath) {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(filePath, error);
+        if (error) {
+            return filePath;
+        }
+        return canonical.string();
+    }
+
+    bool TextureManager::read_texture_file(const std::string &filePath, std::vector<unsigned char> &contents,
+                                           uint64_t &contentHash, bool &isBaked) const {
+        // only use the baked file if it is newer than its source and the format can be sampled
+        std::string bakedPath = baked_texture_path(filePath);
+        std::error_code error;
+        auto bakedTime = std::filesystem::last_write_time(bakedPath, error);
+        if (!error) {
+            auto sourceTime = std::filesystem::last_write_time(filePath, error);
+            if ((error || bakedTime >= sourceTime) && read_file(bakedPath, contents, contentHash)) {
+                BakedTextureHeader header{};
+                if (contents.size() >= sizeof(header)) {
+                    std::memcpy(&header, contents.data(), sizeof(header));
+                }
+                bool needsS3tc = header.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+                                 header.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                if (!needsS3tc || _s3tcSupported) {
+                    isBaked = true;
+                    return true;
+                }
+            }
+        }
+
+        isBaked = false;
+        return read_file(filePath, contents, contentHash);
+    }
+
+    bool TextureManager::read_file(const std::string &filePath, std::vector<unsigned char> &contents,
+                                   uint64_t &contentHash) {
+        std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        auto fileSize = (size_t) file.tellg();
+        contents.resize(fileSize);
+        file.seekg(0);
+        file.read((char *) contents.data(), (std::streamsize) fileSize);
+        if (!file) {
+            return false;
+        }
+
+        // 64-bit FNV-1a
+        contentHash = 0xcbf29ce484222325ull;
+        for (unsigned char byte: contents) {
+            contentHash ^= byte;
+            contentHash *= 0x100000001b3ull;
+        }
+        return true;
+    }
+
+    ImageData TextureManager::load_image(const std::string &filePath, const std::vector<unsigned char> &contents,
+                                         uint64_t contentHash, bool isBaked) {
+        ImageData image;
+        image.contentHash = contentHash;
+        if (isBaked) {
+            image.isBaked = parse_baked_texture(contents, image.baked);
+            if (!image.isBaked) {
+                std::cout << "Baked texture for " << filePath << " is unreadable, decoding the source instead"
+                          << std::endl;
+                return decode_source(filePath);
+            }
+            image.width = (int) image.baked.width;
+            image.height = (int) image.baked.height;
+            return image;
+        }
+
+        int texChannels;
+        image.pixels = stbi_load_from_memory(contents.data(), (int) contents.size(), &image.width, &image.height,
+                                             &texChannels, STBI_rgb_alpha);
+        return image;
+    }
+
+    ImageData TextureManager::decode_source(const std::string &filePath) {
+        std::vector<unsigned char> contents;
+        uint64_t contentHash = 0;
+        if (!read_file(filePath, contents, contentHash)) {
+            return ImageData{};
+        }
+        return load_image(filePath, contents, contentHash, false);
+    }
+
+    void TextureManager::upload_baked(const TextureSlot &slot, const BakedTexture &baked) {
+        for (size_t level = 0; level < baked.levels.size(); level++) {
+            const BakedTextureLevel &bakedLevel = baked.levels[level];
+            _pools.upload_compressed(slot, (uint32_t) level, bakedLevel.width, bakedLevel.height, bakedLevel.size,
+                                     baked.data.data() + bakedLevel.offset);
+        }
+    }
+
+    void TextureManager::resize_image(ImageData &image, int width, int height) {
+        // allocated like stb_image does so the result is freed the same way
+        auto *resized = (stbi_uc *) malloc((size_t) width * (size_t) height * 4);
+        float scaleX = (float) image.width / (float) width;
+        float scaleY = (float) image.height / (float) height;
+        for (int y = 0; y < height; y++) {
+            float sourceY = std::clamp(((float) y + 0.5f) * scaleY - 0.5f, 0.0f, (float) (image.height - 1));
+            int y0 = (int) sourceY;
+            int y1 = std::min(y0 + 1, image.height - 1);
+            float fy = sourceY - (float) y0;
+            for (int x = 0; x < width; x++) {
+                float sourceX = std::clamp(((float) x + 0.5f) * scaleX - 0.5f, 0.0f, (float) (image.width - 1));
+                int x0 = (int) sourceX;
+                int x1 = std::min(x0 + 1, image.width - 1);
+                float fx = sourceX - (float) x0;
+                for (int channel = 0; channel < 4; channel++) {
+                    auto texel = [&](int tx, int ty) {
+                        return (float) image.pixels[((size_t) ty * (size_t) image.width + (size_t) tx) * 4 + channel];
+                    };
+                    float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * fx;
+                    float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * fx;
+                    resized[((size_t) y * (size_t) width + (size_t) x) * 4 + channel] =
+                            (stbi_uc) (top + (bottom - top) * fy + 0.5f);
+                }
+            }
+        }
+        stbi_image_free(image.pixels);
+        image.pixels = resized;
+        image.width = width;
+        image.height = height;
     }
 
     PBRTexture *TextureManager::create_pbr_texture(std::vector<Texture *> &textureMaps, const std::string &name) {
@@ -49,27 +401,42 @@ namespace GLRenderer {
         newPbrTexture.albedo = textureMaps[0];
         newPbrTexture.normal = textureMaps[1];
         newPbrTexture.metalroughness = textureMaps[2];
+        newPbrTexture.refCount = 1;
 
         _pbrTextures[name] = newPbrTexture;
         std::cout << "Loaded PBR texture " << name << std::endl;
         return &_pbrTextures[name];
     }
 
-    Texture *TextureManager::get_texture(const std::string &name) {
-        if (_textures.find(name) == _textures.end()) {
+    PBRTexture *TextureManager::acquire_pbr_texture(const std::string &name) {
+        auto existingTexture = _pbrTextures.find(name);
+        if (existingTexture == _pbrTextures.end()) {
             // does not exist
             return nullptr;
-        } else {
-            return &_textures[name];
         }
+        existingTexture->second.refCount++;
+        return &existingTexture->second;
     }
 
-    PBRTexture *TextureManager::get_pbr_texture(const std::string &name) {
-        if (_pbrTextures.find(name) == _pbrTextures.end()) {
-            // does not exist
-            return nullptr;
-        } else {
-            return &_pbrTextures[name];
+    void TextureManager::release_pbr_texture(PBRTexture *pbrTexture) {
+        if (!pbrTexture || pbrTexture->refCount == 0) {
+            return;
+        }
+        pbrTexture->refCount--;
+        if (pbrTexture->refCount > 0) {
+            return;
+        }
+
+        // drop the references on the maps, then the entry itself
+        Texture *textureMaps[3] = {pbrTexture->albedo, pbrTexture->normal, pbrTexture->metalroughness};
+        for (auto it = _pbrTextures.begin(); it != _pbrTextures.end(); ++it) {
+            if (&it->second == pbrTexture) {
+                _pbrTextures.erase(it);
+                break;
+            }
+        }
+        for (auto texture: textureMaps) {
+            release_texture(texture);
         }
     }
 }
\ No newline at end of file
@@ -2,36 +2,124 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 #include <unordered_map>
+#include <gl/baked_texture.h>
+#include <gl/texture_pool.h>
+
+class ThreadPool;
 
 namespace GLRenderer {
+    // decoded RGBA8 pixels owned by stb until uploaded, or a baked mip chain
+    struct ImageData {
+        int width = 0;
+        int height = 0;
+        unsigned char *pixels = nullptr;
+        uint64_t contentHash = 0;
+        bool isBaked = false;
+        BakedTexture baked;
+    };
+
     struct Texture {
-        unsigned int id;
+        // layer of a pooled texture array
+        TextureSlot slot;
         std::string type;
+        uint64_t contentHash = 0;
+        size_t sizeBytes = 0;
+        uint32_t refCount = 0;
+        uint64_t lastUsed = 0;
     };
 
+    // holds one reference on each of its maps
     struct PBRTexture {
         Texture *albedo;
         Texture *normal;
         Texture *metalroughness;
+        uint32_t refCount = 0;
     };
 
+    // shared by every model; textures are deduplicated by canonical path and file contents,
+    // and unreferenced ones stay resident until the budget forces them out, least recently used first
     class TextureManager {
     public:
-        explicit TextureManager(const std::string &defaultTexturePath);
+        TextureManager(const std::string &defaultTexturePath, size_t budgetBytes);
+
+        // decodes images across the pool so acquire_texture only has to do the GL upload
+        void preload_textures(const std::vector<std::string> &filePaths, ThreadPool *pool);
 
-        Texture *create_texture(const std::string &filePath, const std::string &typeName);
+        // returns a referenced texture, loading it if needed, or the default texture if loading fails
+        Texture *acquire_texture(const std::string &filePath, const std::string &typeName);
 
+        void release_texture(Texture *texture);
+
+        // takes over the references held in textureMaps
         PBRTexture *create_pbr_texture(std::vector<Texture *> &textureMaps, const std::string &name);
 
-        Texture *get_texture(const std::string &name);
+        // returns a referenced PBR texture or nullptr if it does not exist yet
+        PBRTexture *acquire_pbr_texture(const std::string &name);
+
+        void release_pbr_texture(PBRTexture *pbrTexture);
+
+        void set_budget(size_t budgetBytes);
+
+        void cleanup();
+
+        size_t get_budget() const { return _budgetBytes; }
+
+        size_t get_resident_bytes() const { return _residentBytes; }
+
+        size_t get_texture_count() const { return _textures.size(); }
+
+        TexturePoolSet *get_pools() { return &_pools; }
+
+        // textures resized to fit an existing pool, and ones that got the default texture, once the pools ran out
+        uint32_t get_resized_texture_count() const { return _resizedTextures; }
 
-        PBRTexture *get_pbr_texture(const std::string &name);
+        uint32_t get_unpooled_texture_count() const { return _unpooledTextures; }
 
         Texture *_defaultTexture;
 
     private:
-        std::unordered_map<std::string, Texture> _textures;
+        // textures keyed by content hash, with every path that resolved to them
+        std::unordered_map<uint64_t, Texture> _textures;
+        std::unordered_map<std::string, uint64_t> _texturePaths;
         std::unordered_map<std::string, PBRTexture> _pbrTextures;
+        std::unordered_map<std::string, ImageData> _preloadedImages;
+        TexturePoolSet _pools;
+
+        // BC1/BC3 need EXT_texture_compression_s3tc, without it baked files using them are ignored
+        bool _s3tcSupported = false;
+
+        size_t _budgetBytes = 0;
+        size_t _residentBytes = 0;
+        uint64_t _useCounter = 0;
+        uint32_t _resizedTextures = 0;
+        uint32_t _unpooledTextures = 0;
+
+        Texture *create_texture(const std::string &canonicalPath, const std::string &typeName);
+
+        Texture *reference(Texture *texture);
+
+        void enforce_budget();
+
+        static std::string canonical_path(const std::string &filePath);
+
+        // reads an up to date baked container if there is one, otherwise the source image
+        bool read_texture_file(const std::string &filePath, std::vector<unsigned char> &contents,
+                               uint64_t &contentHash, bool &isBaked) const;
+
+        static bool read_file(const std::string &filePath, std::vector<unsigned char> &contents, uint64_t &contentHash);
+
+        // a baked file that does not parse (corrupt, truncated or an old version) falls back to the source image
+        static ImageData load_image(const std::string &filePath, const std::vector<unsigned char> &contents,
+                                    uint64_t contentHash, bool isBaked);
+
+        // reads and decodes the source image, ignoring any baked file
+        static ImageData decode_source(const std::string &filePath);
+
+        void upload_baked(const TextureSlot &slot, const BakedTexture &baked);
+
+        // bilinear resample of RGBA8 pixels, replacing them in the image
+        static void resize_image(ImageData &image, int width, int height);
     };
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "texture_pool.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace GLRenderer {
+    bool TexturePoolSet::allocate(GLenum format, uint32_t width, uint32_t height, uint32_t levels, size_t layerBytes,
+                                  TextureSlot &slot) {
+        uint32_t poolIndex = 0;
+        while (poolIndex < _pools.size()) {
+            const Pool &pool = _pools[poolIndex];
+            if (pool.format == format && pool.width == width && pool.height == height && pool.levels == levels) {
+                break;
+            }
+            poolIndex++;
+        }
+        if (poolIndex == _pools.size()) {
+            if (_pools.size() >= MAX_TEXTURE_POOLS) {
+                std::cout << "Error: all " << MAX_TEXTURE_POOLS << " texture pools are in use, none left for "
+                          << width << "x" << height << " format 0x" << std::hex << format << std::dec << std::endl;
+                return false;
+            }
+            Pool pool;
+            pool.format = format;
+            pool.width = width;
+            pool.height = height;
+            pool.levels = levels;
+            pool.capacity = TEXTURE_POOL_INITIAL_LAYERS;
+            pool.layerBytes = layerBytes;
+            pool.id = create_array(pool, pool.capacity);
+            make_resident(pool);
+            _pools.push_back(pool);
+            _version++;
+        }
+
+        Pool &pool = _pools[poolIndex];
+        slot.pool = poolIndex;
+        if (!pool.freeLayers.empty()) {
+            slot.layer = pool.freeLayers.back();
+            pool.freeLayers.pop_back();
+            return true;
+        }
+        if (pool.layerCount == pool.capacity) {
+            grow(pool);
+        }
+        slot.layer = pool.layerCount++;
+        return true;
+    }
+
+    bool TexturePoolSet::find_closest_size(GLenum format, uint32_t levels, uint32_t width, uint32_t height,
+                                           uint32_t &poolWidth, uint32_t &poolHeight) const {
+        double area = std::log((double) width * (double) height);
+        double closest = 0.0;
+        bool found = false;
+        for (auto &pool: _pools) {
+            if (pool.format != format || pool.levels != levels) {
+                continue;
+            }
+            double distance = std::abs(std::log((double) pool.width * (double) pool.height) - area);
+            if (!found || distance < closest) {
+                poolWidth = pool.width;
+                poolHeight = pool.height;
+                closest = distance;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void TexturePoolSet::free(const TextureSlot &slot) {
+        if (slot.pool < _pools.size()) {
+            _pools[slot.pool].freeLayers.push_back(slot.layer);
+        }
+    }
+
+    void TexturePoolSet::upload(const TextureSlot &slot, uint32_t level, uint32_t width, uint32_t height,
+                                const void *pixels) {
+        glTextureSubImage3D(_pools[slot.pool].id, (GLint) level, 0, 0, (GLint) slot.layer, (GLsizei) width,
+                            (GLsizei) height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    void TexturePoolSet::upload_compressed(const TextureSlot &slot, uint32_t level, uint32_t width, uint32_t height,
+                                           size_t size, const void *data) {
+        const Pool &pool = _pools[slot.pool];
+        glCompressedTextureSubImage3D(pool.id, (GLint) level, 0, 0, (GLint) slot.layer, (GLsizei) width,
+                                      (GLsizei) height, 1, pool.format, (GLsizei) size, data);
+    }
+
+    void TexturePoolSet::enable_bindless(const BindlessFunctions &functions) {
+        _functions = functions;
+        _bindless = true;
+        for (auto &pool: _pools) {
+            make_resident(pool);
+        }
+        _version++;
+    }
+
+    size_t TexturePoolSet::get_bytes() const {
+        size_t bytes = 0;
+        for (auto &pool: _pools) {
+            bytes += pool.layerBytes * pool.capacity;
+        }
+        return bytes;
+    }
+
+    void TexturePoolSet::cleanup() {
+        for (auto &pool: _pools) {
+            release_texture(pool);
+        }
+        _pools.clear();
+        _version++;
+    }
+
+    unsigned int TexturePoolSet::create_array(const Pool &pool, uint32_t capacity) const {
+        unsigned int id = 0;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &id);
+        glTextureStorage3D(id, (GLsizei) pool.levels, pool.format, (GLsizei) pool.width, (GLsizei) pool.height,
+                           (GLsizei) capacity);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, pool.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return id;
+    }
+
+    void TexturePoolSet::grow(Pool &pool) {
+        uint32_t capacity = pool.capacity * 2;
+        unsigned int id = create_array(pool, capacity);
+        for (uint32_t level = 0; level < pool.levels; level++) {
+            uint32_t width = std::max(pool.width >> level, 1u);
+            uint32_t height = std::max(pool.height >> level, 1u);
+            glCopyImageSubData(pool.id, GL_TEXTURE_2D_ARRAY, (GLint) level, 0, 0, 0, id, GL_TEXTURE_2D_ARRAY,
+                               (GLint) level, 0, 0, 0, (GLsizei) width, (GLsizei) height, (GLsizei) pool.layerCount);
+        }
+        release_texture(pool);
+        pool.id = id;
+        pool.capacity = capacity;
+        make_resident(pool);
+        _version++;
+    }
+
+    void TexturePoolSet::make_resident(Pool &pool) {
+        // the handle freezes the texture's state, so it is taken after storage and parameters are set
+        if (_bindless && pool.handle == 0) {
+            pool.handle = _functions.getTextureHandle(pool.id);
+            _functions.makeTextureHandleResident(pool.handle);
+        }
+    }
+
+    void TexturePoolSet::release_texture(Pool &pool) {
+        if (pool.handle != 0) {
+            _functions.makeTextureHandleNonResident(pool.handle);
+            pool.handle = 0;
+        }
+        glDeleteTextures(1, &pool.id);
+        pool.id = 0;
+    }
+}
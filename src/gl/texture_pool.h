@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+#include <gl/bindless.h>
+
+namespace GLRenderer {
+    // without bindless every pool is bound at once, to the units after the shadow cubemap
+    constexpr uint32_t MAX_TEXTURE_POOLS = 12;
+    constexpr uint32_t TEXTURE_POOL_FIRST_UNIT = 4;
+    constexpr uint32_t TEXTURE_POOL_INITIAL_LAYERS = 4;
+
+    struct TextureSlot {
+        uint32_t pool = 0;
+        uint32_t layer = 0;
+
+        // pool in the high 16 bits, layer in the low 16, as the shaders read it
+        uint32_t packed() const { return pool << 16 | layer; }
+    };
+
+    // textures of the same format, size and level count share a GL_TEXTURE_2D_ARRAY, one layer each,
+    // so a pass binds the pools once instead of three textures per material
+    class TexturePoolSet {
+    public:
+        // returns false if the texture would need a pool past MAX_TEXTURE_POOLS
+        bool allocate(GLenum format, uint32_t width, uint32_t height, uint32_t levels, size_t layerBytes,
+                      TextureSlot &slot);
+
+        // size of the existing pool with this format and level count closest in area to the texture, for when
+        // allocate runs out of pools; false if there is no such pool
+        bool find_closest_size(GLenum format, uint32_t levels, uint32_t width, uint32_t height, uint32_t &poolWidth,
+                               uint32_t &poolHeight) const;
+
+        void free(const TextureSlot &slot);
+
+        void upload(const TextureSlot &slot, uint32_t level, uint32_t width, uint32_t height, const void *pixels);
+
+        void upload_compressed(const TextureSlot &slot, uint32_t level, uint32_t width, uint32_t height, size_t size,
+                               const void *data);
+
+        // pools created from now on get resident handles too
+        void enable_bindless(const BindlessFunctions &functions);
+
+        bool is_bindless() const { return _bindless; }
+
+        uint32_t get_pool_count() const { return (uint32_t) _pools.size(); }
+
+        unsigned int get_texture(uint32_t pool) const { return _pools[pool].id; }
+
+        GLuint64 get_handle(uint32_t pool) const { return _pools[pool].handle; }
+
+        // bumped when a pool is created or reallocated, bindings and handle tables built before are stale
+        uint32_t get_version() const { return _version; }
+
+        // allocated layers, used or not
+        size_t get_bytes() const;
+
+        void cleanup();
+
+    private:
+        struct Pool {
+            unsigned int id = 0;
+            GLuint64 handle = 0;
+            GLenum format = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t levels = 0;
+            uint32_t capacity = 0;
+            uint32_t layerCount = 0;
+            size_t layerBytes = 0;
+            std::vector<uint32_t> freeLayers;
+        };
+
+        std::vector<Pool> _pools;
+        uint32_t _version = 0;
+        bool _bindless = false;
+        BindlessFunctions _functions;
+
+        unsigned int create_array(const Pool &pool, uint32_t capacity) const;
+
+        // doubles the layers, copying the existing ones over
+        void grow(Pool &pool);
+
+        void make_resident(Pool &pool);
+
+        void release_texture(Pool &pool);
+    };
+}
@@ -0,0 +1,30 @@
+#include "uniform_buffer.h"
+
+namespace GLRenderer {
+    UniformBuffer::UniformBuffer(size_t size, unsigned int binding, GLenum target) {
+        this->size = size;
+        this->binding = binding;
+        this->target = target;
+        glCreateBuffers(1, &id);
+        glNamedBufferData(id, (GLsizeiptr) size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(target, binding, id);
+    }
+
+    void UniformBuffer::update(const void *data, size_t size, size_t offset) {
+        glNamedBufferSubData(id, (GLintptr) offset, (GLsizeiptr) size, data);
+    }
+
+    void UniformBuffer::reserve(size_t size) {
+        if (size <= this->size) {
+            return;
+        }
+        this->size = size;
+        glNamedBufferData(id, (GLsizeiptr) size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(target, binding, id);
+    }
+
+    void UniformBuffer::cleanup() {
+        glDeleteBuffers(1, &id);
+        id = 0;
+    }
+}
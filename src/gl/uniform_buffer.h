@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+namespace GLRenderer {
+    // buffer bound once to a fixed block binding, then only updated
+    class UniformBuffer {
+    public:
+        UniformBuffer(size_t size, unsigned int binding, GLenum target = GL_UNIFORM_BUFFER);
+
+        void update(const void *data, size_t size, size_t offset = 0);
+
+        template<typename T>
+        void update(const T &data) {
+            update(&data, sizeof(T));
+        }
+
+        // grows the buffer to at least size bytes, the contents are lost if it reallocates
+        void reserve(size_t size);
+
+        void cleanup();
+
+        unsigned int id = 0;
+        size_t size = 0;
+        unsigned int binding = 0;
+        GLenum target = GL_UNIFORM_BUFFER;
+    };
+}
@@ -0,0 +1,96 @@
+#include "vertex_format.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace GLRenderer {
+    static int16_t encode_snorm16(float value) {
+        return (int16_t) std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+    }
+
+    static int8_t encode_snorm8(float value) {
+        return (int8_t) std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f);
+    }
+
+    static uint16_t encode_half(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        // too small for a normal half, shift into a denormal or flush to zero
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return (uint16_t) sign;
+            }
+            mantissa |= 0x800000;
+            uint32_t shift = (uint32_t) (14 - exponent);
+            uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1) {
+                half++;
+            }
+            return (uint16_t) (sign | half);
+        }
+        // overflow and infinity clamp to infinity, nan stays nan
+        if (exponent >= 31) {
+            bool isNan = ((bits >> 23) & 0xff) == 0xff && mantissa != 0;
+            return (uint16_t) (sign | 0x7c00 | (isNan ? 0x200 : 0));
+        }
+
+        // round to nearest, a carry into the exponent is still correct
+        uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000) {
+            half++;
+        }
+        return (uint16_t) half;
+    }
+
+    // maps a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+    static glm::vec2 encode_octahedral(const glm::vec3 &direction) {
+        float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+        if (length == 0.0f) {
+            return glm::vec2(0.0f, 0.0f);
+        }
+        glm::vec2 encoded(direction.x / length, direction.y / length);
+        if (direction.z < 0.0f) {
+            encoded = glm::vec2((1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f),
+                                (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return encoded;
+    }
+
+    void encode_vertices(const Vertex *vertices, size_t count, const glm::vec3 &center, const glm::vec3 &extent,
+                         PositionVertex *positions, AttributeVertex *attributes) {
+        // flat meshes have a zero extent on one axis
+        glm::vec3 invExtent;
+        for (int axis = 0; axis < 3; axis++) {
+            invExtent[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const Vertex &vertex = vertices[i];
+            glm::vec3 position = (vertex.position - center) * invExtent;
+            positions[i].position[0] = encode_snorm16(position.x);
+            positions[i].position[1] = encode_snorm16(position.y);
+            positions[i].position[2] = encode_snorm16(position.z);
+            positions[i].position[3] = 0;
+
+            glm::vec2 normal = encode_octahedral(vertex.normal);
+            attributes[i].normal[0] = encode_snorm16(normal.x);
+            attributes[i].normal[1] = encode_snorm16(normal.y);
+
+            // the bitangent is rebuilt from normal and tangent, only its handedness is kept
+            glm::vec2 tangent = encode_octahedral(vertex.tangent);
+            float handedness = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+            attributes[i].tangent[0] = encode_snorm8(tangent.x);
+            attributes[i].tangent[1] = encode_snorm8(tangent.y);
+            attributes[i].tangent[2] = encode_snorm8(handedness);
+            attributes[i].tangent[3] = 0;
+
+            attributes[i].uv[0] = encode_half(vertex.uv.x);
+            attributes[i].uv[1] = encode_half(vertex.uv.y);
+        }
+    }
+}
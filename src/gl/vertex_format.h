@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <glad/glad.h>
+#include <gl/vertex.h>
+
+namespace GLRenderer {
+    // GPU vertex streams, also what the mesh cache stores; Vertex stays the full precision import format
+
+    // snorm16 inside the mesh bounds, dequantized with the draw's position scale and offset; w is padding
+    struct PositionVertex {
+        int16_t position[4];
+    };
+
+    // octahedral snorm16 normal, octahedral snorm8 tangent with the bitangent sign in z, half float uv
+    struct AttributeVertex {
+        int16_t normal[2];
+        int8_t tangent[4];
+        uint16_t uv[2];
+    };
+
+    static_assert(sizeof(PositionVertex) == 8, "PositionVertex must stay tightly packed");
+    static_assert(sizeof(AttributeVertex) == 12, "AttributeVertex must stay tightly packed");
+
+    struct VertexAttribute {
+        unsigned int location;
+        int size;
+        GLenum type;
+        bool normalized;
+        unsigned int offset;
+    };
+
+    // attribute table per stream, the shader input locations must match
+    template<typename V>
+    struct VertexLayout;
+
+    template<>
+    struct VertexLayout<PositionVertex> {
+        static constexpr std::array<VertexAttribute, 1> attributes = {{
+            {0, 3, GL_SHORT, true, offsetof(PositionVertex, position)},
+        }};
+    };
+
+    template<>
+    struct VertexLayout<AttributeVertex> {
+        static constexpr std::array<VertexAttribute, 3> attributes = {{
+            {1, 2, GL_SHORT, true, offsetof(AttributeVertex, normal)},
+            {2, 2, GL_HALF_FLOAT, false, offsetof(AttributeVertex, uv)},
+            {3, 4, GL_BYTE, true, offsetof(AttributeVertex, tangent)},
+        }};
+    };
+
+    // sets up every attribute of V on the given VAO binding and points that binding at the buffer
+    template<typename V>
+    void set_vertex_format(unsigned int vao, unsigned int bindingIndex, unsigned int buffer) {
+        glVertexArrayVertexBuffer(vao, bindingIndex, buffer, 0, sizeof(V));
+        for (const auto &attribute: VertexLayout<V>::attributes) {
+            glEnableVertexArrayAttrib(vao, attribute.location);
+            glVertexArrayAttribFormat(vao, attribute.location, attribute.size, attribute.type,
+                                      attribute.normalized ? GL_TRUE : GL_FALSE, attribute.offset);
+            glVertexArrayAttribBinding(vao, attribute.location, bindingIndex);
+        }
+    }
+
+    // quantizes positions into the box given by center and extent, and packs the rest
+    void encode_vertices(const Vertex *vertices, size_t count, const glm::vec3 &center, const glm::vec3 &extent,
+                         PositionVertex *positions, AttributeVertex *attributes);
+
+    // mesh space position of a quantized vertex, as the vertex shaders reconstruct it
+    inline glm::vec3 decode_position(const PositionVertex &vertex, const glm::vec3 &center, const glm::vec3 &extent) {
+        glm::vec3 position((float) vertex.position[0], (float) vertex.position[1], (float) vertex.position[2]);
+        return glm::max(position / 32767.0f, glm::vec3(-1.0f)) * extent + center;
+    }
+}
@@ -1,12 +1,16 @@
 #include <SDL.h>
 #include <iostream>
 #include <chrono>
+#include <string>
+#include <stdexcept>
 #include <imgui.h>
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_opengl3.h>
 #include <implot.h>
 #include <gl/renderer.h>
 #include <gl/check.h>
+#include <benchmark.h>
+#include <profiler.h>
 
 constexpr uint32_t DEFAULT_WINDOW_WIDTH = 1366;
 constexpr uint32_t DEFAULT_WINDOW_HEIGHT = 768;
@@ -16,6 +20,92 @@ int main(int argc, char *argv[]) {
     uint32_t windowWidth = DEFAULT_WINDOW_WIDTH;
     uint32_t windowHeight = DEFAULT_WINDOW_HEIGHT;
 
+    PROFILE_THREAD("Main");
+
+    // parse options
+    unsigned int importThreadCount = 0;
+    int textureBudgetMB = 1024;
+    bool useBindless = true;
+    int pointLights = 0;
+    bool gpuLightCulling = false;
+    bool depthPrepass = false;
+    bool occlusionCulling = false;
+    BenchmarkOptions benchmark;
+    std::string startupTracePath;
+    // numeric values that don't parse or are out of range end up here rather than aborting
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--import-threads" && i + 1 < argc) {
+                importThreadCount = (unsigned int) std::stoul(argv[++i]);
+            } else if (arg == "--texture-budget-mb" && i + 1 < argc) {
+                textureBudgetMB = std::stoi(argv[++i]);
+            } else if (arg == "--no-bindless") {
+                useBindless = false;
+            } else if (arg == "--lights" && i + 1 < argc) {
+                pointLights = std::stoi(argv[++i]);
+            } else if (arg == "--gpu-light-culling") {
+                gpuLightCulling = true;
+            } else if (arg == "--depth-prepass") {
+                depthPrepass = true;
+            } else if (arg == "--occlusion-culling") {
+                occlusionCulling = true;
+            } else if (arg == "--benchmark" && i + 1 < argc) {
+                benchmark.cameraPathFile = argv[++i];
+            } else if (arg == "--frames" && i + 1 < argc) {
+                benchmark.frameCount = (uint32_t) std::stoul(argv[++i]);
+            } else if (arg == "--warmup" && i + 1 < argc) {
+                benchmark.warmupFrames = (uint32_t) std::stoul(argv[++i]);
+            } else if (arg == "--width" && i + 1 < argc) {
+                benchmark.width = (uint32_t) std::stoul(argv[++i]);
+            } else if (arg == "--height" && i + 1 < argc) {
+                benchmark.height = (uint32_t) std::stoul(argv[++i]);
+            } else if (arg == "--report" && i + 1 < argc) {
+                benchmark.reportPath = argv[++i];
+            } else if (arg == "--capture" && i + 1 < argc) {
+                // comma separated frame numbers
+                std::string frames = argv[++i];
+                size_t start = 0;
+                while (start < frames.size()) {
+                    size_t end = frames.find(',', start);
+                    if (end == std::string::npos) end = frames.size();
+                    if (end > start) {
+                        benchmark.captureFrames.push_back((uint32_t) std::stoul(frames.substr(start, end - start)));
+                    }
+                    start = end + 1;
+                }
+            } else if (arg == "--capture-prefix" && i + 1 < argc) {
+                benchmark.capturePrefix = argv[++i];
+            } else if (arg == "--gpu-trace" && i + 1 < argc) {
+                benchmark.gpuTracePath = argv[++i];
+            } else if (arg == "--cpu-trace" && i + 1 < argc) {
+                benchmark.cpuTracePath = argv[++i];
+            } else if (arg == "--startup-trace" && i + 1 < argc) {
+                startupTracePath = argv[++i];
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cout << "Invalid option value (" << e.what() << ")" << std::endl;
+        std::cout << "usage: opengl [--import-threads N] [--texture-budget-mb MB] [--no-bindless] "
+                     "[--lights N] [--gpu-light-culling] [--depth-prepass] [--occlusion-culling] "
+                     "[--benchmark camera_path [--frames N] [--warmup N] [--width W] [--height H] [--report file] "
+                     "[--capture N,N,...] [--capture-prefix prefix] [--gpu-trace file] [--cpu-trace file]] "
+                     "[--startup-trace file]" << std::endl;
+        return 1;
+    }
+
+    // headless, no window or imgui
+    if (!benchmark.cameraPathFile.empty()) {
+        benchmark.importThreadCount = importThreadCount;
+        benchmark.textureBudgetMB = textureBudgetMB;
+        benchmark.useBindless = useBindless;
+        benchmark.pointLights = pointLights;
+        benchmark.gpuLightCulling = gpuLightCulling;
+        benchmark.depthPrepass = depthPrepass;
+        benchmark.occlusionCulling = occlusionCulling;
+        return run_benchmark(benchmark);
+    }
+
     // create window
     auto windowFlags = (SDL_WindowFlags) SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
     SDL_Window *window = SDL_CreateWindow("OpenGL", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -66,13 +156,28 @@ int main(int argc, char *argv[]) {
     // create camera
     auto camera = FlyCamera(DEFAULT_FOV_DEG, (float) windowWidth / (float) windowHeight, 0.1f, 2000.0f);
 
-    // init renderer
+    // init renderer, timed so cold imports can be compared against warm mesh caches
+    auto initTimerStart = std::chrono::high_resolution_clock::now();
     GLRenderer::Renderer renderer;
+    renderer.importThreadCount = importThreadCount;
+    renderer.textureBudgetMB = textureBudgetMB;
+    renderer.useBindless = useBindless;
+    renderer.pointLightCount = pointLights;
+    renderer.gpuLightCulling = gpuLightCulling;
+    renderer.depthPrepass = depthPrepass;
+    renderer.occlusionCulling = occlusionCulling;
+    renderer.procAddressLoader = (GLADloadproc) SDL_GL_GetProcAddress;
     renderer.init(&camera, DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
     if (!renderer.isInitialized) {
         std::cout << "Failed to initialize renderer" << std::endl;
         return -1;
     }
+    std::chrono::duration<double, std::milli> initDuration = std::chrono::high_resolution_clock::now() - initTimerStart;
+    std::cout << "Renderer initialized in " << initDuration.count() << " ms" << std::endl;
+    if (!startupTracePath.empty() && CpuProfiler::write_trace(startupTracePath) &&
+        CpuProfiler::write_folded(startupTracePath + ".folded")) {
+        std::cout << "Startup trace written to " << startupTracePath << std::endl;
+    }
 
     double previousFrameTime = 0;
     SDL_Event e;
@@ -99,6 +204,10 @@ int main(int argc, char *argv[]) {
             if (e.type == SDL_MOUSEMOTION && !toggleUI) {
                 camera.process_mouse((float) e.motion.xrel, (float) e.motion.yrel);
             }
+            if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT && toggleUI &&
+                !ImGui::GetIO().WantCaptureMouse) {
+                renderer.pick(e.button.x, e.button.y);
+            }
             if (e.type == SDL_KEYDOWN) {
                 switch (e.key.keysym.sym) {
                     case SDLK_ESCAPE:
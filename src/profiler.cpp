@@ -0,0 +1,238 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    struct ThreadRing {
+        CpuZoneEvent events[CPU_PROFILER_RING_SIZE];
+        std::atomic<uint64_t> written{0};
+        uint32_t id = 0;
+        std::string name;
+    };
+
+    // rings outlive their threads so late exports still see pool workers
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+
+    thread_local ThreadRing *threadRing = nullptr;
+
+    struct Capture {
+        uint32_t framesLeft = 0;
+        uint64_t begin = 0;
+        bool started = false;
+        std::string tracePath;
+    };
+    std::mutex captureMutex;
+    Capture capture;
+    std::atomic<bool> capturing{false};
+
+    ThreadRing *register_thread() {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(std::make_unique<ThreadRing>());
+        ThreadRing *ring = rings.back().get();
+        ring->id = (uint32_t) rings.size() - 1;
+        ring->name = "Thread " + std::to_string(ring->id);
+        return ring;
+    }
+
+    struct ThreadEvents {
+        uint32_t id;
+        std::string name;
+        std::vector<CpuZoneEvent> events;
+    };
+
+    // copies the events inside [begin, end] from every ring, outer zones before the ones they contain
+    std::vector<ThreadEvents> collect_events(uint64_t begin, uint64_t end) {
+        std::vector<ThreadEvents> threads;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto &ring: rings) {
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > CPU_PROFILER_RING_SIZE ? written - CPU_PROFILER_RING_SIZE : 0;
+            ThreadEvents thread{ring->id, ring->name, {}};
+            thread.events.reserve((size_t) (written - first));
+            for (uint64_t i = first; i < written; i++) {
+                thread.events.push_back(ring->events[i % CPU_PROFILER_RING_SIZE]);
+            }
+
+            // the owner may have kept writing, drop what it overwrote meanwhile
+            uint64_t rewritten = ring->written.load(std::memory_order_acquire);
+            size_t overwritten = rewritten > CPU_PROFILER_RING_SIZE + first ?
+                                 (size_t) std::min<uint64_t>(rewritten - CPU_PROFILER_RING_SIZE - first,
+                                                             thread.events.size()) : 0;
+            thread.events.erase(thread.events.begin(), thread.events.begin() + (ptrdiff_t) overwritten);
+
+            thread.events.erase(std::remove_if(thread.events.begin(), thread.events.end(),
+                                               [begin, end](const CpuZoneEvent &event) {
+                                                   return event.start < begin || event.end > end;
+                                               }), thread.events.end());
+            std::sort(thread.events.begin(), thread.events.end(), [](const CpuZoneEvent &a, const CpuZoneEvent &b) {
+                return a.start != b.start ? a.start < b.start : a.end > b.end;
+            });
+            threads.push_back(std::move(thread));
+        }
+        return threads;
+    }
+
+    // pairs of ticks and steady_clock taken at startup, compared against a fresh pair to get the tick rate
+    const uint64_t originTicks = CpuProfiler::now();
+    const auto originTime = std::chrono::steady_clock::now();
+
+    double microseconds_per_tick() {
+        double elapsedTicks = (double) (CpuProfiler::now() - originTicks);
+        double elapsedUs = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - originTime).count();
+        return elapsedTicks > 0.0 ? elapsedUs / elapsedTicks : 0.0;
+    }
+
+    void write_json_string(std::ofstream &file, const std::string &value) {
+        file << '"';
+        for (char c: value) {
+            if (c == '"' || c == '\\') file << '\\';
+            file << c;
+        }
+        file << '"';
+    }
+}
+
+
+void CpuProfiler::record(const char *name, uint64_t start, uint64_t end) {
+    ThreadRing *ring = threadRing;
+    if (!ring) {
+        ring = threadRing = register_thread();
+    }
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    ring->events[index % CPU_PROFILER_RING_SIZE] = {name, start, end};
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::set_thread_name(const char *name) {
+    if (!threadRing) {
+        threadRing = register_thread();
+    }
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    threadRing->name = name;
+}
+
+void CpuProfiler::frame_mark() {
+    if (!capturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::string tracePath;
+    uint64_t begin;
+    uint64_t end = now();
+    {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        if (!capture.started) {
+            capture.started = true;
+            capture.begin = end;
+            return;
+        }
+        if (--capture.framesLeft > 0) {
+            return;
+        }
+        tracePath = capture.tracePath;
+        begin = capture.begin;
+        capture = Capture();
+        capturing = false;
+    }
+
+    std::string foldedPath = tracePath + ".folded";
+    if (write_trace(tracePath, begin, end) && write_folded(foldedPath, begin, end)) {
+        std::cout << "CPU trace written to " << tracePath << " and " << foldedPath << std::endl;
+    }
+}
+
+void CpuProfiler::start_capture(uint32_t frameCount, const std::string &tracePath) {
+    if (frameCount == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(captureMutex);
+    capture = Capture();
+    capture.framesLeft = frameCount;
+    capture.tracePath = tracePath;
+    capturing = true;
+}
+
+bool CpuProfiler::is_capturing() {
+    return capturing.load(std::memory_order_relaxed);
+}
+
+bool CpuProfiler::write_trace(const std::string &filePath, uint64_t begin, uint64_t end) {
+    std::ofstream file(filePath, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "Failed to write CPU trace " << filePath << std::endl;
+        return false;
+    }
+
+    // complete events in microseconds, one Chrome thread per ring
+    std::vector<ThreadEvents> threads = collect_events(begin, end);
+    double usPerTick = microseconds_per_tick();
+    file << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (auto &thread: threads) {
+        file << (first ? "" : ",\n") << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+             << thread.id << ", \"args\": {\"name\": ";
+        write_json_string(file, thread.name);
+        file << "}}";
+        first = false;
+        for (auto &event: thread.events) {
+            file << ",\n  {\"name\": ";
+            write_json_string(file, event.name);
+            file << ", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread.id << ", \"ts\": "
+                 << (double) (int64_t) (event.start - originTicks) * usPerTick << ", \"dur\": "
+                 << (double) (event.end - event.start) * usPerTick
+                 << "}";
+        }
+    }
+    file << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return true;
+}
+
+bool CpuProfiler::write_folded(const std::string &filePath, uint64_t begin, uint64_t end) {
+    std::ofstream file(filePath, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "Failed to write folded stacks " << filePath << std::endl;
+        return false;
+    }
+
+    // zones on a thread nest by time, so a stack of open zones gives each one's path and self time
+    std::map<std::string, uint64_t> selfTimes;
+    for (auto &thread: collect_events(begin, end)) {
+        struct OpenZone {
+            std::string path;
+            uint64_t end;
+            uint64_t selfTime;
+        };
+        std::vector<OpenZone> stack;
+        auto close_zone = [&selfTimes, &stack]() {
+            selfTimes[stack.back().path] += stack.back().selfTime;
+            stack.pop_back();
+        };
+        for (auto &event: thread.events) {
+            while (!stack.empty() && stack.back().end <= event.start) {
+                close_zone();
+            }
+            uint64_t duration = event.end - event.start;
+            if (!stack.empty()) {
+                stack.back().selfTime -= std::min(stack.back().selfTime, duration);
+            }
+            std::string path = (stack.empty() ? thread.name : stack.back().path) + ";" + event.name;
+            stack.push_back({path, event.end, duration});
+        }
+        while (!stack.empty()) {
+            close_zone();
+        }
+    }
+    double usPerTick = microseconds_per_tick();
+    for (auto &it: selfTimes) {
+        file << it.first << " " << (uint64_t) ((double) it.second * usPerTick) << "\n";
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_PROFILER_TSC
+#endif
+
+// CPU zones recorded into per-thread rings; without ENABLE_CPU_PROFILER the macros compile to nothing
+#ifdef ENABLE_CPU_PROFILER
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+// name must be a string literal, it is kept by pointer
+#define PROFILE_ZONE(name) CpuZoneScope PROFILER_CONCAT(cpuZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) CpuProfiler::set_thread_name(name)
+#define PROFILE_FRAME() CpuProfiler::frame_mark()
+#else
+#define PROFILE_ZONE(name) ((void) 0)
+#define PROFILE_FUNCTION() ((void) 0)
+#define PROFILE_THREAD(name) ((void) 0)
+#define PROFILE_FRAME() ((void) 0)
+#endif
+
+// events each thread keeps, older ones are overwritten
+constexpr uint32_t CPU_PROFILER_RING_SIZE = 1 << 14;
+
+struct CpuZoneEvent {
+    const char *name;
+    // ticks of CpuProfiler::now()
+    uint64_t start;
+    uint64_t end;
+};
+
+// every thread writes only its own ring, so recording is a store and a release of the write index;
+// readers copy a ring and drop whatever was overwritten while they read it
+class CpuProfiler {
+public:
+    // the TSC where there is one, it is several times cheaper than steady_clock; converted to time on export
+    static uint64_t now() {
+#ifdef CPU_PROFILER_TSC
+        return __rdtsc();
+#else
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void record(const char *name, uint64_t start, uint64_t end);
+
+    // names the calling thread in exports
+    static void set_thread_name(const char *name);
+
+    // called once per frame from the main thread, starts and ends captures on frame boundaries
+    static void frame_mark();
+
+    // the next frameCount frames are written as a Chrome trace and a folded stack file when they are done
+    static void start_capture(uint32_t frameCount, const std::string &tracePath);
+
+    static bool is_capturing();
+
+    // everything still in the rings between the two times, startup included if nothing overwrote it
+    static bool write_trace(const std::string &filePath, uint64_t begin = 0, uint64_t end = UINT64_MAX);
+
+    // "a;b;c self_us" lines for flamegraph.pl or speedscope
+    static bool write_folded(const std::string &filePath, uint64_t begin = 0, uint64_t end = UINT64_MAX);
+};
+
+class CpuZoneScope {
+public:
+    explicit CpuZoneScope(const char *name) : _name(name), _start(CpuProfiler::now()) {}
+
+    ~CpuZoneScope() {
+        CpuProfiler::record(_name, _start, CpuProfiler::now());
+    }
+
+    CpuZoneScope(const CpuZoneScope &) = delete;
+
+    CpuZoneScope &operator=(const CpuZoneScope &) = delete;
+
+private:
+    const char *_name;
+    uint64_t _start;
+};
@@ -0,0 +1,95 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include "profiler.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the calling thread also works on jobs, so spawn one less
+    for (unsigned int i = 1; i < threadCount; i++) {
+        _workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeCondition.notify_all();
+    for (auto &worker: _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)> &func) {
+    if (count == 0) {
+        return;
+    }
+
+    // serial path, no synchronization needed
+    if (_workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &func;
+        _jobCount = count;
+        _nextIndex = 0;
+        _finishedCount = 0;
+        _jobGeneration++;
+    }
+    _wakeCondition.notify_all();
+
+    run_job_items();
+
+    // wait for the remaining items and for every worker to let go of the job
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCondition.wait(lock, [this] { return _finishedCount == _jobCount && _activeWorkers == 0; });
+    _job = nullptr;
+}
+
+unsigned int ThreadPool::thread_count() const {
+    return (unsigned int) _workers.size() + 1;
+}
+
+void ThreadPool::worker_loop() {
+    PROFILE_THREAD("Pool Worker");
+    uint64_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeCondition.wait(lock, [this, seenGeneration] {
+                return _quit || (_job && _jobGeneration != seenGeneration);
+            });
+            if (_quit) {
+                return;
+            }
+            seenGeneration = _jobGeneration;
+            _activeWorkers++;
+        }
+
+        run_job_items();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _activeWorkers--;
+        }
+        _doneCondition.notify_all();
+    }
+}
+
+void ThreadPool::run_job_items() {
+    size_t index;
+    while ((index = _nextIndex.fetch_add(1)) < _jobCount) {
+        (*_job)(index);
+        _finishedCount.fetch_add(1);
+    }
+}
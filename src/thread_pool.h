@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // 0 picks the hardware thread count, 1 runs everything on the calling thread
+    explicit ThreadPool(unsigned int threadCount = 0);
+
+    ~ThreadPool();
+
+    // runs func(i) for every i in [0, count) across the pool and the calling thread, returns when all are done
+    void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+    unsigned int thread_count() const;
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wakeCondition;
+    std::condition_variable _doneCondition;
+    bool _quit = false;
+
+    // current job, guarded by _mutex apart from the atomics
+    const std::function<void(size_t)> *_job = nullptr;
+    size_t _jobCount = 0;
+    uint64_t _jobGeneration = 0;
+    std::atomic<size_t> _nextIndex{0};
+    std::atomic<size_t> _finishedCount{0};
+    unsigned int _activeWorkers = 0;
+
+    void worker_loop();
+
+    void run_job_items();
+};
@@ -0,0 +1,377 @@
+// Offline texture baker: turns source images into .btex containers holding a full
+// block-compressed mip chain, which TextureManager uploads directly.
+//
+// usage: texbake [--force] [--threads N] [--format auto|bc1|bc3|bc5] [--model file.gltf]... [image]...
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <stb_image.h>
+
+#define STB_DXT_IMPLEMENTATION
+
+#include <stb_dxt.h>
+#include <glad/glad.h>
+#include <gl/baked_texture.h>
+#include <thread_pool.h>
+
+using namespace GLRenderer;
+
+enum class TextureUsage {
+    Color,
+    Normal,
+    Data
+};
+
+struct BakeJob {
+    std::string path;
+    TextureUsage usage = TextureUsage::Color;
+    // 0 picks a format from the usage and image contents
+    uint32_t format = 0;
+};
+
+struct BakeResult {
+    bool baked = false;
+    bool skipped = false;
+    uint32_t format = 0;
+    int width = 0;
+    int height = 0;
+    size_t levelCount = 0;
+    size_t uncompressedBytes = 0;
+    size_t bakedBytes = 0;
+    double decodeMs = 0;
+    double bakeMs = 0;
+    double loadBakedMs = 0;
+};
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+static float srgb_to_linear(unsigned char value) {
+    return std::pow((float) value / 255.0f, 2.2f);
+}
+
+static unsigned char linear_to_srgb(float value) {
+    return (unsigned char) std::lround(std::pow(std::clamp(value, 0.0f, 1.0f), 1.0f / 2.2f) * 255.0f);
+}
+
+// 2x2 box filter; color is averaged in linear space, normals are renormalized
+static Image downsample(const Image &source, TextureUsage usage) {
+    Image result;
+    result.width = std::max(1, source.width / 2);
+    result.height = std::max(1, source.height / 2);
+    result.pixels.resize((size_t) result.width * result.height * 4);
+
+    for (int y = 0; y < result.height; y++) {
+        for (int x = 0; x < result.width; x++) {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int sy = 0; sy < 2; sy++) {
+                for (int sx = 0; sx < 2; sx++) {
+                    int px = std::min(x * 2 + sx, source.width - 1);
+                    int py = std::min(y * 2 + sy, source.height - 1);
+                    const unsigned char *texel = &source.pixels[((size_t) py * source.width + px) * 4];
+                    for (int c = 0; c < 4; c++) {
+                        if (usage == TextureUsage::Color && c < 3) {
+                            sum[c] += srgb_to_linear(texel[c]);
+                        } else if (usage == TextureUsage::Normal && c < 3) {
+                            sum[c] += (float) texel[c] / 255.0f * 2.0f - 1.0f;
+                        } else {
+                            sum[c] += (float) texel[c] / 255.0f;
+                        }
+                    }
+                }
+            }
+
+            unsigned char *texel = &result.pixels[((size_t) y * result.width + x) * 4];
+            if (usage == TextureUsage::Normal) {
+                float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                if (length < 1e-6f) {
+                    sum[0] = 0.0f;
+                    sum[1] = 0.0f;
+                    sum[2] = 1.0f;
+                    length = 1.0f;
+                }
+                for (int c = 0; c < 3; c++) {
+                    texel[c] = (unsigned char) std::lround((sum[c] / length * 0.5f + 0.5f) * 255.0f);
+                }
+                texel[3] = (unsigned char) std::lround(sum[3] / 4.0f * 255.0f);
+            } else {
+                for (int c = 0; c < 4; c++) {
+                    if (usage == TextureUsage::Color && c < 3) {
+                        texel[c] = linear_to_srgb(sum[c] / 4.0f);
+                    } else {
+                        texel[c] = (unsigned char) std::lround(sum[c] / 4.0f * 255.0f);
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// compresses one level, edge blocks repeat the last row and column
+static void compress_level(const Image &image, uint32_t format, std::vector<unsigned char> &output) {
+    uint32_t blockSize = baked_block_size(format);
+    int blocksX = (image.width + 3) / 4;
+    int blocksY = (image.height + 3) / 4;
+    size_t start = output.size();
+    output.resize(start + (size_t) blocksX * blocksY * blockSize);
+
+    unsigned char block[16 * 4];
+    unsigned char blockRG[16 * 2];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    int px = std::min(bx * 4 + x, image.width - 1);
+                    int py = std::min(by * 4 + y, image.height - 1);
+                    const unsigned char *texel = &image.pixels[((size_t) py * image.width + px) * 4];
+                    std::memcpy(&block[(y * 4 + x) * 4], texel, 4);
+                    blockRG[(y * 4 + x) * 2] = texel[0];
+                    blockRG[(y * 4 + x) * 2 + 1] = texel[1];
+                }
+            }
+
+            unsigned char *dest = &output[start + ((size_t) by * blocksX + bx) * blockSize];
+            if (format == GL_COMPRESSED_RG_RGTC2) {
+                stb_compress_bc5_block(dest, blockRG);
+            } else {
+                int alpha = format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 1 : 0;
+                stb_compress_dxt_block(dest, block, alpha, STB_DXT_HIGHQUAL);
+            }
+        }
+    }
+}
+
+static uint32_t pick_format(const Image &image, TextureUsage usage) {
+    if (usage == TextureUsage::Normal || usage == TextureUsage::Data) {
+        // the shader only samples two channels of normal and metal/roughness maps
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+        if (image.pixels[i] != 255) {
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+    }
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+static bool is_up_to_date(const std::string &sourcePath, const std::string &bakedPath) {
+    std::error_code error;
+    auto bakedTime = std::filesystem::last_write_time(bakedPath, error);
+    if (error) return false;
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    if (error) return false;
+    return bakedTime >= sourceTime;
+}
+
+static BakeResult bake_texture(const BakeJob &job, bool force) {
+    using Clock = std::chrono::high_resolution_clock;
+    BakeResult result;
+    std::string bakedPath = baked_texture_path(job.path);
+    if (!force && is_up_to_date(job.path, bakedPath)) {
+        result.skipped = true;
+        return result;
+    }
+
+    // decode, timed since this is what the runtime does without a baked file
+    auto decodeStart = Clock::now();
+    int channels;
+    Image level;
+    stbi_uc *pixels = stbi_load(job.path.c_str(), &level.width, &level.height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        return result;
+    }
+    level.pixels.assign(pixels, pixels + (size_t) level.width * level.height * 4);
+    stbi_image_free(pixels);
+    result.decodeMs = std::chrono::duration<double, std::milli>(Clock::now() - decodeStart).count();
+
+    // build and compress the mip chain down to 1x1
+    auto bakeStart = Clock::now();
+    BakedTexture baked;
+    baked.format = job.format ? job.format : pick_format(level, job.usage);
+    baked.width = (uint32_t) level.width;
+    baked.height = (uint32_t) level.height;
+    while (true) {
+        BakedTextureLevel bakedLevel{};
+        bakedLevel.offset = baked.data.size();
+        bakedLevel.width = (uint32_t) level.width;
+        bakedLevel.height = (uint32_t) level.height;
+        compress_level(level, baked.format, baked.data);
+        bakedLevel.size = baked.data.size() - bakedLevel.offset;
+        baked.levels.push_back(bakedLevel);
+
+        if (level.width == 1 && level.height == 1) {
+            break;
+        }
+        level = downsample(level, job.usage);
+    }
+    if (!write_baked_texture(bakedPath, baked)) {
+        std::cout << "Failed to write " << bakedPath << std::endl;
+        return result;
+    }
+    result.bakeMs = std::chrono::duration<double, std::milli>(Clock::now() - bakeStart).count();
+
+    // read the container back the same way the runtime does
+    auto loadStart = Clock::now();
+    std::ifstream file(bakedPath, std::ios::binary);
+    std::vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    BakedTexture check;
+    if (!parse_baked_texture(contents, check)) {
+        std::cout << "Failed to read back " << bakedPath << std::endl;
+        return result;
+    }
+    result.loadBakedMs = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+
+    result.baked = true;
+    result.format = baked.format;
+    result.width = (int) baked.width;
+    result.height = (int) baked.height;
+    result.levelCount = baked.levels.size();
+    // the runtime fallback uploads RGBA8 without mips
+    result.uncompressedBytes = (size_t) baked.width * baked.height * 4;
+    result.bakedBytes = baked.data.size();
+    return result;
+}
+
+static void add_model_textures(const std::string &modelPath, std::vector<BakeJob> &jobs) {
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(modelPath, 0);
+    if (!scene) {
+        std::cout << "Assimp error: " << importer.GetErrorString() << std::endl;
+        return;
+    }
+
+    // same lookups as Model::process_mesh
+    std::string directory = modelPath.substr(0, modelPath.find_last_of('/'));
+    const std::pair<aiTextureType, TextureUsage> textureTypes[] = {
+            {aiTextureType_BASE_COLOR,        TextureUsage::Color},
+            {aiTextureType_NORMALS,           TextureUsage::Normal},
+            {aiTextureType_DIFFUSE_ROUGHNESS, TextureUsage::Data},
+    };
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+        aiMaterial *material = scene->mMaterials[i];
+        for (auto &textureType: textureTypes) {
+            if (!material->GetTextureCount(textureType.first)) {
+                continue;
+            }
+            aiString str;
+            material->GetTexture(textureType.first, 0, &str);
+            std::string fullPath = directory + '/' + str.C_Str();
+            auto existing = std::find_if(jobs.begin(), jobs.end(), [&fullPath](const BakeJob &job) {
+                return job.path == fullPath;
+            });
+            if (existing == jobs.end()) {
+                jobs.push_back({fullPath, textureType.second, 0});
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool force = false;
+    unsigned int threadCount = 0;
+    uint32_t format = 0;
+    std::vector<BakeJob> jobs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--force") {
+            force = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            std::string count = argv[++i];
+            try {
+                threadCount = (unsigned int) std::stoul(count);
+            } catch (const std::exception &) {
+                std::cout << "Invalid thread count " << count << std::endl;
+                return 1;
+            }
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string formatName = argv[++i];
+            if (formatName == "bc1") format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            else if (formatName == "bc3") format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            else if (formatName == "bc5") format = GL_COMPRESSED_RG_RGTC2;
+            else if (formatName == "auto") format = 0;
+            else {
+                std::cout << "Unknown format " << formatName << std::endl;
+                return 1;
+            }
+        } else if (arg == "--model" && i + 1 < argc) {
+            add_model_textures(argv[++i], jobs);
+        } else {
+            jobs.push_back({arg, TextureUsage::Color, format});
+        }
+    }
+
+    if (jobs.empty()) {
+        std::cout << "usage: texbake [--force] [--threads N] [--format auto|bc1|bc3|bc5] [--model file.gltf]... "
+                     "[image]..." << std::endl;
+        return 1;
+    }
+
+    auto bakeStart = std::chrono::high_resolution_clock::now();
+    std::vector<BakeResult> results(jobs.size());
+    std::mutex printMutex;
+    ThreadPool pool(threadCount);
+    pool.parallel_for(jobs.size(), [&](size_t i) {
+        results[i] = bake_texture(jobs[i], force);
+
+        std::lock_guard<std::mutex> lock(printMutex);
+        const BakeResult &result = results[i];
+        if (result.skipped) {
+            std::cout << jobs[i].path << ": up to date" << std::endl;
+        } else if (!result.baked) {
+            std::cout << jobs[i].path << ": failed" << std::endl;
+        } else {
+            std::cout << jobs[i].path << ": " << result.width << "x" << result.height << " "
+                      << baked_format_name(result.format) << ", " << result.levelCount << " levels, "
+                      << result.uncompressedBytes / 1024 << " KB -> " << result.bakedBytes / 1024 << " KB ("
+                      << (double) result.uncompressedBytes / (double) result.bakedBytes << "x), decode "
+                      << result.decodeMs << " ms vs baked load " << result.loadBakedMs << " ms" << std::endl;
+        }
+    });
+    std::chrono::duration<double> bakeDuration = std::chrono::high_resolution_clock::now() - bakeStart;
+
+    // totals over everything baked in this run
+    size_t bakedCount = 0, failedCount = 0, uncompressedBytes = 0, bakedBytes = 0;
+    double decodeMs = 0, loadBakedMs = 0;
+    for (auto &result: results) {
+        if (result.baked) {
+            bakedCount++;
+            uncompressedBytes += result.uncompressedBytes;
+            bakedBytes += result.bakedBytes;
+            decodeMs += result.decodeMs;
+            loadBakedMs += result.loadBakedMs;
+        } else if (!result.skipped) {
+            failedCount++;
+        }
+    }
+    std::cout << "Baked " << bakedCount << " textures (" << failedCount << " failed) in " << bakeDuration.count()
+              << " s with " << pool.thread_count() << " threads" << std::endl;
+    if (bakedCount > 0) {
+        std::cout << "Texture memory: " << (double) uncompressedBytes / (1024.0 * 1024.0) << " MB RGBA8 -> "
+                  << (double) bakedBytes / (1024.0 * 1024.0) << " MB baked with mips ("
+                  << (double) uncompressedBytes / (double) bakedBytes << "x less)" << std::endl;
+        std::cout << "Load time: " << decodeMs << " ms decoding sources vs " << loadBakedMs
+                  << " ms reading baked files" << std::endl;
+    }
+
+    return failedCount > 0 ? 1 : 0;
+}